@@ -28,7 +28,7 @@
 
 /* these error strings are only for debugging purposes, and */
 /* do not need to be translated */
-static const char *mp4tagerrmsgs [] = {
+static const char * const mp4tagerrmsgs [] = {
   [MP4TAG_OK] = "ok",
   [MP4TAG_FINISH] = "finish",
   [MP4TAG_ERR_BAD_STRUCT] = "bad structure",
@@ -49,6 +49,8 @@ static const char *mp4tagerrmsgs [] = {
   [MP4TAG_ERR_NOT_PARSED] = "not parsed",
   [MP4TAG_ERR_CANNOT_WRITE] = "cannot write",
   [MP4TAG_ERR_NO_CALLBACK] = "no callback",
+  [MP4TAG_NEED_DATA] = "need data",
+  [MP4TAG_NEED_SKIP] = "need skip",
 };
 
 typedef struct libmp4tagpreserve {
@@ -58,8 +60,12 @@ typedef struct libmp4tagpreserve {
 
 static libmp4tag_t *mp4tag_alloc (int *mp4error);
 static void mp4tag_free_tags (libmp4tag_t *libmp4tag);
-static void mp4tag_copy_to_pub (mp4tagpub_t *mp4tagpub, mp4tag_t *mp4tag);
+static void mp4tag_free_cotables (libmp4tag_t *libmp4tag);
+static int  mp4tag_copy_to_pub (libmp4tag_t *libmp4tag, mp4tagpub_t *mp4tagpub, mp4tag_t *mp4tag);
 static void mp4tag_init_tags (libmp4tag_t *libmp4tag);
+static void mp4tag_free_filter (libmp4tag_t *libmp4tag);
+static libmp4tag_t *mp4tag_open_file (const char *fn, bool readonly, int *mp4error);
+static int mp4tag_open_fh (libmp4tag_t *libmp4tag, const char *fn, bool readonly);
 #if LIBMP4TAG_DEBUG
 static void enable_core_dump (void);
 #endif
@@ -68,16 +74,23 @@ NODISCARD
 libmp4tag_t *
 mp4tag_open (const char *fn, int *mp4error)
 {
-  libmp4tag_t   *libmp4tag = NULL;
-  int           rc;
+  return mp4tag_open_file (fn, false, mp4error);
+}
 
-#if LIBMP4TAG_DEBUG
-  enable_core_dump ();
-#endif
-  if (fn == NULL) {
-    *mp4error = MP4TAG_ERR_NULL_VALUE;
-    return NULL;
-  }
+NODISCARD
+libmp4tag_t *
+mp4tag_open_readonly (const char *fn, int *mp4error)
+{
+  return mp4tag_open_file (fn, true, mp4error);
+}
+
+NODISCARD
+libmp4tag_t *
+mp4tag_openstream (mp4tag_readcb_t readcb, mp4tag_seekcb_t seekcb,
+    void *userdata, uint32_t timeout, int *mp4error)
+{
+  libmp4tag_t *libmp4tag = NULL;
+  int         rc;
 
   *mp4error = MP4TAG_OK;
   libmp4tag = mp4tag_alloc (mp4error);
@@ -85,51 +98,40 @@ mp4tag_open (const char *fn, int *mp4error)
     return NULL;
   }
 
-  libmp4tag->fh = mp4tag_fopen (fn, "rb+");
-  if (libmp4tag->fh == NULL) {
-    /* if the file cannot be opened, try opening w/o write capabilities */
-    libmp4tag->fh = mp4tag_fopen (fn, "rb");
-    if (libmp4tag->fh == NULL) {
-      *mp4error = MP4TAG_ERR_FILE_NOT_FOUND;
-      libmp4tag->libmp4tagident = 0;
-      free (libmp4tag);
-      return NULL;
-    }
-    libmp4tag->canwrite = false;
-  }
+  libmp4tag->readcb = readcb;
+  libmp4tag->seekcb = seekcb;
+  libmp4tag->userdata = userdata;
 
   /* needed for parse, write */
-  libmp4tag->filesz = mp4tag_file_size (fn);
+  libmp4tag->filesz = MP4TAG_NO_FILESZ;
+
+  libmp4tag->isstream = true;
+  libmp4tag->canwrite = false;
+  libmp4tag->timeout = timeout;
   libmp4tag->offset = 0;
 
   rc = mp4tag_parse_ftyp (libmp4tag);
   if (rc != MP4TAG_OK) {
     *mp4error = rc;
-    fclose (libmp4tag->fh);
     libmp4tag->libmp4tagident = 0;
     free (libmp4tag);
     return NULL;
   }
 
-  libmp4tag->fn = strdup (fn);
-  if (libmp4tag->fn == NULL) {
-    *mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
-    fclose (libmp4tag->fh);
-    libmp4tag->libmp4tagident = 0;
-    free (libmp4tag);
-    return NULL;
-  }
+  /* the read-ahead buffer is off unless it is set with */
+  /* mp4tag_set_read_buffer, the read callback is only asked for */
+  /* the data the parser needs */
 
   return libmp4tag;
 }
 
+/* the data is pushed to the parser using mp4tag_feed. */
+/* the 'ftyp' check is done once enough data has been fed */
 NODISCARD
 libmp4tag_t *
-mp4tag_openstream (mp4tag_readcb_t readcb, mp4tag_seekcb_t seekcb,
-    void *userdata, uint32_t timeout, int *mp4error)
+mp4tag_openfeed (int *mp4error)
 {
   libmp4tag_t *libmp4tag = NULL;
-  int         rc;
 
   *mp4error = MP4TAG_OK;
   libmp4tag = mp4tag_alloc (mp4error);
@@ -137,26 +139,15 @@ mp4tag_openstream (mp4tag_readcb_t readcb, mp4tag_seekcb_t seekcb,
     return NULL;
   }
 
-  libmp4tag->readcb = readcb;
-  libmp4tag->seekcb = seekcb;
-  libmp4tag->userdata = userdata;
-
   /* needed for parse, write */
   libmp4tag->filesz = MP4TAG_NO_FILESZ;
 
+  /* a feed is processed as a stream, the data cannot be re-read */
   libmp4tag->isstream = true;
+  libmp4tag->isfeed = true;
   libmp4tag->canwrite = false;
-  libmp4tag->timeout = timeout;
   libmp4tag->offset = 0;
 
-  rc = mp4tag_parse_ftyp (libmp4tag);
-  if (rc != MP4TAG_OK) {
-    *mp4error = rc;
-    libmp4tag->libmp4tagident = 0;
-    free (libmp4tag);
-    return NULL;
-  }
-
   return libmp4tag;
 }
 
@@ -184,9 +175,17 @@ mp4tag_parse (libmp4tag_t *libmp4tag)
   }
 
   if (! libmp4tag->isstream) {
-    offset = mp4tag_ftell (libmp4tag->fh);
+    offset = libmp4tag->offset;
+    if ((libmp4tag->options & MP4TAG_OPTION_MMAP) == MP4TAG_OPTION_MMAP) {
+      /* if the mapping fails, the standard file i/o is used */
+      mp4tag_map_file (libmp4tag);
+    }
   }
-  mp4tag_parse_file (libmp4tag, 0, 0);
+  mp4tag_parse_file (libmp4tag);
+  /* the mapping and the file read-ahead buffer are only used */
+  /* by the parser */
+  mp4tag_unmap_file (libmp4tag);
+  mp4tag_release_read_buffer (libmp4tag);
 
   if (libmp4tag->mp4error == MP4TAG_OK) {
     if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_BUG) ||
@@ -201,18 +200,167 @@ mp4tag_parse (libmp4tag_t *libmp4tag)
       /* version 1.3.x would not calculate the correct lengths */
       /* for the containers if two free boxes got combined */
       mp4tag_update_parent_lengths (libmp4tag, libmp4tag->fh, - libmp4tag->ilst_remaining);
-      if (fseek (libmp4tag->fh, offset, SEEK_SET) == 0) {
-        mp4tag_free_tags (libmp4tag);
-        mp4tag_init_tags (libmp4tag);
-        libmp4tag->offset = offset;
-        mp4tag_parse_file (libmp4tag, 0, 0);
-      }
+      mp4tag_free_tags (libmp4tag);
+      mp4tag_free_cotables (libmp4tag);
+      mp4tag_init_tags (libmp4tag);
+      libmp4tag->offset = offset;
+      mp4tag_parse_file (libmp4tag);
+      mp4tag_release_read_buffer (libmp4tag);
     }
     libmp4tag->parsed = true;
+    /* the index is built now rather than by the first search, */
+    /* so that the search does not change the handle */
+    mp4tag_index_build (libmp4tag);
   }
   return libmp4tag->mp4error;
 }
 
+/* the data must start at the offset returned by mp4tag_feed_offset. */
+/* a null buffer or a zero length indicates the end of the data */
+int
+mp4tag_feed (libmp4tag_t *libmp4tag, const char *buff, size_t len)
+{
+  char        *tbuff;
+  int         rc;
+
+  if (libmp4tag == NULL || libmp4tag->libmp4tagident != MP4TAG_IDENT) {
+    return MP4TAG_ERR_BAD_STRUCT;
+  }
+
+  if (! libmp4tag->isfeed) {
+    libmp4tag->mp4error = MP4TAG_ERR_UNABLE_TO_PROCESS;
+    return libmp4tag->mp4error;
+  }
+
+  if (libmp4tag->parsed) {
+    /* any further data is not needed */
+    return MP4TAG_OK;
+  }
+
+  libmp4tag->mp4error = MP4TAG_OK;
+
+  if (buff == NULL || len == 0) {
+    libmp4tag->feedend = true;
+  } else {
+    if (libmp4tag->feedlen + len > libmp4tag->feedalloc) {
+      size_t    allocsz;
+
+      allocsz = libmp4tag->feedalloc * 2;
+      if (allocsz < libmp4tag->feedlen + len) {
+        allocsz = libmp4tag->feedlen + len;
+      }
+      /* room for the entire box the parse is waiting for */
+      if (libmp4tag->feedwant > libmp4tag->feedoffset &&
+          (uint64_t) (libmp4tag->feedwant - libmp4tag->feedoffset) > allocsz &&
+          (uint64_t) (libmp4tag->feedwant - libmp4tag->feedoffset) < SIZE_MAX / 2) {
+        allocsz = libmp4tag->feedwant - libmp4tag->feedoffset;
+      }
+      tbuff = realloc (libmp4tag->feedbuff, allocsz);
+      if (tbuff == NULL) {
+        libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+        return libmp4tag->mp4error;
+      }
+      libmp4tag->feedbuff = tbuff;
+      libmp4tag->feedalloc = allocsz;
+    }
+    memcpy (libmp4tag->feedbuff + libmp4tag->feedlen, buff, len);
+    libmp4tag->feedlen += len;
+  }
+
+  if (! libmp4tag->feedend &&
+      libmp4tag->feedoffset + (int64_t) libmp4tag->feedlen <
+      libmp4tag->feedwant) {
+    /* the parse would only be suspended again */
+    return MP4TAG_NEED_DATA;
+  }
+
+  rc = mp4tag_feed_file (libmp4tag);
+  if (rc != MP4TAG_NEED_DATA && rc != MP4TAG_NEED_SKIP) {
+    /* done, the buffered data is no longer needed */
+    if (libmp4tag->feedbuff != NULL) {
+      free (libmp4tag->feedbuff);
+      libmp4tag->feedbuff = NULL;
+    }
+    libmp4tag->feedlen = 0;
+    libmp4tag->feedalloc = 0;
+    if (rc == MP4TAG_OK) {
+      libmp4tag->parsed = true;
+      mp4tag_index_build (libmp4tag);
+    }
+  }
+
+  return rc;
+}
+
+/* returns the offset at which the next data to be fed must start */
+NODISCARD
+int64_t
+mp4tag_feed_offset (libmp4tag_t *libmp4tag)
+{
+  if (libmp4tag == NULL || libmp4tag->libmp4tagident != MP4TAG_IDENT) {
+    return 0;
+  }
+
+  return libmp4tag->feedoffset + (int64_t) libmp4tag->feedlen;
+}
+
+int
+mp4tag_probe (libmp4tag_t *libmp4tag, mp4tagprobe_t *mp4tagprobe)
+{
+  int64_t     saveoffset;
+
+  if (libmp4tag == NULL || libmp4tag->libmp4tagident != MP4TAG_IDENT) {
+    return MP4TAG_ERR_BAD_STRUCT;
+  }
+
+  if (mp4tagprobe == NULL) {
+    libmp4tag->mp4error = MP4TAG_ERR_NULL_VALUE;
+    return libmp4tag->mp4error;
+  }
+
+  libmp4tag->mp4error = MP4TAG_OK;
+
+  if (! libmp4tag->isstream && libmp4tag->fh == NULL) {
+    libmp4tag->mp4error = MP4TAG_ERR_NOT_OPEN;
+    return libmp4tag->mp4error;
+  }
+  if (libmp4tag->isstream &&
+      (libmp4tag->readcb == NULL ||
+      libmp4tag->seekcb == NULL)) {
+    libmp4tag->mp4error = MP4TAG_ERR_NO_CALLBACK;
+    return libmp4tag->mp4error;
+  }
+
+  /* if the file has already been parsed, the values are known. */
+  /* a read-only parse does not process the tracks if the duration */
+  /* was found in the 'mvhd' box, and the sample rate is not known */
+  if (! libmp4tag->parsed ||
+      (libmp4tag->readonly && libmp4tag->samplerate == 0)) {
+    saveoffset = libmp4tag->offset;
+
+    if (libmp4tag->parsed) {
+      /* start again from the beginning of the file */
+      libmp4tag->offset = 0;
+    }
+
+    mp4tag_probe_file (libmp4tag);
+    libmp4tag->parsedone = false;
+    mp4tag_release_read_buffer (libmp4tag);
+
+    /* a file may still be parsed after the probe */
+    if (! libmp4tag->isstream) {
+      libmp4tag->offset = saveoffset;
+    }
+  }
+
+  mp4tagprobe->duration = libmp4tag->duration;
+  mp4tagprobe->samplerate = libmp4tag->samplerate;
+  mp4tagprobe->creationdate = libmp4tag->creationdate;
+  mp4tagprobe->modifieddate = libmp4tag->modifieddate;
+
+  return libmp4tag->mp4error;
+}
+
 void
 mp4tag_free (libmp4tag_t *libmp4tag)
 {
@@ -220,6 +368,7 @@ mp4tag_free (libmp4tag_t *libmp4tag)
     return;
   }
 
+  mp4tag_unmap_file (libmp4tag);
   if (libmp4tag->isstream == false && libmp4tag->fh != NULL) {
     fclose (libmp4tag->fh);
   }
@@ -230,7 +379,23 @@ mp4tag_free (libmp4tag_t *libmp4tag)
     libmp4tag->fn = NULL;
   }
 
+  if (libmp4tag->rabuff != NULL) {
+    free (libmp4tag->rabuff);
+    libmp4tag->rabuff = NULL;
+  }
+
+  if (libmp4tag->feedbuff != NULL) {
+    free (libmp4tag->feedbuff);
+    libmp4tag->feedbuff = NULL;
+  }
+  if (libmp4tag->feedwalk != NULL) {
+    free (libmp4tag->feedwalk);
+    libmp4tag->feedwalk = NULL;
+  }
+
+  mp4tag_free_filter (libmp4tag);
   mp4tag_free_tags (libmp4tag);
+  mp4tag_free_cotables (libmp4tag);
 
   libmp4tag->libmp4tagident = 0;
   free (libmp4tag);
@@ -260,6 +425,7 @@ mp4tag_get_tag_by_name (libmp4tag_t *libmp4tag, const char *tag,
   int     idx = -1;
   int     dataidx;
   char    *ttag;
+  int     rc;
 
   if (libmp4tag == NULL || libmp4tag->libmp4tagident != MP4TAG_IDENT) {
     return MP4TAG_ERR_BAD_STRUCT;
@@ -270,36 +436,35 @@ mp4tag_get_tag_by_name (libmp4tag_t *libmp4tag, const char *tag,
     return libmp4tag->mp4error;
   }
 
-  libmp4tag->mp4error = MP4TAG_OK;
+  /* the tags of a parsed handle may be retrieved from several threads */
+  /* at once, the handle is not changed, and the error is returned */
+  /* rather than stored */
 
   if (mp4tagpub == NULL) {
-    libmp4tag->mp4error = MP4TAG_ERR_NULL_VALUE;
-    return libmp4tag->mp4error;
+    return MP4TAG_ERR_NULL_VALUE;
   }
   if (libmp4tag->tags == NULL) {
-    libmp4tag->mp4error = MP4TAG_ERR_NO_TAGS;
-    return libmp4tag->mp4error;
+    return MP4TAG_ERR_NO_TAGS;
   }
 
   ttag = strdup (tag);
   if (ttag == NULL) {
-    libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
-    return libmp4tag->mp4error;
+    return MP4TAG_ERR_OUT_OF_MEMORY;
   }
 
   mp4tag_parse_tagname (ttag, &dataidx);
-  idx = mp4tag_find_tag (libmp4tag, ttag, dataidx);
+  idx = mp4tag_locate_tag (libmp4tag, ttag, dataidx);
   if (idx >= 0 && idx < libmp4tag->tagcount) {
     mp4tag_t    *mp4tag;
 
     mp4tag = &libmp4tag->tags [idx];
-    mp4tag_copy_to_pub (mp4tagpub, mp4tag);
+    rc = mp4tag_copy_to_pub (libmp4tag, mp4tagpub, mp4tag);
   } else {
-    libmp4tag->mp4error = MP4TAG_ERR_TAG_NOT_FOUND;
+    rc = MP4TAG_ERR_TAG_NOT_FOUND;
   }
 
   free (ttag);
-  return libmp4tag->mp4error;
+  return rc;
 }
 
 int
@@ -342,12 +507,15 @@ mp4tag_iterate (libmp4tag_t *libmp4tag, mp4tagpub_t *mp4tagpub)
     return libmp4tag->mp4error;
   }
 
+  mp4tag_sort_tags (libmp4tag);
+
   if (libmp4tag->iterator >= libmp4tag->tagcount) {
     libmp4tag->mp4error = MP4TAG_OK;
     return MP4TAG_FINISH;
   }
 
-  mp4tag_copy_to_pub (mp4tagpub, &libmp4tag->tags [libmp4tag->iterator]);
+  libmp4tag->mp4error = mp4tag_copy_to_pub (libmp4tag, mp4tagpub,
+      &libmp4tag->tags [libmp4tag->iterator]);
   ++libmp4tag->iterator;
 
   return libmp4tag->mp4error;
@@ -501,6 +669,111 @@ mp4tag_set_binary_tag (libmp4tag_t *libmp4tag, const char *tag,
   return libmp4tag->mp4error;
 }
 
+/* all of the items are checked before any tag is changed. */
+/* a new tag is added as it is checked, so that a later item with */
+/* the same name is checked against it.  if an item fails the */
+/* check, the added tags are removed. */
+/* the existing tags are updated once all of the items have passed. */
+/* as with mp4tag_set_tag, the tag list is sorted when it is next used */
+int
+mp4tag_set_tags (libmp4tag_t *libmp4tag, const mp4tagpub_t items [],
+    int count)
+{
+  int       *idxlist;
+  char      **values;
+  int       tagcount;
+  int       datacount;
+  int       rc = MP4TAG_OK;
+
+  if (libmp4tag == NULL || libmp4tag->libmp4tagident != MP4TAG_IDENT) {
+    return MP4TAG_ERR_BAD_STRUCT;
+  }
+
+  if (! libmp4tag->parsed) {
+    libmp4tag->mp4error = MP4TAG_ERR_NOT_PARSED;
+    return libmp4tag->mp4error;
+  }
+
+  libmp4tag->mp4error = MP4TAG_OK;
+
+  if (count <= 0) {
+    return libmp4tag->mp4error;
+  }
+  if (items == NULL) {
+    libmp4tag->mp4error = MP4TAG_ERR_NULL_VALUE;
+    return libmp4tag->mp4error;
+  }
+
+  idxlist = malloc (sizeof (int) * count);
+  values = calloc (count, sizeof (char *));
+  if (idxlist == NULL || values == NULL) {
+    free (idxlist);
+    free (values);
+    libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+    return libmp4tag->mp4error;
+  }
+
+  tagcount = libmp4tag->tagcount;
+  datacount = libmp4tag->datacount;
+  for (int i = 0; i < count; ++i) {
+    if (items [i].tag == NULL || items [i].data == NULL) {
+      rc = MP4TAG_ERR_NULL_VALUE;
+      break;
+    }
+    rc = mp4tag_check_set_tag (libmp4tag, items [i].tag,
+        items [i].binary, &idxlist [i]);
+    if (rc != MP4TAG_OK) {
+      break;
+    }
+    if (idxlist [i] < 0) {
+      /* the item has passed the check, only an allocation can fail */
+      if (items [i].binary) {
+        rc = mp4tag_set_tag_binary (libmp4tag, items [i].tag, -1,
+            items [i].data, items [i].datalen, NULL);
+      } else {
+        rc = mp4tag_set_tag_string (libmp4tag, items [i].tag, -1,
+            items [i].data);
+      }
+      if (rc != MP4TAG_OK) {
+        break;
+      }
+    } else {
+      /* the new value of an existing tag is allocated now, */
+      /* so that the replacement below cannot fail */
+      values [i] = mp4tag_alloc_tag_value (items [i].data,
+          items [i].datalen, items [i].binary);
+      if (values [i] == NULL) {
+        rc = MP4TAG_ERR_OUT_OF_MEMORY;
+        break;
+      }
+    }
+  }
+
+  if (rc != MP4TAG_OK) {
+    mp4tag_truncate_tags (libmp4tag, tagcount);
+    libmp4tag->datacount = datacount;
+    for (int i = 0; i < count; ++i) {
+      free (values [i]);
+    }
+    free (values);
+    free (idxlist);
+    libmp4tag->mp4error = rc;
+    return libmp4tag->mp4error;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    if (values [i] == NULL) {
+      continue;
+    }
+    mp4tag_replace_tag_value (libmp4tag, items [i].tag, idxlist [i],
+        values [i], items [i].datalen, items [i].binary, NULL);
+  }
+
+  free (values);
+  free (idxlist);
+  return libmp4tag->mp4error;
+}
+
 int
 mp4tag_delete_tag (libmp4tag_t *libmp4tag, const char *tag)
 {
@@ -544,10 +817,8 @@ mp4tag_delete_tag (libmp4tag_t *libmp4tag, const char *tag)
         mp4tag_t    *mp4tag;
 
         mp4tag = &libmp4tag->tags [idx];
-        if (mp4tag->covername != NULL) {
-          free (mp4tag->covername);
-          mp4tag->covername = NULL;
-        }
+        mp4tag_free_data (mp4tag, mp4tag->covername, MP4TAG_INPOOL_COVERNAME);
+        mp4tag->covername = NULL;
         libmp4tag->mp4error = MP4TAG_OK;
         free (ttag);
         return libmp4tag->mp4error;
@@ -564,6 +835,53 @@ mp4tag_delete_tag (libmp4tag_t *libmp4tag, const char *tag)
   return libmp4tag->mp4error;
 }
 
+/* all tags whose name begins with prefix are deleted, */
+/* e.g. ----:com.apple.iTunes: */
+int
+mp4tag_delete_tags_by_prefix (libmp4tag_t *libmp4tag, const char *prefix)
+{
+  size_t    len;
+  int       count = 0;
+
+  if (libmp4tag == NULL || libmp4tag->libmp4tagident != MP4TAG_IDENT) {
+    return MP4TAG_ERR_BAD_STRUCT;
+  }
+
+  if (! libmp4tag->parsed) {
+    libmp4tag->mp4error = MP4TAG_ERR_NOT_PARSED;
+    return libmp4tag->mp4error;
+  }
+
+  libmp4tag->mp4error = MP4TAG_OK;
+
+  if (prefix == NULL || *prefix == '\0') {
+    libmp4tag->mp4error = MP4TAG_ERR_NULL_VALUE;
+    return libmp4tag->mp4error;
+  }
+  if (libmp4tag->tags == NULL) {
+    libmp4tag->mp4error = MP4TAG_ERR_TAG_NOT_FOUND;
+    return libmp4tag->mp4error;
+  }
+
+  len = strlen (prefix);
+  for (int i = 0; i < libmp4tag->tagcount; ++i) {
+    if (libmp4tag->tags [i].tag != NULL &&
+        strncmp (libmp4tag->tags [i].tag, prefix, len) == 0) {
+      mp4tag_free_tag_by_idx (libmp4tag, i);
+      libmp4tag->tagdeleted += 1;
+      ++count;
+    }
+  }
+
+  if (count == 0) {
+    /* deleting a non-existent tag is ok */
+    libmp4tag->mp4error = MP4TAG_ERR_TAG_NOT_FOUND;
+  }
+  mp4tag_compact_tags (libmp4tag);
+
+  return libmp4tag->mp4error;
+}
+
 int
 mp4tag_clean_tags (libmp4tag_t *libmp4tag)
 {
@@ -590,9 +908,8 @@ mp4tag_clean_tags (libmp4tag_t *libmp4tag)
 int
 mp4tag_write_tags (libmp4tag_t *libmp4tag)
 {
-  char      *data = NULL;
-  uint32_t  dlen = 0;
-  int       rc;
+  mp4tagilst_t  ilst;
+  int           rc;
 
   if (libmp4tag == NULL || libmp4tag->libmp4tagident != MP4TAG_IDENT) {
     libmp4tag->mp4error = MP4TAG_ERR_BAD_STRUCT;
@@ -611,16 +928,15 @@ mp4tag_write_tags (libmp4tag_t *libmp4tag)
 
   libmp4tag->mp4error = MP4TAG_OK;
 
-  data = mp4tag_build_data (libmp4tag, &dlen);
-  if (libmp4tag->mp4error != MP4TAG_OK) {
+  rc = mp4tag_build_data (libmp4tag, &ilst);
+  if (rc != MP4TAG_OK) {
+    mp4tag_free_build_data (&ilst);
     return libmp4tag->mp4error;
   }
 
-  /* if data is null and dlen == 0 , it is a complete clean of the tags */
-  rc = mp4tag_write_data (libmp4tag, data, dlen);
-  if (data != NULL) {
-    free (data);
-  }
+  /* if the ilst data is empty, it is a complete clean of the tags */
+  rc = mp4tag_write_data (libmp4tag, &ilst);
+  mp4tag_free_build_data (&ilst);
   return rc;
 }
 
@@ -646,6 +962,8 @@ mp4tag_preserve_tags (libmp4tag_t *libmp4tag)
 
   libmp4tag->mp4error = MP4TAG_OK;
 
+  mp4tag_compact_tags (libmp4tag);
+
   preserve = malloc (sizeof (libmp4tagpreserve_t));
   if (preserve == NULL) {
     libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
@@ -704,6 +1022,7 @@ mp4tag_restore_tags (libmp4tag_t *libmp4tag, libmp4tagpreserve_t *preserve)
   for (int i = 0; i < preserve->tagcount; ++i) {
     mp4tag_clone_tag (libmp4tag, &libmp4tag->tags [i], &preserve->tags [i]);
   }
+  libmp4tag->tagsortcount = 0;
 
   return libmp4tag->mp4error;
 }
@@ -788,9 +1107,247 @@ mp4tag_set_option (libmp4tag_t *libmp4tag, int option)
   libmp4tag->options |= option;
 }
 
+void
+mp4tag_set_read_buffer (libmp4tag_t *libmp4tag, size_t sz)
+{
+  size_t    pending;
+  size_t    allocsz;
+
+  if (libmp4tag == NULL || libmp4tag->libmp4tagident != MP4TAG_IDENT) {
+    return;
+  }
+
+  libmp4tag->mp4error = MP4TAG_OK;
+
+  /* the read-ahead buffer is only used for streams */
+  if (! libmp4tag->isstream) {
+    return;
+  }
+
+  /* any data that has already been read from the stream must be kept */
+  pending = libmp4tag->rabufflen - libmp4tag->rabuffidx;
+  if (pending > 0 && libmp4tag->rabuffidx > 0) {
+    memmove (libmp4tag->rabuff,
+        libmp4tag->rabuff + libmp4tag->rabuffidx, pending);
+  }
+  libmp4tag->rabufflen = pending;
+  libmp4tag->rabuffidx = 0;
+
+  allocsz = sz > pending ? sz : pending;
+  if (allocsz == 0) {
+    if (libmp4tag->rabuff != NULL) {
+      free (libmp4tag->rabuff);
+      libmp4tag->rabuff = NULL;
+    }
+  } else {
+    char    *tbuff;
+
+    tbuff = realloc (libmp4tag->rabuff, allocsz);
+    if (tbuff == NULL) {
+      libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+      return;
+    }
+    libmp4tag->rabuff = tbuff;
+  }
+  libmp4tag->rabuffsz = sz;
+}
+
+void
+mp4tag_set_wait_callback (libmp4tag_t *libmp4tag, mp4tag_waitcb_t waitcb)
+{
+  if (libmp4tag == NULL || libmp4tag->libmp4tagident != MP4TAG_IDENT) {
+    return;
+  }
+
+  libmp4tag->mp4error = MP4TAG_OK;
+
+  /* the wait callback is only used for streams */
+  if (! libmp4tag->isstream) {
+    return;
+  }
+
+  libmp4tag->waitcb = waitcb;
+}
+
+int
+mp4tag_set_tag_filter (libmp4tag_t *libmp4tag, const char *tags [], int count)
+{
+  if (libmp4tag == NULL || libmp4tag->libmp4tagident != MP4TAG_IDENT) {
+    return MP4TAG_ERR_BAD_STRUCT;
+  }
+
+  libmp4tag->mp4error = MP4TAG_OK;
+
+  if (tags == NULL && count > 0) {
+    libmp4tag->mp4error = MP4TAG_ERR_NULL_VALUE;
+    return libmp4tag->mp4error;
+  }
+
+  mp4tag_free_filter (libmp4tag);
+  if (count <= 0) {
+    return libmp4tag->mp4error;
+  }
+
+  libmp4tag->filter = malloc (sizeof (char *) * count);
+  if (libmp4tag->filter == NULL) {
+    libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+    return libmp4tag->mp4error;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    if (tags [i] == NULL) {
+      libmp4tag->mp4error = MP4TAG_ERR_NULL_VALUE;
+      break;
+    }
+    libmp4tag->filter [i] = strdup (tags [i]);
+    if (libmp4tag->filter [i] == NULL) {
+      libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+      break;
+    }
+    libmp4tag->filtercount += 1;
+  }
+
+  if (libmp4tag->mp4error != MP4TAG_OK) {
+    mp4tag_free_filter (libmp4tag);
+    return libmp4tag->mp4error;
+  }
+
+  /* writing would remove the tags that were not parsed */
+  libmp4tag->canwrite = false;
+
+  return libmp4tag->mp4error;
+}
+
 
 /* internal routines */
 
+/* a read-only handle does not need the offset tables for writing, */
+/* and the sample tables are not parsed */
+static libmp4tag_t *
+mp4tag_open_file (const char *fn, bool readonly, int *mp4error)
+{
+  libmp4tag_t   *libmp4tag = NULL;
+  int           rc;
+
+#if LIBMP4TAG_DEBUG
+  enable_core_dump ();
+#endif
+  if (fn == NULL) {
+    *mp4error = MP4TAG_ERR_NULL_VALUE;
+    return NULL;
+  }
+
+  *mp4error = MP4TAG_OK;
+  libmp4tag = mp4tag_alloc (mp4error);
+  if (*mp4error != MP4TAG_OK) {
+    return NULL;
+  }
+
+  rc = mp4tag_open_fh (libmp4tag, fn, readonly);
+  if (rc != MP4TAG_OK) {
+    *mp4error = rc;
+    libmp4tag->libmp4tagident = 0;
+    free (libmp4tag);
+    return NULL;
+  }
+
+  return libmp4tag;
+}
+
+/* re-uses the handle and its tag list for the next file. */
+/* the file is opened read-only */
+int
+mp4tag_reopen (libmp4tag_t *libmp4tag, const char *fn)
+{
+  mp4tag_t        *tags;
+  mp4tagkey_t     *tagkeys;
+  mp4tagarena_t   *arena;
+  int             tagalloccount;
+  int             tagkeyalloc;
+
+  if (libmp4tag == NULL || libmp4tag->libmp4tagident != MP4TAG_IDENT) {
+    return MP4TAG_ERR_BAD_STRUCT;
+  }
+  if (fn == NULL) {
+    return MP4TAG_ERR_NULL_VALUE;
+  }
+
+  if (libmp4tag->fh != NULL) {
+    fclose (libmp4tag->fh);
+    libmp4tag->fh = NULL;
+  }
+  if (libmp4tag->fn != NULL) {
+    free (libmp4tag->fn);
+    libmp4tag->fn = NULL;
+  }
+  mp4tag_release_read_buffer (libmp4tag);
+
+  /* only the tag data is released, the tag list, the key list */
+  /* and the arena are kept */
+  for (int i = 0; i < libmp4tag->tagcount; ++i) {
+    mp4tag_free_tag_by_idx (libmp4tag, i);
+  }
+  tags = libmp4tag->tags;
+  tagalloccount = libmp4tag->tagalloccount;
+  tagkeys = libmp4tag->tagkeys;
+  tagkeyalloc = libmp4tag->tagkeyalloc;
+  mp4tag_arena_reset (libmp4tag);
+  arena = libmp4tag->arena;
+  libmp4tag->tags = NULL;
+  libmp4tag->tagkeys = NULL;
+  libmp4tag->arena = NULL;
+  mp4tag_free_tags (libmp4tag);
+  mp4tag_free_cotables (libmp4tag);
+  mp4tag_init_tags (libmp4tag);
+  libmp4tag->tags = tags;
+  libmp4tag->tagalloccount = tagalloccount;
+  libmp4tag->tagkeys = tagkeys;
+  libmp4tag->tagkeyalloc = tagkeyalloc;
+  libmp4tag->arena = arena;
+
+  return mp4tag_open_fh (libmp4tag, fn, true);
+}
+
+static int
+mp4tag_open_fh (libmp4tag_t *libmp4tag, const char *fn, bool readonly)
+{
+  int   rc;
+
+  if (! readonly) {
+    libmp4tag->fh = mp4tag_fopen (fn, "rb+");
+  }
+  if (libmp4tag->fh == NULL) {
+    /* if the file cannot be opened, try opening w/o write capabilities */
+    libmp4tag->fh = mp4tag_fopen (fn, "rb");
+    if (libmp4tag->fh == NULL) {
+      return MP4TAG_ERR_FILE_NOT_FOUND;
+    }
+    libmp4tag->canwrite = false;
+  }
+  libmp4tag->readonly = readonly;
+
+  /* needed for parse, write */
+  libmp4tag->filesz = mp4tag_file_size (fn);
+  libmp4tag->offset = 0;
+
+  rc = mp4tag_parse_ftyp (libmp4tag);
+  mp4tag_release_read_buffer (libmp4tag);
+  if (rc != MP4TAG_OK) {
+    fclose (libmp4tag->fh);
+    libmp4tag->fh = NULL;
+    return rc;
+  }
+
+  libmp4tag->fn = strdup (fn);
+  if (libmp4tag->fn == NULL) {
+    fclose (libmp4tag->fh);
+    libmp4tag->fh = NULL;
+    return MP4TAG_ERR_OUT_OF_MEMORY;
+  }
+
+  return MP4TAG_OK;
+}
+
 static libmp4tag_t *
 mp4tag_alloc (int *mp4error)
 {
@@ -805,9 +1362,30 @@ mp4tag_alloc (int *mp4error)
   libmp4tag->libmp4tagident = MP4TAG_IDENT;
   libmp4tag->fn = NULL;
   libmp4tag->fh = NULL;
+  libmp4tag->mapdata = NULL;
+  libmp4tag->mapsz = 0;
   libmp4tag->readcb = NULL;
   libmp4tag->seekcb = NULL;
+  libmp4tag->waitcb = NULL;
   libmp4tag->userdata = NULL;
+  libmp4tag->rabuff = NULL;
+  libmp4tag->rabuffsz = 0;
+  libmp4tag->rabufflen = 0;
+  libmp4tag->rabuffidx = 0;
+  libmp4tag->rabuffoffset = 0;
+  libmp4tag->feedbuff = NULL;
+  libmp4tag->feedlen = 0;
+  libmp4tag->feedalloc = 0;
+  libmp4tag->feedoffset = 0;
+  libmp4tag->feedwant = 0;
+  libmp4tag->feedwalk = NULL;
+  libmp4tag->viewbuff = NULL;
+  libmp4tag->viewlen = 0;
+  libmp4tag->viewalloc = 0;
+  libmp4tag->viewidx = 0;
+  libmp4tag->viewoffset = 0;
+  libmp4tag->filter = NULL;
+  libmp4tag->filtercount = 0;
   libmp4tag->filesz = MP4TAG_NO_FILESZ;
   libmp4tag->dbgflags = 0;
   libmp4tag->options = MP4TAG_OPTION_NONE;
@@ -818,6 +1396,11 @@ mp4tag_alloc (int *mp4error)
 
   libmp4tag->isstream = false;
   libmp4tag->canwrite = true;
+  libmp4tag->readonly = false;
+  libmp4tag->isfeed = false;
+  libmp4tag->feedftyp = false;
+  libmp4tag->feedneed = false;
+  libmp4tag->feedend = false;
 
   return libmp4tag;
 }
@@ -828,35 +1411,89 @@ mp4tag_free_tags (libmp4tag_t *libmp4tag)
   if (libmp4tag == NULL || libmp4tag->libmp4tagident != MP4TAG_IDENT) {
     return;
   }
-  if (libmp4tag->tags == NULL) {
+
+  if (libmp4tag->tags != NULL) {
+    for (int i = 0; i < libmp4tag->tagcount; ++i) {
+      mp4tag_free_tag_by_idx (libmp4tag, i);
+    }
+    free (libmp4tag->tags);
+    libmp4tag->tags = NULL;
+    libmp4tag->tagcount = 0;
+    libmp4tag->tagalloccount = 0;
+  }
+  libmp4tag->tagdeleted = 0;
+  mp4tag_index_free (libmp4tag);
+  if (libmp4tag->tagkeys != NULL) {
+    free (libmp4tag->tagkeys);
+    libmp4tag->tagkeys = NULL;
+  }
+  libmp4tag->tagkeyalloc = 0;
+  mp4tag_arena_free (libmp4tag);
+
+  /* the ilst view is released after the tags */
+  if (libmp4tag->viewbuff != NULL) {
+    free (libmp4tag->viewbuff);
+    libmp4tag->viewbuff = NULL;
+  }
+  libmp4tag->viewlen = 0;
+  libmp4tag->viewalloc = 0;
+  libmp4tag->viewidx = 0;
+  libmp4tag->viewoffset = 0;
+}
+
+/* the chunk offset tables are not released with the tags, */
+/* they are needed by the write process */
+static void
+mp4tag_free_cotables (libmp4tag_t *libmp4tag)
+{
+  if (libmp4tag->cotables != NULL) {
+    free (libmp4tag->cotables);
+    libmp4tag->cotables = NULL;
+  }
+  libmp4tag->cotablecount = 0;
+  libmp4tag->cotablealloc = 0;
+}
+
+static void
+mp4tag_free_filter (libmp4tag_t *libmp4tag)
+{
+  if (libmp4tag->filter == NULL) {
     return;
   }
 
-  for (int i = 0; i < libmp4tag->tagcount; ++i) {
-    mp4tag_free_tag_by_idx (libmp4tag, i);
+  for (int i = 0; i < libmp4tag->filtercount; ++i) {
+    free (libmp4tag->filter [i]);
   }
-  free (libmp4tag->tags);
-  libmp4tag->tags = NULL;
-  libmp4tag->tagcount = 0;
-  libmp4tag->tagalloccount = 0;
+  free (libmp4tag->filter);
+  libmp4tag->filter = NULL;
+  libmp4tag->filtercount = 0;
 }
 
-static void
-mp4tag_copy_to_pub (mp4tagpub_t *mp4tagpub, mp4tag_t *mp4tag)
+static int
+mp4tag_copy_to_pub (libmp4tag_t *libmp4tag, mp4tagpub_t *mp4tagpub,
+    mp4tag_t *mp4tag)
 {
+  int     rc;
+
+  /* any binary data that was not read during the parse is read now */
+  rc = mp4tag_load_tag_data (libmp4tag, mp4tag);
+
   mp4tagpub->tag = mp4tag->tag;
-  mp4tagpub->data = mp4tag->data;
+  /* the data may have been loaded by another thread */
+  mp4tagpub->data = __atomic_load_n (&mp4tag->data, __ATOMIC_ACQUIRE);
   mp4tagpub->datalen = mp4tag->datalen;
   mp4tagpub->covername = mp4tag->covername;
   mp4tagpub->dataidx = mp4tag->dataidx;
   mp4tagpub->covertype = mp4tag->identtype;
   mp4tagpub->binary = mp4tag->binary;
+  return rc;
 }
 
 static void
 mp4tag_init_tags (libmp4tag_t *libmp4tag)
 {
   libmp4tag->tags = NULL;
+  libmp4tag->arena = NULL;
   libmp4tag->offset = 0;
   libmp4tag->creationdate = 0;
   libmp4tag->modifieddate = 0;
@@ -866,7 +1503,6 @@ mp4tag_init_tags (libmp4tag_t *libmp4tag)
     libmp4tag->base_lengths [i] = 0;
     libmp4tag->base_offsets [i] = 0;
     libmp4tag->base_name [i][0] = '\0';
-    libmp4tag->rem_length [i] = 0;
   }
   libmp4tag->base_offset_count = 0;
   libmp4tag->taglist_base_offset = 0;
@@ -880,14 +1516,20 @@ mp4tag_init_tags (libmp4tag_t *libmp4tag)
   libmp4tag->noilst_offset = 0;
   libmp4tag->after_ilst_offset = 0;
   libmp4tag->insert_delta = 0;
-  libmp4tag->stco_offset = 0;
-  libmp4tag->stco_len = 0;
-  libmp4tag->co64_offset = 0;
-  libmp4tag->co64_len = 0;
+  libmp4tag->cotables = NULL;
+  libmp4tag->cotablecount = 0;
+  libmp4tag->cotablealloc = 0;
   libmp4tag->datacount = 0;
   libmp4tag->lastbox_offset = -1;
   libmp4tag->tagcount = 0;
   libmp4tag->tagalloccount = 0;
+  libmp4tag->tagdeleted = 0;
+  libmp4tag->tagsortcount = 0;
+  libmp4tag->tagindex = NULL;
+  libmp4tag->tagindexsz = 0;
+  libmp4tag->tagindexvalid = false;
+  libmp4tag->tagkeys = NULL;
+  libmp4tag->tagkeyalloc = 0;
   libmp4tag->iterator = 0;
   libmp4tag->mp4error = MP4TAG_OK;
   libmp4tag->mp7meta = false;
@@ -896,6 +1538,7 @@ mp4tag_init_tags (libmp4tag_t *libmp4tag)
   libmp4tag->parsed = false;
   libmp4tag->processdata = false;
   libmp4tag->checkforfree = false;
+  libmp4tag->cotablescan = false;
   libmp4tag->parsedone = false;
 
   libmp4tag->ilst_remaining = 0;
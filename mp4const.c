@@ -13,7 +13,7 @@
 
 const char *COPYRIGHT_STR = "\xc2\xa9";   /* copyright symbol */
 
-const char *boxids [] = {
+const char * const boxids [] = {
   /* various idents that libmp4tag needs to descend into or use */
   [MP4TAG_CO64] = "co64",
   [MP4TAG_FREE] = "free",
@@ -25,6 +25,7 @@ const char *boxids [] = {
   [MP4TAG_META] = "meta",
   [MP4TAG_MINF] = "minf",
   [MP4TAG_MOOV] = "moov",
+  [MP4TAG_MVHD] = "mvhd",
   [MP4TAG_STBL] = "stbl",
   [MP4TAG_STCO] = "stco",
   [MP4TAG_TRAK] = "trak",
@@ -42,7 +43,39 @@ const char *boxids [] = {
   [MP4TAG_NAME] = "name",
 };
 
-/* Must be sorted in ASCII order. */
+/* Must be sorted in fourcc order. */
+/* The parser uses this list to locate the boxids index for a box, */
+/* and the actions to take for the box. */
+const mp4tagboxtype_t mp4tagboxtypes [] = {
+  { MP4TAG_FOURCC ('-','-','-','-'), MP4TAG_CUSTOM, MP4TAG_BOX_NONE },
+  { MP4TAG_FOURCC ('c','o','6','4'), MP4TAG_CO64, MP4TAG_BOX_OFFSET },
+  { MP4TAG_FOURCC ('c','o','v','r'), MP4TAG_COVR, MP4TAG_BOX_NONE },
+  { MP4TAG_FOURCC ('d','a','t','a'), MP4TAG_DATA, MP4TAG_BOX_NONE },
+  { MP4TAG_FOURCC ('d','i','s','k'), MP4TAG_DISK, MP4TAG_BOX_NONE },
+  { MP4TAG_FOURCC ('f','r','e','e'), MP4TAG_FREE, MP4TAG_BOX_NONE },
+  { MP4TAG_FOURCC ('f','t','y','p'), MP4TAG_FTYP, MP4TAG_BOX_NONE },
+  { MP4TAG_FOURCC ('g','n','r','e'), MP4TAG_GNRE, MP4TAG_BOX_NONE },
+  { MP4TAG_FOURCC ('h','d','l','r'), MP4TAG_HDLR, MP4TAG_BOX_NONE },
+  { MP4TAG_FOURCC ('i','l','s','t'), MP4TAG_ILST, MP4TAG_BOX_DESCEND | MP4TAG_BOX_OFFSET },
+  { MP4TAG_FOURCC ('m','d','h','d'), MP4TAG_MDHD, MP4TAG_BOX_DATA },
+  { MP4TAG_FOURCC ('m','d','i','a'), MP4TAG_MDIA, MP4TAG_BOX_DESCEND | MP4TAG_BOX_TRACK },
+  { MP4TAG_FOURCC ('m','e','a','n'), MP4TAG_MEAN, MP4TAG_BOX_NONE },
+  { MP4TAG_FOURCC ('m','e','t','a'), MP4TAG_META, MP4TAG_BOX_DESCEND },
+  { MP4TAG_FOURCC ('m','i','n','f'), MP4TAG_MINF, MP4TAG_BOX_DESCEND | MP4TAG_BOX_TRACK },
+  { MP4TAG_FOURCC ('m','o','o','v'), MP4TAG_MOOV, MP4TAG_BOX_DESCEND },
+  { MP4TAG_FOURCC ('m','v','h','d'), MP4TAG_MVHD, MP4TAG_BOX_DATA },
+  { MP4TAG_FOURCC ('n','a','m','e'), MP4TAG_NAME, MP4TAG_BOX_NONE },
+  { MP4TAG_FOURCC ('s','t','b','l'), MP4TAG_STBL, MP4TAG_BOX_DESCEND | MP4TAG_BOX_TRACK },
+  { MP4TAG_FOURCC ('s','t','c','o'), MP4TAG_STCO, MP4TAG_BOX_OFFSET },
+  { MP4TAG_FOURCC ('t','r','a','k'), MP4TAG_TRAK, MP4TAG_BOX_DESCEND | MP4TAG_BOX_TRACK },
+  { MP4TAG_FOURCC ('t','r','k','n'), MP4TAG_TRKN, MP4TAG_BOX_NONE },
+  { MP4TAG_FOURCC ('u','d','t','a'), MP4TAG_UDTA, MP4TAG_BOX_DESCEND | MP4TAG_BOX_OFFSET },
+};
+const int mp4tagboxtypeslen = sizeof (mp4tagboxtypes) / sizeof (mp4tagboxtype_t);
+
+/* Kept in ASCII order for readability. */
+/* The hash table used to locate a tag (mp4taghash.h) is generated */
+/* from this list by mp4tagmkhash.  Run 'make hash' after a change. */
 /* This list is used to verify that a tag is valid if it is not found */
 /* in the current tag list. */
 /* The identifier type and length for a tag are stored here. */
@@ -116,7 +149,7 @@ const int mp4taglistlen = sizeof (mp4taglist) / sizeof (mp4tagdef_t);
 /* but we must convert any old gnre data to ©gen. */
 /* itunes still puts data into the 'gnre' field, yick. */
 /* this is the ID3 genre list */
-const char *mp4tagoldgenrelist [] = {
+const char * const mp4tagoldgenrelist [] = {
   "Blues",              "Classic Rock",           "Country",
   "Dance",              "Disco",                  "Funk",
   "Grunge",             "Hip-Hop",                "Jazz",
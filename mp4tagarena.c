@@ -0,0 +1,160 @@
+/*
+ * Copyright 2026 Brad Lanam Pleasant Hill CA
+ */
+
+/*
+ * The tag arena.
+ * While a file is parsed, the tag names and values are carved from
+ * chunks owned by the handle.  Nothing in the arena is freed on its
+ * own, the arena is released along with the tags.  When a handle is
+ * re-used for another file, the arena is reset and the most recent
+ * chunk is kept.
+ * Tag names and values that are set after the parse are allocated
+ * separately.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "libmp4tag.h"
+#include "mp4tagint.h"
+
+enum {
+  MP4TAG_ARENA_MIN_SZ = 4096,
+  MP4TAG_ARENA_MAX_SZ = 65536,
+  MP4TAG_ARENA_ALIGN = sizeof (void *),
+};
+
+static mp4tagarena_t *mp4tag_arena_chunk (size_t sz);
+
+void *
+mp4tag_arena_alloc (libmp4tag_t *libmp4tag, size_t sz)
+{
+  mp4tagarena_t   *arena;
+  char            *p;
+
+  sz = (sz + MP4TAG_ARENA_ALIGN - 1) & ~ ((size_t) MP4TAG_ARENA_ALIGN - 1);
+
+  arena = libmp4tag->arena;
+  if (arena == NULL || arena->sz - arena->used < sz) {
+    mp4tagarena_t   *tarena;
+    size_t          asz;
+
+    /* each new chunk is twice the size of the last */
+    asz = MP4TAG_ARENA_MIN_SZ;
+    if (arena != NULL) {
+      asz = arena->sz * 2;
+    }
+    if (asz > MP4TAG_ARENA_MAX_SZ) {
+      asz = MP4TAG_ARENA_MAX_SZ;
+    }
+
+    if (sz > asz / 4) {
+      /* a large value is placed in a chunk of its own, */
+      /* after the current chunk, which remains in use */
+      tarena = mp4tag_arena_chunk (sz);
+      if (tarena == NULL) {
+        libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+        return NULL;
+      }
+      tarena->used = sz;
+      if (arena == NULL) {
+        libmp4tag->arena = tarena;
+      } else {
+        tarena->next = arena->next;
+        arena->next = tarena;
+      }
+      return (char *) (tarena + 1);
+    }
+
+    tarena = mp4tag_arena_chunk (asz);
+    if (tarena == NULL) {
+      libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+      return NULL;
+    }
+    tarena->next = arena;
+    libmp4tag->arena = tarena;
+    arena = tarena;
+  }
+
+  p = (char *) (arena + 1) + arena->used;
+  arena->used += sz;
+
+  return p;
+}
+
+/* copies len bytes of str, and adds a null terminator */
+char *
+mp4tag_arena_dup (libmp4tag_t *libmp4tag, const char *str, size_t len)
+{
+  char    *p;
+
+  p = mp4tag_arena_alloc (libmp4tag, len + 1);
+  if (p == NULL) {
+    return NULL;
+  }
+  memcpy (p, str, len);
+  p [len] = '\0';
+
+  return p;
+}
+
+/* the most recent chunk is kept for the next file */
+void
+mp4tag_arena_reset (libmp4tag_t *libmp4tag)
+{
+  mp4tagarena_t   *arena;
+
+  arena = libmp4tag->arena;
+  if (arena == NULL) {
+    return;
+  }
+  if (arena->sz > MP4TAG_ARENA_MAX_SZ) {
+    /* a chunk holding a large value is not kept */
+    mp4tag_arena_free (libmp4tag);
+    return;
+  }
+
+  libmp4tag->arena = arena->next;
+  mp4tag_arena_free (libmp4tag);
+  arena->next = NULL;
+  arena->used = 0;
+  libmp4tag->arena = arena;
+}
+
+void
+mp4tag_arena_free (libmp4tag_t *libmp4tag)
+{
+  mp4tagarena_t   *arena;
+
+  arena = libmp4tag->arena;
+  while (arena != NULL) {
+    mp4tagarena_t   *tarena;
+
+    tarena = arena->next;
+    free (arena);
+    arena = tarena;
+  }
+  libmp4tag->arena = NULL;
+}
+
+static mp4tagarena_t *
+mp4tag_arena_chunk (size_t sz)
+{
+  mp4tagarena_t   *arena;
+
+  arena = malloc (sizeof (mp4tagarena_t) + sz);
+  if (arena == NULL) {
+    return NULL;
+  }
+  arena->next = NULL;
+  arena->sz = sz;
+  arena->used = 0;
+
+  return arena;
+}
@@ -0,0 +1,494 @@
+/*
+ * Copyright 2026 Brad Lanam Pleasant Hill CA
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#if __has_include (<linux/io_uring.h>)
+# include <linux/io_uring.h>
+# include <sys/syscall.h>
+# include <sys/mman.h>
+# include <sys/uio.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+#include "libmp4tag.h"
+#include "mp4tagint.h"
+
+/* liburing is not used, the system calls are made directly */
+#if defined (__NR_io_uring_setup) && defined (__NR_io_uring_enter)
+# define MP4TAG_USE_URING 1
+#else
+# define MP4TAG_USE_URING 0
+#endif
+
+static int mp4tag_batch_sync (const char *fn [], int count, mp4tag_batchcb_t batchcb, void *udata);
+static size_t mp4tag_batch_size (libmp4tag_t *libmp4tag, char **buff, size_t *buffsz);
+
+#if MP4TAG_USE_URING
+
+/* one file in process.  each slot has at most one read outstanding */
+typedef struct {
+  libmp4tag_t   *libmp4tag;
+  char          *buff;
+  size_t        buffsz;
+  struct iovec  iov;
+  int           idx;
+  int           fd;
+} mp4tagbatchslot_t;
+
+typedef struct {
+  int                 ringfd;
+  unsigned            *sqtail;
+  unsigned            *sqmask;
+  unsigned            *sqarray;
+  unsigned            *cqhead;
+  unsigned            *cqtail;
+  unsigned            *cqmask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void                *sqring;
+  void                *cqring;
+  size_t              sqringsz;
+  size_t              cqringsz;
+  size_t              sqessz;
+  /* the number of entries not yet submitted to the kernel */
+  unsigned            pending;
+  /* the number of entries submitted that have not completed */
+  unsigned            inflight;
+} mp4tagring_t;
+
+static int mp4tag_batch_uring (const char *fn [], int count, int depth, mp4tag_batchcb_t batchcb, void *udata);
+static bool mp4tag_batch_start (mp4tagring_t *ring, mp4tagbatchslot_t *slots, int sidx, const char *fn [], int count, int *next, mp4tag_batchcb_t batchcb, void *udata);
+static void mp4tag_batch_read (mp4tagring_t *ring, mp4tagbatchslot_t *slots, int sidx);
+static int mp4tag_batch_reap (mp4tagring_t *ring, mp4tagbatchslot_t *slots, int active, const char *fn [], int count, int *next, int stop, mp4tag_batchcb_t batchcb, void *udata);
+static void mp4tag_batch_done (mp4tagbatchslot_t *slot, int rc, mp4tag_batchcb_t batchcb, void *udata);
+static bool mp4tag_ring_init (mp4tagring_t *ring, unsigned entries);
+static void mp4tag_ring_free (mp4tagring_t *ring);
+
+#endif
+
+/* the files are parsed using the mp4tag_feed parser. */
+/* with io_uring, the reads for up to 'depth' files are outstanding */
+/* at once, and each file's next read is submitted as soon as the */
+/* previous one completes.  otherwise the files are read one at a time. */
+int
+mp4tag_parse_batch (const char *fn [], int count, int depth,
+    mp4tag_batchcb_t batchcb, void *udata)
+{
+  if (count <= 0) {
+    return MP4TAG_OK;
+  }
+  if (fn == NULL || batchcb == NULL) {
+    return MP4TAG_ERR_NULL_VALUE;
+  }
+
+  if (depth <= 0) {
+    depth = MP4TAG_BATCH_DEPTH;
+  }
+  if (depth > count) {
+    depth = count;
+  }
+
+#if MP4TAG_USE_URING
+  if (depth > 1) {
+    int   rc;
+
+    rc = mp4tag_batch_uring (fn, count, depth, batchcb, udata);
+    if (rc != MP4TAG_ERR_NOT_IMPLEMENTED) {
+      return rc;
+    }
+    /* io_uring is not available, the files are read one at a time */
+  }
+#endif
+
+  return mp4tag_batch_sync (fn, count, batchcb, udata);
+}
+
+static int
+mp4tag_batch_sync (const char *fn [], int count,
+    mp4tag_batchcb_t batchcb, void *udata)
+{
+  libmp4tag_t   *libmp4tag;
+  FILE          *fh;
+  char          *buff;
+  size_t        buffsz = MP4TAG_READ_BUFF_SZ;
+  size_t        br;
+  int           mp4error;
+  int           rc;
+
+  buff = malloc (buffsz);
+  if (buff == NULL) {
+    return MP4TAG_ERR_OUT_OF_MEMORY;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    fh = mp4tag_fopen (fn [i], "rb");
+    if (fh == NULL) {
+      batchcb (NULL, i, MP4TAG_ERR_FILE_NOT_FOUND, udata);
+      continue;
+    }
+    libmp4tag = mp4tag_openfeed (&mp4error);
+    if (libmp4tag == NULL) {
+      fclose (fh);
+      batchcb (NULL, i, mp4error, udata);
+      continue;
+    }
+
+    rc = MP4TAG_NEED_DATA;
+    while (rc == MP4TAG_NEED_DATA || rc == MP4TAG_NEED_SKIP) {
+      br = mp4tag_pread (fh, buff, mp4tag_batch_size (libmp4tag, &buff, &buffsz),
+          mp4tag_feed_offset (libmp4tag));
+      rc = mp4tag_feed (libmp4tag, buff, br);
+    }
+
+    fclose (fh);
+    batchcb (libmp4tag, i, rc, udata);
+    mp4tag_free (libmp4tag);
+  }
+
+  free (buff);
+  return MP4TAG_OK;
+}
+
+/* a box that is larger than the read buffer (e.g. a cover image) */
+/* is read with a single read */
+static size_t
+mp4tag_batch_size (libmp4tag_t *libmp4tag, char **buff, size_t *buffsz)
+{
+  int64_t   want;
+  char      *tbuff;
+
+  want = libmp4tag->feedwant - mp4tag_feed_offset (libmp4tag);
+  if (want <= (int64_t) *buffsz || (uint64_t) want >= SIZE_MAX / 2) {
+    return *buffsz;
+  }
+
+  tbuff = realloc (*buff, want);
+  if (tbuff == NULL) {
+    /* the box is read in pieces */
+    return *buffsz;
+  }
+  *buff = tbuff;
+  *buffsz = want;
+  return *buffsz;
+}
+
+#if MP4TAG_USE_URING
+
+/* returns MP4TAG_ERR_NOT_IMPLEMENTED if io_uring is not available */
+static int
+mp4tag_batch_uring (const char *fn [], int count, int depth,
+    mp4tag_batchcb_t batchcb, void *udata)
+{
+  mp4tagring_t        ring;
+  mp4tagbatchslot_t   *slots;
+  int                 next = 0;
+  int                 active = 0;
+  int                 rc = MP4TAG_OK;
+  int                 res;
+  int                 retry = 0;
+  bool                waitonly = false;
+
+  if (! mp4tag_ring_init (&ring, depth)) {
+    return MP4TAG_ERR_NOT_IMPLEMENTED;
+  }
+
+  slots = malloc (sizeof (mp4tagbatchslot_t) * depth);
+  if (slots == NULL) {
+    mp4tag_ring_free (&ring);
+    return MP4TAG_ERR_OUT_OF_MEMORY;
+  }
+  for (int i = 0; i < depth; ++i) {
+    slots [i].libmp4tag = NULL;
+    slots [i].idx = -1;
+    slots [i].fd = -1;
+    slots [i].buffsz = MP4TAG_READ_BUFF_SZ;
+    slots [i].buff = malloc (slots [i].buffsz);
+    if (slots [i].buff == NULL) {
+      rc = MP4TAG_ERR_OUT_OF_MEMORY;
+    }
+  }
+
+  /* the first reads for every slot go in a single submission */
+  for (int i = 0; rc == MP4TAG_OK && i < depth; ++i) {
+    if (mp4tag_batch_start (&ring, slots, i, fn, count, &next, batchcb, udata)) {
+      ++active;
+    }
+  }
+
+  while (active > 0) {
+    res = syscall (__NR_io_uring_enter, ring.ringfd,
+        waitonly ? 0 : ring.pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    waitonly = false;
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if ((errno == EAGAIN || errno == EBUSY) && ring.inflight > 0) {
+        /* the kernel will not take more reads until some of the */
+        /* completions are processed.  if none have arrived yet, */
+        /* wait for one before the reads are submitted again */
+        waitonly =
+            *ring.cqhead == __atomic_load_n (ring.cqtail, __ATOMIC_ACQUIRE);
+        res = 0;
+      } else if ((errno == EAGAIN || errno == EBUSY) &&
+          retry < MP4TAG_BATCH_RETRY) {
+        /* nothing to wait for, the kernel is short of resources */
+        ++retry;
+        mp4tag_sleep (MP4TAG_SLEEP_TIME);
+        continue;
+      } else {
+        rc = MP4TAG_ERR_FILE_READ_ERROR;
+        break;
+      }
+    } else {
+      retry = 0;
+    }
+    ring.pending -= res;
+    ring.inflight += res;
+
+    active = mp4tag_batch_reap (&ring, slots, active, fn, count, &next,
+        MP4TAG_OK, batchcb, udata);
+  }
+
+  /* the kernel may still write to the buffers of the reads that */
+  /* were submitted.  the reads not yet submitted never will be. */
+  while (rc != MP4TAG_OK && ring.inflight > 0) {
+    res = syscall (__NR_io_uring_enter, ring.ringfd, 0, 1,
+        IORING_ENTER_GETEVENTS, NULL, 0);
+    if (res < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      break;
+    }
+    active = mp4tag_batch_reap (&ring, slots, active, fn, count, &next,
+        rc, batchcb, udata);
+  }
+
+  for (int i = 0; i < depth; ++i) {
+    if (slots [i].idx >= 0) {
+      /* only if the submission failed */
+      mp4tag_batch_done (&slots [i], rc, batchcb, udata);
+    }
+    if (slots [i].buff != NULL && ring.inflight == 0) {
+      free (slots [i].buff);
+    }
+  }
+  /* the callback is called for the files that were not started */
+  while (next < count) {
+    batchcb (NULL, next, rc, udata);
+    ++next;
+  }
+  if (ring.inflight > 0) {
+    /* the reads could not be waited for.  the buffers and the */
+    /* ring are not released, as they may still be in use */
+    return rc;
+  }
+  free (slots);
+  mp4tag_ring_free (&ring);
+
+  return rc;
+}
+
+/* processes the completed reads.  each file's next read is queued, */
+/* or if the file is done, the next file is started in its slot. */
+/* if stop is not MP4TAG_OK, the files are finished with that error */
+/* and no more reads are queued. */
+/* returns the number of slots that have a file in process */
+static int
+mp4tag_batch_reap (mp4tagring_t *ring, mp4tagbatchslot_t *slots,
+    int active, const char *fn [], int count, int *next, int stop,
+    mp4tag_batchcb_t batchcb, void *udata)
+{
+  struct io_uring_cqe *cqe;
+  unsigned            head;
+  unsigned            tail;
+
+  head = *ring->cqhead;
+  tail = __atomic_load_n (ring->cqtail, __ATOMIC_ACQUIRE);
+  while (head != tail) {
+    mp4tagbatchslot_t   *slot;
+    int                 res;
+    int                 frc;
+
+    cqe = &ring->cqes [head & *ring->cqmask];
+    slot = &slots [cqe->user_data];
+    res = cqe->res;
+    ++head;
+    ring->inflight -= 1;
+
+    if (res < 0) {
+      slot->libmp4tag->mp4error = MP4TAG_ERR_FILE_READ_ERROR;
+      frc = MP4TAG_ERR_FILE_READ_ERROR;
+    } else {
+      /* a read of zero bytes is the end of the file */
+      frc = mp4tag_feed (slot->libmp4tag, slot->buff, res);
+    }
+
+    if (frc == MP4TAG_NEED_DATA || frc == MP4TAG_NEED_SKIP) {
+      if (stop == MP4TAG_OK) {
+        mp4tag_batch_read (ring, slots, slot - slots);
+        continue;
+      }
+      frc = stop;
+    }
+
+    mp4tag_batch_done (slot, frc, batchcb, udata);
+    if (stop != MP4TAG_OK ||
+        ! mp4tag_batch_start (ring, slots, slot - slots, fn, count,
+        next, batchcb, udata)) {
+      --active;
+    }
+  }
+  __atomic_store_n (ring->cqhead, head, __ATOMIC_RELEASE);
+
+  return active;
+}
+
+/* opens the next file that can be opened, and queues its first read. */
+/* returns false if there are no more files */
+static bool
+mp4tag_batch_start (mp4tagring_t *ring, mp4tagbatchslot_t *slots, int sidx,
+    const char *fn [], int count, int *next,
+    mp4tag_batchcb_t batchcb, void *udata)
+{
+  mp4tagbatchslot_t   *slot = &slots [sidx];
+  int                 mp4error;
+
+  while (*next < count) {
+    slot->idx = *next;
+    *next += 1;
+
+    slot->fd = open (fn [slot->idx], O_RDONLY | O_CLOEXEC);
+    if (slot->fd < 0) {
+      batchcb (NULL, slot->idx, MP4TAG_ERR_FILE_NOT_FOUND, udata);
+      continue;
+    }
+    slot->libmp4tag = mp4tag_openfeed (&mp4error);
+    if (slot->libmp4tag == NULL) {
+      close (slot->fd);
+      batchcb (NULL, slot->idx, mp4error, udata);
+      continue;
+    }
+
+    mp4tag_batch_read (ring, slots, sidx);
+    return true;
+  }
+
+  slot->idx = -1;
+  slot->fd = -1;
+  return false;
+}
+
+/* queues a read at the offset the parser needs */
+static void
+mp4tag_batch_read (mp4tagring_t *ring, mp4tagbatchslot_t *slots, int sidx)
+{
+  mp4tagbatchslot_t   *slot = &slots [sidx];
+  struct io_uring_sqe *sqe;
+  unsigned            tail;
+  unsigned            idx;
+
+  slot->iov.iov_len = mp4tag_batch_size (slot->libmp4tag,
+      &slot->buff, &slot->buffsz);
+  slot->iov.iov_base = slot->buff;
+
+  /* there are never more reads outstanding than there are slots, */
+  /* and the ring has at least that many entries */
+  tail = *ring->sqtail;
+  idx = tail & *ring->sqmask;
+  sqe = &ring->sqes [idx];
+  memset (sqe, 0, sizeof (struct io_uring_sqe));
+  sqe->opcode = IORING_OP_READV;
+  sqe->fd = slot->fd;
+  sqe->addr = (uint64_t) (uintptr_t) &slot->iov;
+  sqe->len = 1;
+  sqe->off = (uint64_t) mp4tag_feed_offset (slot->libmp4tag);
+  sqe->user_data = sidx;
+  ring->sqarray [idx] = idx;
+  __atomic_store_n (ring->sqtail, tail + 1, __ATOMIC_RELEASE);
+  ring->pending += 1;
+}
+
+/* the handle is freed once the callback returns */
+static void
+mp4tag_batch_done (mp4tagbatchslot_t *slot, int rc,
+    mp4tag_batchcb_t batchcb, void *udata)
+{
+  close (slot->fd);
+  batchcb (slot->libmp4tag, slot->idx, rc, udata);
+  mp4tag_free (slot->libmp4tag);
+  slot->libmp4tag = NULL;
+  slot->idx = -1;
+  slot->fd = -1;
+}
+
+static bool
+mp4tag_ring_init (mp4tagring_t *ring, unsigned entries)
+{
+  struct io_uring_params  p;
+  char                    *sq;
+  char                    *cq;
+
+  memset (&p, 0, sizeof (p));
+  ring->ringfd = syscall (__NR_io_uring_setup, entries, &p);
+  if (ring->ringfd < 0) {
+    /* not supported by the kernel, or not permitted */
+    return false;
+  }
+
+  ring->sqringsz = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+  ring->cqringsz = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+  ring->sqessz = p.sq_entries * sizeof (struct io_uring_sqe);
+  ring->pending = 0;
+  ring->inflight = 0;
+
+  ring->sqring = mmap (NULL, ring->sqringsz, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring->ringfd, IORING_OFF_SQ_RING);
+  ring->cqring = mmap (NULL, ring->cqringsz, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring->ringfd, IORING_OFF_CQ_RING);
+  ring->sqes = mmap (NULL, ring->sqessz, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring->ringfd, IORING_OFF_SQES);
+  if (ring->sqring == MAP_FAILED ||
+      ring->cqring == MAP_FAILED ||
+      ring->sqes == MAP_FAILED) {
+    mp4tag_ring_free (ring);
+    return false;
+  }
+
+  sq = ring->sqring;
+  ring->sqtail = (unsigned *) (sq + p.sq_off.tail);
+  ring->sqmask = (unsigned *) (sq + p.sq_off.ring_mask);
+  ring->sqarray = (unsigned *) (sq + p.sq_off.array);
+  cq = ring->cqring;
+  ring->cqhead = (unsigned *) (cq + p.cq_off.head);
+  ring->cqtail = (unsigned *) (cq + p.cq_off.tail);
+  ring->cqmask = (unsigned *) (cq + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+  return true;
+}
+
+static void
+mp4tag_ring_free (mp4tagring_t *ring)
+{
+  if (ring->sqes != MAP_FAILED) {
+    munmap (ring->sqes, ring->sqessz);
+  }
+  if (ring->cqring != MAP_FAILED) {
+    munmap (ring->cqring, ring->cqringsz);
+  }
+  if (ring->sqring != MAP_FAILED) {
+    munmap (ring->sqring, ring->sqringsz);
+  }
+  close (ring->ringfd);
+}
+
+#endif /* MP4TAG_USE_URING */
@@ -19,18 +19,31 @@
 
 #include "libmp4tag.h"
 
+enum {
+  CLI_FILTER_MAX = 20,
+};
+
 typedef struct {
   int       nargc;
   char      **utf8argv;
 } argcopy_t;
 
-static libmp4tag_t * openparse (const char *fname, int dbgflags, int options, int32_t freespacesz);
-static libmp4tag_t * openstream_parse (FILE *fh, int dbgflags, int options, int32_t freespacesz);
+typedef struct {
+  const char  *tags [CLI_FILTER_MAX];
+  char        names [CLI_FILTER_MAX][MP4TAG_ID_MAX];
+  int         count;
+} clifilter_t;
+
+static libmp4tag_t * openparse (const char *fname, int dbgflags, int options, int32_t freespacesz, clifilter_t *filter, bool readonly);
+static libmp4tag_t * openstream_parse (FILE *fh, int dbgflags, int options, int32_t freespacesz, clifilter_t *filter);
+static libmp4tag_t * openfeed_parse (FILE *fh, int dbgflags, int options, clifilter_t *filter);
+static int probefile (const char *fname, int dbgflags);
 static void setTagName (const char *tag, char *buff, size_t sz);
 static void displayTag (mp4tagpub_t *mp4tagpub);
 static void cleanargs (argcopy_t *argcopy);
 static size_t clireadcb (char *buff, size_t sz, size_t nmemb, void *udata);
 static int cliseekcb (size_t offset, void *udata);
+static int cliwaitcb (uint32_t timeout, void *udata);
 
 int
 main (int argc, char *argv [])
@@ -46,6 +59,7 @@ main (int argc, char *argv [])
   const         char *copyto = NULL;
   const         char *preservecmd = NULL;
   const         char *dumpfn = NULL;
+  bool          asfeed = false;
   bool          asstream = false;
   bool          clean = false;
   bool          copy = false;
@@ -54,12 +68,15 @@ main (int argc, char *argv [])
   bool          duration = false;
   bool          forcebinary = false;
   bool          preserve = false;
+  bool          probe = false;
+  bool          readonly = false;
   bool          testbin = false;
   bool          write = false;
   int           fnidx = -1;
   int           dbgflags = 0;
   int           options = 0;
   int32_t       freespacesz = 0;
+  clifilter_t   filter;
   int           rc = MP4TAG_OK;
   char          *targ;
 #if _lib_GetCommandLineW
@@ -69,6 +86,7 @@ main (int argc, char *argv [])
   FILE          *fh = NULL;          // for openstream test
 
   static struct option mp4tagcli_options [] = {
+    { "asfeed",         no_argument,        NULL,   'e' },
     { "asstream",       no_argument,        NULL,   's' },
     { "binary",         no_argument,        NULL,   'b' },
     { "clean",          no_argument,        NULL,   'c' },
@@ -79,8 +97,13 @@ main (int argc, char *argv [])
     { "display",        required_argument,  NULL,   'd' },
     { "dump",           required_argument,  NULL,   'D' },
     { "duration",       no_argument,        NULL,   'u' },
+    { "filter",         required_argument,  NULL,   'T' },
     { "freespace",      required_argument,  NULL,   'F' },
+    { "ilstview",       no_argument,        NULL,   'I' },
+    { "mmap",           no_argument,        NULL,   'm' },
     { "preserve",       required_argument,  NULL,   'P' },
+    { "probe",          no_argument,        NULL,   'p' },
+    { "readonly",       no_argument,        NULL,   'r' },
     { "testbin",        no_argument,        NULL,   'B' },
     { "version",        no_argument,        NULL,   'v' },
     { NULL,             0,                  NULL,   0 }
@@ -105,6 +128,7 @@ main (int argc, char *argv [])
 #endif
 
   *tagname = '\0';
+  filter.count = 0;
 
   /* do not specify the 'c' clean short argument */
   while ((c = getopt_long_only (argc, argcopy.utf8argv, "d:D:f:kFt:ux:",
@@ -151,14 +175,46 @@ main (int argc, char *argv [])
         }
         break;
       }
+      case 'I': {
+        options |= MP4TAG_OPTION_ILST_VIEW;
+        break;
+      }
       case 'k': {
         options |= MP4TAG_OPTION_KEEP_BACKUP;
         break;
       }
+      case 'e': {
+        /* a feed is processed as a stream */
+        asfeed = true;
+        asstream = true;
+        break;
+      }
+      case 'm': {
+        options |= MP4TAG_OPTION_MMAP;
+        break;
+      }
+      case 'p': {
+        probe = true;
+        break;
+      }
+      case 'r': {
+        readonly = true;
+        break;
+      }
       case 's': {
         asstream = true;
         break;
       }
+      case 'T': {
+        if (optarg != NULL && filter.count < CLI_FILTER_MAX) {
+          targ = argcopy.utf8argv [optind - 1];
+          setTagName (targ, filter.names [filter.count],
+              sizeof (filter.names [filter.count]));
+          filter.tags [filter.count] = filter.names [filter.count];
+          filter.count += 1;
+        }
+        break;
+      }
       case 't': {
         if (optarg != NULL) {
           targ = argcopy.utf8argv [optind - 1];
@@ -210,18 +266,27 @@ main (int argc, char *argv [])
     preserve = true;
   }
 
-  if (asstream) {
+  if (probe) {
+    rc = probefile (infname, dbgflags);
+    cleanargs (&argcopy);
+    return rc;
+  }
+
+  if (asfeed) {
     fh = fopen (infname, "rb");
-    libmp4tag = openstream_parse (fh, dbgflags, options, freespacesz);
+    libmp4tag = openfeed_parse (fh, dbgflags, options, &filter);
+  } else if (asstream) {
+    fh = fopen (infname, "rb");
+    libmp4tag = openstream_parse (fh, dbgflags, options, freespacesz, &filter);
   } else {
-    libmp4tag = openparse (infname, dbgflags, options, freespacesz);
+    libmp4tag = openparse (infname, dbgflags, options, freespacesz, &filter, readonly);
   }
 
   if (! asstream && preserve) {
     preservedata = mp4tag_preserve_tags (libmp4tag);
     mp4tag_free (libmp4tag);
     rc = system (preservecmd);
-    libmp4tag = openparse (infname, dbgflags, options, freespacesz);
+    libmp4tag = openparse (infname, dbgflags, options, freespacesz, NULL, false);
     rc = mp4tag_restore_tags (libmp4tag, preservedata);
     mp4tag_preserve_free (preservedata);
     write = true;
@@ -230,7 +295,7 @@ main (int argc, char *argv [])
   if (! asstream && copy) {
     preservedata = mp4tag_preserve_tags (libmp4tag);
     mp4tag_free (libmp4tag);
-    libmp4tag = openparse (copyto, dbgflags, options, freespacesz);
+    libmp4tag = openparse (copyto, dbgflags, options, freespacesz, NULL, false);
     mp4tag_restore_tags (libmp4tag, preservedata);
     mp4tag_preserve_free (preservedata);
     write = true;
@@ -301,6 +366,7 @@ main (int argc, char *argv [])
   if (rc == MP4TAG_OK && ! asstream && write) {
     if (mp4tag_write_tags (libmp4tag) != MP4TAG_OK) {
       fprintf (stderr, "Unable to write tags (%s)\n", mp4tag_error_str (libmp4tag));
+      rc = mp4tag_error (libmp4tag);
     }
   }
 
@@ -407,12 +473,17 @@ displayTag (mp4tagpub_t *mp4tagpub)
 }
 
 static libmp4tag_t *
-openparse (const char *fname, int dbgflags, int options, int32_t freespacesz)
+openparse (const char *fname, int dbgflags, int options,
+    int32_t freespacesz, clifilter_t *filter, bool readonly)
 {
   libmp4tag_t   *libmp4tag = NULL;
   int           mp4error;
 
-  libmp4tag = mp4tag_open (fname, &mp4error);
+  if (readonly) {
+    libmp4tag = mp4tag_open_readonly (fname, &mp4error);
+  } else {
+    libmp4tag = mp4tag_open (fname, &mp4error);
+  }
   if (libmp4tag == NULL) {
     fprintf (stderr, "unable to open %s\n", fname);
     exit (1);
@@ -425,16 +496,54 @@ openparse (const char *fname, int dbgflags, int options, int32_t freespacesz)
   if (freespacesz != 0) {
     mp4tag_set_free_space (libmp4tag, freespacesz);
   }
+  if (filter != NULL && filter->count > 0) {
+    mp4tag_set_tag_filter (libmp4tag, filter->tags, filter->count);
+  }
 
   mp4tag_parse (libmp4tag);
   return libmp4tag;
 }
 
+/* the tags are not parsed */
+static int
+probefile (const char *fname, int dbgflags)
+{
+  libmp4tag_t   *libmp4tag = NULL;
+  mp4tagprobe_t mp4tagprobe;
+  int           mp4error;
+  int           rc;
+
+  libmp4tag = mp4tag_open (fname, &mp4error);
+  if (libmp4tag == NULL) {
+    fprintf (stderr, "unable to open %s\n", fname);
+    exit (1);
+  }
+
+  if (dbgflags != 0) {
+    mp4tag_set_debug_flags (libmp4tag, dbgflags);
+  }
+
+  rc = mp4tag_probe (libmp4tag, &mp4tagprobe);
+  if (rc == MP4TAG_OK) {
+    fprintf (stdout, "duration=%" PRId64 "\n", mp4tagprobe.duration);
+    fprintf (stdout, "samplerate=%" PRId32 "\n", mp4tagprobe.samplerate);
+    fprintf (stdout, "creationdate=%" PRId64 "\n", mp4tagprobe.creationdate);
+    fprintf (stdout, "modifieddate=%" PRId64 "\n", mp4tagprobe.modifieddate);
+  } else {
+    fprintf (stderr, "unable to probe %s (%s)\n", fname,
+        mp4tag_error_str (libmp4tag));
+  }
+
+  mp4tag_free (libmp4tag);
+  return rc;
+}
+
 /* this is a very simplistic example using a file handle */
 /* a streaming interface would need to provide read and seek callback */
 /* functions that work with the user's stream */
 static libmp4tag_t *
-openstream_parse (FILE *fh, int dbgflags, int options, int32_t freespacesz)
+openstream_parse (FILE *fh, int dbgflags, int options,
+    int32_t freespacesz, clifilter_t *filter)
 {
   libmp4tag_t   *libmp4tag = NULL;
   int           mp4error;
@@ -446,17 +555,62 @@ openstream_parse (FILE *fh, int dbgflags, int options, int32_t freespacesz)
   }
 
   mp4tag_set_option (libmp4tag, options);
+  mp4tag_set_wait_callback (libmp4tag, cliwaitcb);
   if (dbgflags != 0) {
     mp4tag_set_debug_flags (libmp4tag, dbgflags);
   }
   if (freespacesz != 0) {
     mp4tag_set_free_space (libmp4tag, freespacesz);
   }
+  if (filter != NULL && filter->count > 0) {
+    mp4tag_set_tag_filter (libmp4tag, filter->tags, filter->count);
+  }
 
   mp4tag_parse (libmp4tag);
   return libmp4tag;
 }
 
+/* the data is pushed to the parser as it is read. */
+/* an application using an event loop would call mp4tag_feed */
+/* each time data arrives */
+static libmp4tag_t *
+openfeed_parse (FILE *fh, int dbgflags, int options, clifilter_t *filter)
+{
+  libmp4tag_t   *libmp4tag = NULL;
+  int           mp4error;
+  int           rc;
+  size_t        br;
+  char          buff [4096];
+
+  libmp4tag = mp4tag_openfeed (&mp4error);
+  if (libmp4tag == NULL || fh == NULL) {
+    fprintf (stderr, "unable to open feed\n");
+    exit (1);
+  }
+
+  mp4tag_set_option (libmp4tag, options);
+  if (dbgflags != 0) {
+    mp4tag_set_debug_flags (libmp4tag, dbgflags);
+  }
+  if (filter != NULL && filter->count > 0) {
+    mp4tag_set_tag_filter (libmp4tag, filter->tags, filter->count);
+  }
+
+  rc = MP4TAG_NEED_DATA;
+  while (rc == MP4TAG_NEED_DATA || rc == MP4TAG_NEED_SKIP) {
+    if (rc == MP4TAG_NEED_SKIP &&
+        mp4tag_fseek (fh, mp4tag_feed_offset (libmp4tag), SEEK_SET) != 0) {
+      /* indicate the end of the data */
+      br = 0;
+    } else {
+      br = fread (buff, 1, sizeof (buff), fh);
+    }
+    rc = mp4tag_feed (libmp4tag, buff, br);
+  }
+
+  return libmp4tag;
+}
+
 static size_t
 clireadcb (char *buff, size_t sz, size_t nmemb, void *udata)
 {
@@ -477,6 +631,20 @@ cliseekcb (size_t offset, void *udata)
   return rc;
 }
 
+/* a real stream would block here until more data arrives */
+/* or the timeout passes. */
+/* a file will never receive any more data once the end is reached */
+static int
+cliwaitcb (uint32_t timeout, void *udata)
+{
+  FILE    *fh = udata;
+
+  if (feof (fh)) {
+    return 1;
+  }
+  return 0;
+}
+
 static void
 cleanargs (argcopy_t *argcopy)
 {
@@ -9,14 +9,25 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#if _lib_pwritev
+# include <sys/uio.h>
+#endif
+#if __has_include (<sys/mman.h>)
+# include <sys/mman.h>
+#endif
+
 #if __has_include (<windows.h>)
 # define WIN32_LEAN_AND_MEAN 1
 # include <windows.h>
 #endif
+#if _lib_ReadFile
+# include <io.h>       /* _get_osfhandle */
+#endif
 
 #include "libmp4tag.h"
 #include "mp4tagint.h"
@@ -247,6 +258,241 @@ mp4tag_fseek (FILE *fh, int64_t offset, int whence)
 #endif
 }
 
+/* internal routines */
+
+/* positional reads and writes do not use or change the file position. */
+/* nothing may be buffered by stdio for the file, a file that has been */
+/* written using fwrite() must be flushed first. */
+/* returns the number of bytes read */
+size_t
+mp4tag_pread (FILE *fh, void *buff, size_t sz, int64_t offset)
+{
+  char      *cbuff = buff;
+  size_t    tot = 0;
+
+#if _lib_pread
+  ssize_t   rc;
+  int       fd;
+
+  fd = fileno (fh);
+  while (tot < sz) {
+    rc = pread (fd, cbuff + tot, sz - tot, offset + tot);
+    if (rc < 0 && errno == EINTR) {
+      continue;
+    }
+    if (rc <= 0) {
+      break;
+    }
+    tot += rc;
+  }
+#endif
+#if ! _lib_pread && _lib_ReadFile
+  HANDLE      fhandle;
+  OVERLAPPED  ov;
+  DWORD       br;
+  size_t      want;
+
+  fhandle = (HANDLE) _get_osfhandle (_fileno (fh));
+  while (tot < sz) {
+    want = sz - tot;
+    if (want > MP4TAG_WIN_IO_MAX) {
+      want = MP4TAG_WIN_IO_MAX;
+    }
+    memset (&ov, 0, sizeof (ov));
+    ov.Offset = (DWORD) ((offset + tot) & 0xffffffff);
+    ov.OffsetHigh = (DWORD) ((offset + tot) >> 32);
+    if (ReadFile (fhandle, cbuff + tot, (DWORD) want, &br, &ov) == 0 ||
+        br == 0) {
+      break;
+    }
+    tot += br;
+  }
+#endif
+#if ! _lib_pread && ! _lib_ReadFile
+  if (mp4tag_fseek (fh, offset, SEEK_SET) == 0) {
+    tot = fread (cbuff, 1, sz, fh);
+  }
+#endif
+
+  return tot;
+}
+
+/* returns the number of bytes written */
+size_t
+mp4tag_pwrite (FILE *fh, const void *buff, size_t sz, int64_t offset)
+{
+  const char  *cbuff = buff;
+  size_t      tot = 0;
+
+#if _lib_pwrite
+  ssize_t   rc;
+  int       fd;
+
+  fd = fileno (fh);
+  while (tot < sz) {
+    rc = pwrite (fd, cbuff + tot, sz - tot, offset + tot);
+    if (rc < 0 && errno == EINTR) {
+      continue;
+    }
+    if (rc <= 0) {
+      break;
+    }
+    tot += rc;
+  }
+#endif
+#if ! _lib_pwrite && _lib_ReadFile
+  HANDLE      fhandle;
+  OVERLAPPED  ov;
+  DWORD       bw;
+  size_t      want;
+
+  fhandle = (HANDLE) _get_osfhandle (_fileno (fh));
+  while (tot < sz) {
+    want = sz - tot;
+    if (want > MP4TAG_WIN_IO_MAX) {
+      want = MP4TAG_WIN_IO_MAX;
+    }
+    memset (&ov, 0, sizeof (ov));
+    ov.Offset = (DWORD) ((offset + tot) & 0xffffffff);
+    ov.OffsetHigh = (DWORD) ((offset + tot) >> 32);
+    if (WriteFile (fhandle, cbuff + tot, (DWORD) want, &bw, &ov) == 0 ||
+        bw == 0) {
+      break;
+    }
+    tot += bw;
+  }
+#endif
+#if ! _lib_pwrite && ! _lib_ReadFile
+  if (mp4tag_fseek (fh, offset, SEEK_SET) == 0) {
+    tot = fwrite (cbuff, 1, sz, fh);
+    fflush (fh);
+  }
+#endif
+
+  return tot;
+}
+
+/* writes the parts in order, starting at offset. */
+/* the parts must all be in memory. */
+/* returns the number of bytes written */
+size_t
+mp4tag_pwritev (FILE *fh, const mp4tagiov_t *iov, int iovcount, int64_t offset)
+{
+  size_t      tot = 0;
+
+#if _lib_pwritev
+  struct iovec  wiov [MP4TAG_IOV_MAX];
+  ssize_t       rc;
+  int           fd;
+  int           idx = 0;
+  size_t        skip = 0;     /* amount of iov [idx] already written */
+
+  fd = fileno (fh);
+  while (true) {
+    int     count = 0;
+
+    /* move past the parts that have been written */
+    while (idx < iovcount && skip >= iov [idx].len) {
+      skip -= iov [idx].len;
+      ++idx;
+    }
+    if (idx >= iovcount) {
+      break;
+    }
+
+    for (int i = idx; i < iovcount && count < MP4TAG_IOV_MAX; ++i) {
+      size_t    tskip = i == idx ? skip : 0;
+
+      wiov [count].iov_base = (void *) (iov [i].data + tskip);
+      wiov [count].iov_len = iov [i].len - tskip;
+      ++count;
+    }
+    rc = pwritev (fd, wiov, count, offset + tot);
+    if (rc < 0 && errno == EINTR) {
+      continue;
+    }
+    if (rc <= 0) {
+      break;
+    }
+    tot += rc;
+    skip += rc;
+  }
+#else
+  for (int i = 0; i < iovcount; ++i) {
+    size_t    bwrite;
+
+    bwrite = mp4tag_pwrite (fh, iov [i].data, iov [i].len, offset + tot);
+    tot += bwrite;
+    if (bwrite != iov [i].len) {
+      break;
+    }
+  }
+#endif
+
+  return tot;
+}
+
+/* maps the entire file read-only so that the parser can process */
+/* the boxes in place. returns false if the file could not be mapped, */
+/* in which case the standard file i/o is used. */
+bool
+mp4tag_map_file (libmp4tag_t *libmp4tag)
+{
+#if _lib_mmap
+  void    *data;
+
+  if (libmp4tag->isstream || libmp4tag->fh == NULL) {
+    return false;
+  }
+  if ((ssize_t) libmp4tag->filesz <= 0) {
+    return false;
+  }
+
+  data = mmap (NULL, libmp4tag->filesz, PROT_READ, MAP_SHARED,
+      fileno (libmp4tag->fh), 0);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  libmp4tag->mapdata = data;
+  libmp4tag->mapsz = libmp4tag->filesz;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void
+mp4tag_unmap_file (libmp4tag_t *libmp4tag)
+{
+  if (libmp4tag->mapdata == NULL) {
+    return;
+  }
+
+#if _lib_mmap
+  munmap ((void *) libmp4tag->mapdata, libmp4tag->mapsz);
+#endif
+  libmp4tag->mapdata = NULL;
+  libmp4tag->mapsz = 0;
+}
+
+/* a stream's read-ahead buffer holds data that cannot be read again, */
+/* and is kept */
+void
+mp4tag_release_read_buffer (libmp4tag_t *libmp4tag)
+{
+  if (libmp4tag->isstream) {
+    return;
+  }
+
+  if (libmp4tag->rabuff != NULL) {
+    free (libmp4tag->rabuff);
+    libmp4tag->rabuff = NULL;
+  }
+  libmp4tag->rabuffsz = 0;
+  libmp4tag->rabufflen = 0;
+  libmp4tag->rabuffoffset = 0;
+}
+
 #ifdef _WIN32
 
 NODISCARD
@@ -0,0 +1,271 @@
+/* generated by mp4tagmkhash from mp4taglist (mp4const.c) */
+/* do not edit */
+
+#ifndef INC_MP4TAGHASH_H
+#define INC_MP4TAGHASH_H
+
+#define MP4TAG_HASH_MULT 0xb71baca7U
+#define MP4TAG_HASH_SHIFT 24
+#define MP4TAG_HASH_SZ 256
+
+/* fourcc, mp4taglist index */
+static const mp4taghash_t mp4taghash [MP4TAG_HASH_SZ] = {
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x6469736b, 10 },  /* disk */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0xa9415254, 40 },  /* ©ART */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x61744944,  2 },  /* atID */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x61415254,  0 },  /* aART */
+  { 0x00000000, -1 },
+  { 0x6c646573, 16 },  /* ldes */
+  { 0x74767368, 38 },  /* tvsh */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x6f776e72, 17 },  /* ownr */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x6b657977, 15 },  /* keyw */
+  { 0x00000000, -1 },
+  { 0x70676170, 19 },  /* pgap */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x7374696b, 32 },  /* stik */
+  { 0x00000000, -1 },
+  { 0xa9677270, 46 },  /* ©grp */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x72746e67, 23 },  /* rtng */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0xa96d766e, 50 },  /* ©mvn */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x63617467,  3 },  /* catg */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x65676964, 11 },  /* egid */
+  { 0x70637374, 18 },  /* pcst */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x636e4944,  5 },  /* cnID */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0xa967656e, 45 },  /* ©gen */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0xa96d7663, 48 },  /* ©mvc */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x73664944, 24 },  /* sfID */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0xa977726b, 55 },  /* ©wrk */
+  { 0x7476736e, 39 },  /* tvsn */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x63707274,  8 },  /* cprt */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x74766573, 36 },  /* tves */
+  { 0x706c4944, 20 },  /* plID */
+  { 0xa9616c62, 41 },  /* ©alb */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0xa9707562, 53 },  /* ©pub */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x7075726c, 22 },  /* purl */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x68647664, 14 },  /* hdvd */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0xa9646972, 44 },  /* ©dir */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x64657363,  9 },  /* desc */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x736f616c, 27 },  /* soal */
+  { 0xa96d7669, 49 },  /* ©mvi */
+  { 0x636d4944,  4 },  /* cmID */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x746d706f, 33 },  /* tmpo */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0xa96c7972, 47 },  /* ©lyr */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x6370696c,  7 },  /* cpil */
+  { 0xa9646179, 43 },  /* ©day */
+  { 0x00000000, -1 },
+  { 0xa96e7274, 52 },  /* ©nrt */
+  { 0x00000000, -1 },
+  { 0x736f6e6d, 30 },  /* sonm */
+  { 0x636f7672,  6 },  /* covr */
+  { 0x00000000, -1 },
+  { 0x736f6161, 26 },  /* soaa */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0xa9636d74, 42 },  /* ©cmt */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0xa9777274, 56 },  /* ©wrt */
+  { 0x74726b6e, 34 },  /* trkn */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x70757264, 21 },  /* purd */
+  { 0x74766e6e, 37 },  /* tvnn */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x67654944, 12 },  /* geID */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x7476656e, 35 },  /* tven */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0xa9746f6f, 54 },  /* ©too */
+  { 0x00000000, -1 },
+  { 0xa96e616d, 51 },  /* ©nam */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x736f6172, 28 },  /* soar */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x676e7265, 13 },  /* gnre */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+  { 0x616b4944,  1 },  /* akID */
+  { 0x00000000, -1 },
+  { 0x736f636f, 29 },  /* soco */
+  { 0x00000000, -1 },
+  { 0x7368776d, 25 },  /* shwm */
+  { 0x736f736e, 31 },  /* sosn */
+  { 0x00000000, -1 },
+  { 0x00000000, -1 },
+};
+
+#endif /* INC_MP4TAGHASH_H */
@@ -0,0 +1,218 @@
+/*
+ * Copyright 2026 Brad Lanam Pleasant Hill CA
+ */
+
+/*
+ * The hash index of the tag list.
+ * Open addressing with linear probing, keyed on the tag name and
+ * the data index.  The index is built when a tag is first located
+ * after the tag list has been changed as a whole (parse, sort,
+ * compaction, restore).  A tag added to or deleted from the tag list
+ * updates the index in place.
+ * If the index cannot be built, the tag list is searched instead
+ * (mp4tag_locate_tag).
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "libmp4tag.h"
+#include "mp4tagint.h"
+
+enum {
+  MP4TAG_INDEX_MIN_SZ = 16,
+};
+
+static void mp4tag_index_add (libmp4tag_t *libmp4tag, uint32_t hash, int idx);
+static uint32_t mp4tag_index_hash (const char *tag, int dataidx);
+
+/* the index must be valid */
+int
+mp4tag_index_find (libmp4tag_t *libmp4tag, const char *tag, int dataidx)
+{
+  uint32_t  hash;
+  uint32_t  mask;
+  uint32_t  slot;
+
+  hash = mp4tag_index_hash (tag, dataidx);
+  mask = libmp4tag->tagindexsz - 1;
+  slot = hash & mask;
+  while (libmp4tag->tagindex [slot].idx >= 0) {
+    const mp4tagindexent_t  *ent = &libmp4tag->tagindex [slot];
+    const mp4tag_t          *mp4tag = &libmp4tag->tags [ent->idx];
+
+    if (ent->hash == hash &&
+        mp4tag->dataidx == dataidx &&
+        strcmp (mp4tag->tag, tag) == 0) {
+      return ent->idx;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  return MP4TAG_NOTFOUND;
+}
+
+/* the tag at idx has been added to the end of the tag list */
+void
+mp4tag_index_add_tag (libmp4tag_t *libmp4tag, int idx)
+{
+  if (! libmp4tag->tagindexvalid || idx < 0) {
+    return;
+  }
+  if (libmp4tag->tagcount * 2 > libmp4tag->tagindexsz) {
+    /* re-built at the larger size when next used */
+    libmp4tag->tagindexvalid = false;
+    return;
+  }
+
+  mp4tag_index_add (libmp4tag, mp4tag_index_hash (libmp4tag->tags [idx].tag,
+      libmp4tag->tags [idx].dataidx), idx);
+}
+
+/* called before the tag at idx is deleted. */
+/* the deleted tag keeps its place in the tag list until the list */
+/* is compacted, so no other entry changes */
+void
+mp4tag_index_remove (libmp4tag_t *libmp4tag, int idx)
+{
+  uint32_t  mask;
+  uint32_t  slot;
+  uint32_t  next;
+
+  if (! libmp4tag->tagindexvalid) {
+    return;
+  }
+  if (libmp4tag->tags [idx].tag == NULL) {
+    /* not in the index */
+    return;
+  }
+
+  mask = libmp4tag->tagindexsz - 1;
+  slot = mp4tag_index_hash (libmp4tag->tags [idx].tag,
+      libmp4tag->tags [idx].dataidx) & mask;
+  while (libmp4tag->tagindex [slot].idx != idx) {
+    if (libmp4tag->tagindex [slot].idx < 0) {
+      /* not possible, but the index is no longer trusted */
+      libmp4tag->tagindexvalid = false;
+      return;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  /* the entries following the removed entry are moved back, */
+  /* unless they would be moved before their home slot */
+  next = slot;
+  while (true) {
+    uint32_t    home;
+
+    next = (next + 1) & mask;
+    if (libmp4tag->tagindex [next].idx < 0) {
+      break;
+    }
+    home = libmp4tag->tagindex [next].hash & mask;
+    if (((next - home) & mask) >= ((next - slot) & mask)) {
+      libmp4tag->tagindex [slot] = libmp4tag->tagindex [next];
+      slot = next;
+    }
+  }
+  libmp4tag->tagindex [slot].idx = -1;
+}
+
+/* the tag list has been changed as a whole */
+void
+mp4tag_index_invalidate (libmp4tag_t *libmp4tag)
+{
+  libmp4tag->tagindexvalid = false;
+}
+
+void
+mp4tag_index_free (libmp4tag_t *libmp4tag)
+{
+  if (libmp4tag->tagindex != NULL) {
+    free (libmp4tag->tagindex);
+    libmp4tag->tagindex = NULL;
+  }
+  libmp4tag->tagindexsz = 0;
+  libmp4tag->tagindexvalid = false;
+}
+
+/* the index is kept at most half full. */
+/* if the index cannot be allocated, it is left invalid, */
+/* and the tag list is searched. */
+bool
+mp4tag_index_build (libmp4tag_t *libmp4tag)
+{
+  int     sz;
+
+  sz = MP4TAG_INDEX_MIN_SZ;
+  while (sz < libmp4tag->tagcount * 4) {
+    sz *= 2;
+  }
+
+  if (sz > libmp4tag->tagindexsz) {
+    mp4tagindexent_t  *tagindex;
+
+    tagindex = realloc (libmp4tag->tagindex, sizeof (mp4tagindexent_t) * sz);
+    if (tagindex == NULL) {
+      libmp4tag->tagindexvalid = false;
+      return false;
+    }
+    libmp4tag->tagindex = tagindex;
+    libmp4tag->tagindexsz = sz;
+  }
+
+  for (int i = 0; i < libmp4tag->tagindexsz; ++i) {
+    libmp4tag->tagindex [i].idx = -1;
+  }
+  for (int i = 0; i < libmp4tag->tagcount; ++i) {
+    if (libmp4tag->tags [i].tag == NULL) {
+      continue;
+    }
+    mp4tag_index_add (libmp4tag, mp4tag_index_hash (libmp4tag->tags [i].tag,
+        libmp4tag->tags [i].dataidx), i);
+  }
+
+  libmp4tag->tagindexvalid = true;
+  return true;
+}
+
+static void
+mp4tag_index_add (libmp4tag_t *libmp4tag, uint32_t hash, int idx)
+{
+  uint32_t  mask;
+  uint32_t  slot;
+
+  mask = libmp4tag->tagindexsz - 1;
+  slot = hash & mask;
+  while (libmp4tag->tagindex [slot].idx >= 0) {
+    slot = (slot + 1) & mask;
+  }
+  libmp4tag->tagindex [slot].hash = hash;
+  libmp4tag->tagindex [slot].idx = idx;
+}
+
+/* fnv-1a, with the data index mixed in last */
+static uint32_t
+mp4tag_index_hash (const char *tag, int dataidx)
+{
+  const unsigned char *p = (const unsigned char *) tag;
+  uint32_t            hash = 2166136261U;
+
+  while (*p) {
+    hash ^= *p++;
+    hash *= 16777619U;
+  }
+  hash ^= (uint32_t) dataidx;
+  hash *= 16777619U;
+
+  /* the low bits are used for the slot */
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bU;
+  hash ^= hash >> 13;
+  return hash;
+}
@@ -19,6 +19,11 @@ extern "C" {
 
 #define LIBMP4TAG_DEBUG 0
 
+/* the box identifier as a 32-bit big-endian value */
+#define MP4TAG_FOURCC(a,b,c,d) \
+    (((uint32_t) (uint8_t) (a) << 24) | ((uint32_t) (uint8_t) (b) << 16) | \
+    ((uint32_t) (uint8_t) (c) << 8) | (uint32_t) (uint8_t) (d))
+
 enum {
   /* various idents that libmp4tag needs to descend into or use */
   MP4TAG_CO64,
@@ -31,6 +36,7 @@ enum {
   MP4TAG_META,
   MP4TAG_MINF,
   MP4TAG_MOOV,
+  MP4TAG_MVHD,
   MP4TAG_STBL,
   MP4TAG_STCO,
   MP4TAG_TRAK,
@@ -48,6 +54,19 @@ enum {
   MP4TAG_NAME,
 };
 
+/* the actions the parser takes for a box type */
+enum {
+  MP4TAG_BOX_NONE       = 0,
+  /* a container that is descended into */
+  MP4TAG_BOX_DESCEND    = (1 << 0),
+  /* a container on the path to a track's chunk offset table */
+  MP4TAG_BOX_TRACK      = (1 << 1),
+  /* the location of the box is saved for writing */
+  MP4TAG_BOX_OFFSET     = (1 << 2),
+  /* the box data is read and processed */
+  MP4TAG_BOX_DATA       = (1 << 3),
+};
+
 enum {
   MP4TAG_NOTFOUND = -1,     // returned by find-tag
   MP4TAG_ID_LEN = 4,
@@ -77,6 +96,28 @@ enum {
   /* the copy size seems to make little difference in speed */
   MP4TAG_COPY_SIZE = 5 * 1024 * 1024,       // 5 mibibytes
   MP4TAG_FREE_SPACE_SZ = 2048,
+  MP4TAG_READ_BUFF_SZ = 64 * 1024,
+  /* the largest single ReadFile()/WriteFile() */
+  MP4TAG_WIN_IO_MAX = 1024 * 1024 * 1024,
+  /* the number of files mp4tag_parse_batch has in process at once */
+  MP4TAG_BATCH_DEPTH = 32,
+  /* the number of times mp4tag_parse_batch re-tries a submission the */
+  /* kernel did not accept, when there are no reads to wait for */
+  MP4TAG_BATCH_RETRY = 50,
+  /* chunk offset tables closer than this are updated with a single */
+  /* read and write */
+  MP4TAG_CO_GAP_SZ = 64 * 1024,
+  /* binary data of this size or larger is not read during the parse */
+  MP4TAG_LAZY_SZ = 4 * 1024,
+  /* a box smaller than this is read into a buffer on the stack */
+  MP4TAG_BOX_BUFF_SZ = 1024,
+  /* when writing, a tag value of this size or larger is written */
+  /* from the tag rather than being copied */
+  MP4TAG_WRITE_REF_SZ = 1024,
+  /* the number of parts passed to a single pwritev() */
+  MP4TAG_IOV_MAX = 64,
+  /* space reserved in the ilst view for a numeric value or genre name */
+  MP4TAG_VIEW_NUM_SZ = 40,
   MP4TAG_NO_FILESZ = -3,
   MP4TAG_READ_OK = 1,
   MP4TAG_READ_NONE = 0,
@@ -103,6 +144,10 @@ typedef struct mp4tag {
   char      *data;
   char      *covername;
   uint32_t  datalen;
+  /* binary data that has not been read has a file offset */
+  int64_t   dataoffset;
+  /* the location of the data within the data built by the writer */
+  uint32_t  writeoffset;
   int       dataidx;
   int       idx;
   /* identtype is the flag value from the original data */
@@ -111,17 +156,123 @@ typedef struct mp4tag {
   int       internallen;
   /* priority is used to order the tags for writing */
   int       priority;
+  /* the MP4TAG_INPOOL_* flags for the tag name and values */
+  /* that are located in the ilst view or the tag arena */
+  int       inpool;
   bool      binary;
 } mp4tag_t;
 
+/* a tag name or value located in the ilst view or the tag arena */
+/* is not freed on its own */
+enum {
+  MP4TAG_INPOOL_TAG = 0x0001,
+  MP4TAG_INPOOL_DATA = 0x0002,
+  MP4TAG_INPOOL_COVERNAME = 0x0004,
+};
+
+/* an entry in the hash index of the tag list (mp4tagindex.c). */
+/* hash is the hash of the tag name and data index, */
+/* idx is the position in the tag list, -1 if the entry is empty */
+typedef struct {
+  uint32_t  hash;
+  int       idx;
+} mp4tagindexent_t;
+
+/* the sort key of a tag in the tag list (mp4tagutil.c). */
+/* key is the first four bytes of the tag name as an integer, */
+/* which orders the same as strcmp() */
+typedef struct {
+  uint32_t    key;
+  int         dataidx;
+  const char  *tag;
+  int         idx;
+} mp4tagkey_t;
+
+/* a chunk of the tag arena (mp4tagarena.c). */
+/* the chunks are linked, the most recent chunk is first */
+typedef struct mp4tagarena {
+  struct mp4tagarena  *next;
+  size_t              sz;
+  size_t              used;
+  /* the chunk's memory follows the header */
+} mp4tagarena_t;
+
+/* a part of the tag data built by the writer (mp4tagwrite.c). */
+/* the part is in memory, or if data is null, in the file at offset. */
+/* alloc is set if the data was read in by the writer */
+typedef struct {
+  const char  *data;
+  int64_t     offset;
+  size_t      len;
+  bool        alloc;
+} mp4tagiov_t;
+
+/* the 'ilst' data built by the writer.  the box headers and small */
+/* values are placed in buff, the large values are not copied. */
+/* iov lists the parts in the order they are written, */
+/* datalen is the total length */
+typedef struct {
+  mp4tagiov_t *iov;
+  int         iovcount;
+  char        *buff;
+  uint32_t    bufflen;
+  uint32_t    datalen;
+} mp4tagilst_t;
+
+/* the location of a chunk offset table, used by the write process */
+typedef struct {
+  int64_t   offset;
+  uint32_t  len;
+  int       offsetsz;
+} mp4tagcotable_t;
+
 typedef struct libmp4tag {
   int64_t         libmp4tagident;
   FILE            *fh;
   char            *fn;
+  /* memory-mapped file, only present while parsing */
+  const char      *mapdata;
+  size_t          mapsz;
   mp4tag_readcb_t readcb;
   mp4tag_seekcb_t seekcb;
+  mp4tag_waitcb_t waitcb;
   void            *userdata;
+  /* read-ahead buffer.  a stream uses rabuffidx as the position of */
+  /* the next byte, a file is read at rabuffoffset, only while parsing */
+  char            *rabuff;
+  size_t          rabuffsz;
+  size_t          rabufflen;
+  size_t          rabuffidx;
+  int64_t         rabuffoffset;
+  /* mp4tag_feed: the data that has been fed and not yet used, */
+  /* feedoffset is the offset of the first byte in the buffer */
+  char            *feedbuff;
+  size_t          feedlen;
+  size_t          feedalloc;
+  int64_t         feedoffset;
+  /* the offset of the end of the data the parse is waiting for */
+  int64_t         feedwant;
+  struct mp4tagwalk *feedwalk;
+  /* ilst view: the contents of the 'ilst' box, followed by */
+  /* the pool used for the tag names and string values */
+  char            *viewbuff;
+  size_t          viewlen;
+  size_t          viewalloc;
+  size_t          viewidx;
+  int64_t         viewoffset;
+  /* tag filter, only these tags are parsed */
+  char            **filter;
+  int             filtercount;
   mp4tag_t        *tags;
+  /* the tag names and values of a parsed file */
+  mp4tagarena_t   *arena;
+  /* hash index of the tag list, built when a tag is first located */
+  mp4tagindexent_t *tagindex;
+  int             tagindexsz;
+  bool            tagindexvalid;
+  /* the sort keys of the tag list, used to sort and write the tags */
+  mp4tagkey_t     *tagkeys;
+  int             tagkeyalloc;
   size_t          filesz;
   int64_t         offset;
   int64_t         creationdate;
@@ -133,7 +284,6 @@ typedef struct libmp4tag {
   /* used by the parser and writer */
   uint32_t        base_lengths [MP4TAG_LEVEL_MAX];
   int64_t         base_offsets [MP4TAG_LEVEL_MAX];
-  int64_t         rem_length [MP4TAG_LEVEL_MAX];
   uint64_t        ilst_remaining;           /* for 1.3.0 bug */
   /* base_name is for debugging, otherwise not needed */
   char            base_name [MP4TAG_LEVEL_MAX][MP4TAG_ID_DISP_LEN + 1];
@@ -149,10 +299,10 @@ typedef struct libmp4tag {
   int64_t         noilst_offset;
   int64_t         after_ilst_offset;
   uint32_t        insert_delta;
-  int64_t         stco_offset;
-  uint32_t        stco_len;
-  int64_t         co64_offset;
-  uint32_t        co64_len;
+  /* chunk offset tables (stco/co64) for every track */
+  mp4tagcotable_t *cotables;
+  int             cotablecount;
+  int             cotablealloc;
   /* datacount is a temporary variable used by both add-tag */
   /* and the write process */
   int             datacount;
@@ -162,6 +312,10 @@ typedef struct libmp4tag {
   /* tag list */
   int             tagcount;
   int             tagalloccount;
+  /* the number of deleted tags still in the tag list */
+  int             tagdeleted;
+  /* the number of tags at the start of the tag list that are in order */
+  int             tagsortcount;
   int             iterator;
   int             mp4error;
   int             dbgflags;
@@ -172,6 +326,7 @@ typedef struct libmp4tag {
   /* used by the parser */
   bool            processdata;
   bool            checkforfree;
+  bool            cotablescan;
   bool            parsedone;
   /* used by the parser to track 1.3.0 bug */
   bool            ilstremain;
@@ -183,6 +338,13 @@ typedef struct libmp4tag {
   /* streams */
   bool            isstream;
   bool            canwrite;
+  /* opened with mp4tag_openfeed */
+  bool            isfeed;
+  bool            feedftyp;
+  bool            feedneed;
+  bool            feedend;
+  /* opened with mp4tag_open_readonly */
+  bool            readonly;
 } libmp4tag_t;
 
 /* mp4const.c */
@@ -194,42 +356,99 @@ typedef struct {
   int         len;
 } mp4tagdef_t;
 
-extern const char *boxids [];
+typedef struct {
+  uint32_t    fourcc;
+  int         boxid;
+  int         flags;
+} mp4tagboxtype_t;
+
+/* the generated hash table of mp4taglist (mp4taghash.h) */
+typedef struct {
+  uint32_t    fourcc;
+  int         idx;
+} mp4taghash_t;
+
+extern const char * const boxids [];
+extern const mp4tagboxtype_t mp4tagboxtypes [];
+extern const int mp4tagboxtypeslen;
 extern const mp4tagdef_t mp4taglist [];
 extern const int mp4taglistlen;
-extern const char *mp4tagoldgenrelist [];
+extern const char * const mp4tagoldgenrelist [];
 extern const int mp4tagoldgenrelistsz;
 
+/* libmp4tag.c */
+
+int  mp4tag_reopen (libmp4tag_t *libmp4tag, const char *fn);
+
+/* mp4tagarena.c */
+
+void *mp4tag_arena_alloc (libmp4tag_t *libmp4tag, size_t sz);
+char *mp4tag_arena_dup (libmp4tag_t *libmp4tag, const char *str, size_t len);
+void mp4tag_arena_reset (libmp4tag_t *libmp4tag);
+void mp4tag_arena_free (libmp4tag_t *libmp4tag);
+
+/* mp4tagfileop.c */
+
+size_t mp4tag_pread (FILE *fh, void *buff, size_t sz, int64_t offset);
+size_t mp4tag_pwrite (FILE *fh, const void *buff, size_t sz, int64_t offset);
+size_t mp4tag_pwritev (FILE *fh, const mp4tagiov_t *iov, int iovcount, int64_t offset);
+bool mp4tag_map_file (libmp4tag_t *libmp4tag);
+void mp4tag_unmap_file (libmp4tag_t *libmp4tag);
+void mp4tag_release_read_buffer (libmp4tag_t *libmp4tag);
+
+/* mp4tagindex.c */
+
+int  mp4tag_index_find (libmp4tag_t *libmp4tag, const char *tag, int dataidx);
+void mp4tag_index_add_tag (libmp4tag_t *libmp4tag, int idx);
+void mp4tag_index_remove (libmp4tag_t *libmp4tag, int idx);
+void mp4tag_index_invalidate (libmp4tag_t *libmp4tag);
+bool mp4tag_index_build (libmp4tag_t *libmp4tag);
+void mp4tag_index_free (libmp4tag_t *libmp4tag);
+
 /* mp4tagparse.c */
 
-int  mp4tag_parse_file (libmp4tag_t *libmp4tag, uint32_t boxlen, int level);
+int  mp4tag_parse_file (libmp4tag_t *libmp4tag);
 int  mp4tag_parse_ftyp (libmp4tag_t *libmp4tag);
+int  mp4tag_feed_file (libmp4tag_t *libmp4tag);
+int  mp4tag_probe_file (libmp4tag_t *libmp4tag);
 
 /* mp4tagwrite.c */
 
-NODISCARD char  * mp4tag_build_data (libmp4tag_t *libmp4tag, uint32_t *dlen);
-int   mp4tag_write_data (libmp4tag_t *libmp4tag, const char *data, uint32_t datalen);
+int   mp4tag_build_data (libmp4tag_t *libmp4tag, mp4tagilst_t *ilst);
+int   mp4tag_write_data (libmp4tag_t *libmp4tag, mp4tagilst_t *ilst);
+void  mp4tag_free_build_data (mp4tagilst_t *ilst);
 
 
 /* mp4writeutil.c */
 void mp4tag_update_parent_lengths (libmp4tag_t *libmp4tag, FILE *ofh, int32_t delta);
+void mp4tag_relocate_offsets_32 (char *dptr, uint32_t count, uint64_t foffset, int32_t delta);
+void mp4tag_relocate_offsets_64 (char *dptr, uint32_t count, uint64_t foffset, int32_t delta);
 
 /* mp4tagutil.c */
 
-extern const char *MP4TAG_INPUT_DELIM;
+extern const char * const MP4TAG_INPUT_DELIM;
 void mp4tag_sort_tags (libmp4tag_t *libmp4tag);
+void mp4tag_compact_tags (libmp4tag_t *libmp4tag);
 int  mp4tag_find_tag (libmp4tag_t *libmp4tag, const char *tag, int dataidx);
+int  mp4tag_locate_tag (libmp4tag_t *libmp4tag, const char *tag, int dataidx);
 int  mp4tag_parse_tagname (char *tag, int *dataidx);
-NODISCARD mp4tagdef_t *mp4tag_check_tag (const char *tag);
-int  mp4tag_compare (const void *a, const void *b);
-int  mp4tag_compare_list (const void *a, const void *b);
+NODISCARD const mp4tagdef_t *mp4tag_check_tag (const char *tag);
+bool mp4tag_alloc_keys (libmp4tag_t *libmp4tag);
 int  mp4tag_add_tag (libmp4tag_t *libmp4tag, const char *tag, const char *data, ssize_t sz, uint32_t origflag, size_t origlen, const char *covername);
 int  mp4tag_set_tag_string (libmp4tag_t *libmp4tag, const char *name, int idx, const char *data);
 int  mp4tag_set_tag_binary (libmp4tag_t *libmp4tag, const char *name, int idx, const char *data, size_t sz, const char *fn);
+int  mp4tag_check_set_tag (libmp4tag_t *libmp4tag, const char *tag, bool binary, int *pidx);
+char *mp4tag_alloc_tag_value (const char *data, size_t sz, bool binary);
+void mp4tag_replace_tag_value (libmp4tag_t *libmp4tag, const char *tag, int idx, char *value, size_t sz, bool binary, const char *fn);
+void mp4tag_truncate_tags (libmp4tag_t *libmp4tag, int tagcount);
 void mp4tag_del_tag (libmp4tag_t *libmp4tag, int idx);
 void mp4tag_free_tag_by_idx (libmp4tag_t *libmp4tag, int idx);
 void mp4tag_free_tag (mp4tag_t *mp4tag);
+void mp4tag_free_data (mp4tag_t *mp4tag, void *data, int inpool);
 void mp4tag_clone_tag (libmp4tag_t *libmp4tag, mp4tag_t *target, mp4tag_t *source);
+int  mp4tag_load_tag_data (libmp4tag_t *libmp4tag, mp4tag_t *mp4tag);
+bool mp4tag_filter_tag (libmp4tag_t *libmp4tag, const char *tag);
+bool mp4tag_filter_box (libmp4tag_t *libmp4tag, const char *boxnm);
 void mp4tag_sleep (uint32_t ms);
 bool mp4tag_chk_dbg (libmp4tag_t *libmp4tag, int dbg);
 
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2026 Brad Lanam Pleasant Hill CA
+ *
+ * mp4tagmkhash
+ *    Generates mp4taghash.h, a perfect hash table of the known tags
+ *    in mp4taglist (mp4const.c), keyed on the 4-byte identifier as it
+ *    appears in the file.  mp4taghash.h is kept in the source tree,
+ *    and is re-generated with 'make hash'.  A native build checks that
+ *    it is up to date.
+ *
+ *    mp4tagmkhash <output-file>
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "mp4tagint.h"
+
+enum {
+  MKHASH_BITS_MIN = 6,
+  MKHASH_BITS_MAX = 10,
+  /* the number of multipliers tried for each table size */
+  MKHASH_TRIES = 2000000,
+};
+
+static uint32_t mkhash_fourcc (const char *tag);
+static bool mkhash_try (const uint32_t *fourccs, int count, uint32_t mult, int bits, int16_t *table);
+
+int
+main (int argc, char *argv [])
+{
+  uint32_t  *fourccs;
+  int16_t   *table;
+  uint32_t  mult = 0;
+  uint32_t  seed = 0x9e3779b9;
+  int       bits;
+  bool      found = false;
+  FILE      *ofh;
+
+  if (argc < 2) {
+    fprintf (stderr, "usage: mp4tagmkhash <output-file>\n");
+    return 1;
+  }
+
+  fourccs = malloc (sizeof (uint32_t) * mp4taglistlen);
+  table = malloc (sizeof (int16_t) << MKHASH_BITS_MAX);
+  if (fourccs == NULL || table == NULL) {
+    fprintf (stderr, "mp4tagmkhash: out of memory\n");
+    return 1;
+  }
+
+  for (int i = 0; i < mp4taglistlen; ++i) {
+    fourccs [i] = mkhash_fourcc (mp4taglist [i].tag);
+    for (int j = 0; j < i; ++j) {
+      if (fourccs [j] == fourccs [i]) {
+        fprintf (stderr, "mp4tagmkhash: duplicate tag %s\n",
+            mp4taglist [i].tag);
+        return 1;
+      }
+    }
+  }
+
+  /* the smallest table with no collisions is used. */
+  /* the multipliers are generated the same way every time, */
+  /* so the output does not change unless the list changes */
+  for (bits = MKHASH_BITS_MIN; bits <= MKHASH_BITS_MAX; ++bits) {
+    if ((1 << bits) < mp4taglistlen) {
+      continue;
+    }
+    for (int i = 0; i < MKHASH_TRIES; ++i) {
+      seed = seed * 1664525 + 1013904223;
+      mult = seed | 1;
+      if (mkhash_try (fourccs, mp4taglistlen, mult, bits, table)) {
+        found = true;
+        break;
+      }
+    }
+    if (found) {
+      break;
+    }
+  }
+
+  if (! found) {
+    fprintf (stderr, "mp4tagmkhash: unable to locate a perfect hash\n");
+    return 1;
+  }
+
+  ofh = fopen (argv [1], "w");
+  if (ofh == NULL) {
+    fprintf (stderr, "mp4tagmkhash: unable to open %s\n", argv [1]);
+    return 1;
+  }
+
+  fprintf (ofh, "/* generated by mp4tagmkhash from mp4taglist (mp4const.c) */\n");
+  fprintf (ofh, "/* do not edit */\n\n");
+  fprintf (ofh, "#ifndef INC_MP4TAGHASH_H\n");
+  fprintf (ofh, "#define INC_MP4TAGHASH_H\n\n");
+  fprintf (ofh, "#define MP4TAG_HASH_MULT 0x%08" PRIx32 "U\n", mult);
+  fprintf (ofh, "#define MP4TAG_HASH_SHIFT %d\n", 32 - bits);
+  fprintf (ofh, "#define MP4TAG_HASH_SZ %d\n\n", 1 << bits);
+  fprintf (ofh, "/* fourcc, mp4taglist index */\n");
+  fprintf (ofh, "static const mp4taghash_t mp4taghash [MP4TAG_HASH_SZ] = {\n");
+  for (int i = 0; i < (1 << bits); ++i) {
+    if (table [i] < 0) {
+      fprintf (ofh, "  { 0x00000000, -1 },\n");
+    } else {
+      fprintf (ofh, "  { 0x%08" PRIx32 ", %2d },  /* %s */\n",
+          fourccs [table [i]], table [i], mp4taglist [table [i]].tag);
+    }
+  }
+  fprintf (ofh, "};\n\n");
+  fprintf (ofh, "#endif /* INC_MP4TAGHASH_H */\n");
+
+  if (fclose (ofh) != 0) {
+    fprintf (stderr, "mp4tagmkhash: unable to write %s\n", argv [1]);
+    return 1;
+  }
+
+  free (fourccs);
+  free (table);
+  return 0;
+}
+
+/* the copyright symbol is a single byte in the file */
+static uint32_t
+mkhash_fourcc (const char *tag)
+{
+  size_t    clen;
+
+  clen = strlen (COPYRIGHT_STR);
+  if (strncmp (tag, COPYRIGHT_STR, clen) == 0) {
+    return MP4TAG_FOURCC (MP4TAG_PREFIX_CHAR, tag [clen],
+        tag [clen + 1], tag [clen + 2]);
+  }
+  return MP4TAG_FOURCC (tag [0], tag [1], tag [2], tag [3]);
+}
+
+static bool
+mkhash_try (const uint32_t *fourccs, int count, uint32_t mult, int bits,
+    int16_t *table)
+{
+  for (int i = 0; i < (1 << bits); ++i) {
+    table [i] = -1;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    uint32_t    h;
+
+    h = (uint32_t) (fourccs [i] * mult) >> (32 - bits);
+    if (table [h] >= 0) {
+      return false;
+    }
+    table [h] = i;
+  }
+
+  return true;
+}
@@ -27,11 +27,56 @@ typedef struct {
 typedef struct {
   uint64_t    boxlen;
   uint64_t    len;
+  uint32_t    fourcc;
+  /* the boxids index, or MP4TAG_NOTFOUND */
+  int         boxid;
+  /* the parser actions for the box type */
+  int         boxflags;
+  /* the display name is only filled in when it is used */
   char        nm [MP4TAG_ID_DISP_LEN];
-  uint64_t    dlen;
-  char        *data;
+  /* the amount of the box data that has been read or skipped */
+  uint64_t    used;
+  const char  *data;
+  /* set if the data was allocated rather than mapped */
+  char        *dalloc;
 } boxdata_t;
 
+enum {
+  MP4TAG_WALK_SKIP,
+  MP4TAG_WALK_DESCEND,
+  MP4TAG_WALK_STOP,
+};
+
+enum {
+  MP4TAG_WALK_NONE          = 0,
+  /* the box lengths are checked against the container's length */
+  MP4TAG_WALK_CHECK_LEN     = (1 << 0),
+  /* the file structure is printed (debugging) */
+  MP4TAG_WALK_TRACE         = (1 << 1),
+};
+
+/* one frame for each container that has been descended into */
+typedef struct {
+  boxdata_t   bd;
+  /* the remaining length of the container's contents */
+  int64_t     remlen;
+} mp4tagframe_t;
+
+typedef struct mp4tagwalk mp4tagwalk_t;
+
+typedef int (*mp4tagwalkenter_t) (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk, boxdata_t *bd);
+typedef void (*mp4tagwalkleave_t) (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk, boxdata_t *bd);
+typedef void (*mp4tagwalkfinish_t) (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk);
+
+struct mp4tagwalk {
+  mp4tagwalkenter_t   enter;
+  mp4tagwalkleave_t   leave;
+  mp4tagwalkfinish_t  finish;
+  int                 flags;
+  int                 level;
+  mp4tagframe_t       frames [MP4TAG_LEVEL_MAX];
+};
+
 typedef struct {
   uint32_t    flags;
 } boxmdhd_t;
@@ -64,414 +109,153 @@ typedef struct {
   uint32_t    moreflags;
 } boxmdhd8_t;
 
-static bool assertchecked = false;
-
+/* checked at compile time, there is no shared state to set at run time */
+static_assert (sizeof (boxhead_t) == 8, "boxhead_t size");
+static_assert (sizeof (boxhead_t) == MP4TAG_BOXHEAD_SZ, "boxhead_t size");
+static_assert (sizeof (boxmdhd4_t) == 24, "boxmdhd4_t size");
+static_assert (sizeof (boxmdhd8pack_t) == 36, "boxmdhd8pack_t size");
+
+static void mp4tag_walk (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk);
+static void mp4tag_walk_resume (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk);
+static int mp4tag_walk_head (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk, boxdata_t *bd);
+static void mp4tag_walk_done (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk, boxdata_t *bd);
+static void mp4tag_walk_pop (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk);
+static const mp4tagboxtype_t * mp4tag_box_type (uint32_t fourcc);
+static const char * mp4tag_box_name (boxdata_t *bd);
+static int mp4tag_parse_enter (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk, boxdata_t *bd);
+static void mp4tag_parse_offset (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk, boxdata_t *bd);
+static void mp4tag_parse_leave (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk, boxdata_t *bd);
+static void mp4tag_parse_finish (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk);
+static int mp4tag_probe_enter (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk, boxdata_t *bd);
+static void mp4tag_probe_leave (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk, boxdata_t *bd);
 static void mp4tag_process_mdhd (libmp4tag_t *libmp4tag, const char *data);
+static void mp4tag_process_mvhd (libmp4tag_t *libmp4tag, const char *data);
+static void mp4tag_decode_mdhd (const char *data, boxmdhd8_t *mdhd8);
 static void mp4tag_process_tag (libmp4tag_t *libmp4tag, const char *tag, uint32_t blen, const char *data);
+static void mp4tag_process_item (libmp4tag_t *libmp4tag, char *tnm, uint32_t type, uint32_t tlen, const char *p);
 static void mp4tag_process_covr (libmp4tag_t *libmp4tag, const char *tag, uint32_t blen, const char *data);
+static int mp4tag_process_lazy (libmp4tag_t *libmp4tag, const char *tag, uint64_t blen);
+static void mp4tag_add_lazy (libmp4tag_t *libmp4tag, const char *tag, int64_t offset, uint32_t len, uint32_t type, const char *covername);
+static void mp4tag_add_cotable (libmp4tag_t *libmp4tag, int64_t offset, uint32_t len, int offsetsz);
 static void mp4tag_process_data (const char *p, uint32_t *tlen, uint32_t *flags);
 static void mp4tag_parse_check_end (libmp4tag_t *libmp4tag);
+static int mp4tag_view_load (libmp4tag_t *libmp4tag, uint64_t len);
+static void mp4tag_view_size (const char *data, uint64_t len, size_t *poolsz, int *count);
+static size_t mp4tag_view_avail (libmp4tag_t *libmp4tag);
 static int mp4tag_data_seek (libmp4tag_t *libmp4tag, int64_t skiplen);
 static int mp4tag_data_read (libmp4tag_t *libmp4tag, void *buff, size_t sz);
+static int mp4tag_data_ref (libmp4tag_t *libmp4tag, const char **dptr, size_t sz);
+static size_t mp4tag_stream_read (libmp4tag_t *libmp4tag, char *buff, size_t sz);
+static size_t mp4tag_file_read (libmp4tag_t *libmp4tag, char *buff, size_t sz);
 static time_t mp4tag_get_time (void);
 /* debugging */
 static void mp4tag_dump_co (libmp4tag_t *libmp4tag, const char *ident, size_t len, const char *data);
+static void mp4tag_dump_co_file (libmp4tag_t *libmp4tag, const char *ident, size_t len);
 static void mp4tag_dump_data (libmp4tag_t *libmp4tag, int64_t offset);
 
-/* uses a recursive descent method */
+/* the box tree is traversed by mp4tag_walk using a stack of box frames. */
+/* the parser and the probe supply the callbacks that decide */
+/* which boxes are descended into and which are processed. */
 int
-mp4tag_parse_file (libmp4tag_t *libmp4tag, uint32_t boxlen, int level)
+mp4tag_parse_file (libmp4tag_t *libmp4tag)
 {
-  boxhead_t       bh;
-  boxdata_t       bd;
-  size_t          rrc;          /* read return-code */
-  uint32_t        skiplen;
-  uint32_t        boxheadsz;
-  bool            needdata = false;
-  bool            descend = false;
-
-  if (! assertchecked) {
-    assert (sizeof (boxhead_t) == 8);
-    assert (sizeof (boxhead_t) == MP4TAG_BOXHEAD_SZ);
-    assert (sizeof (boxmdhd4_t) == 24);
-    assert (sizeof (boxmdhd8pack_t) == 36);
-    assertchecked = true;
-  }
-
-  if (level >= MP4TAG_LEVEL_MAX) {
-    libmp4tag->mp4error = MP4TAG_ERR_UNABLE_TO_PROCESS;
-    return libmp4tag->mp4error;
-  }
+  mp4tagwalk_t    walk;
 
   if (libmp4tag->parsedone) {
     return libmp4tag->mp4error;
   }
 
-  libmp4tag->rem_length [level] = boxlen;
-  /* subtract the box's header size, as it is not included */
-  /* within the container's contents */
-  libmp4tag->rem_length [level] -= MP4TAG_BOXHEAD_SZ;
-
-  rrc = mp4tag_data_read (libmp4tag, &bh, MP4TAG_BOXHEAD_SZ);
-
-  while (rrc == MP4TAG_READ_OK) {
-    boxheadsz = MP4TAG_BOXHEAD_SZ;
-
-    /* the box-length includes the length and the identifier */
-    bd.boxlen = be32toh (bh.len);
-
-    if (bd.boxlen == 0) {
-      /* indicates that the 'mdat' box continues to the end of the file */
-      libmp4tag->parsedone = true;
-      break;
-    }
-
-    if (bd.boxlen == 1) {
-      uint64_t    t64 = 0;
-
-      rrc = mp4tag_data_read (libmp4tag, &t64, sizeof (uint64_t));
-      if (rrc != MP4TAG_READ_OK) {
-        break;
-      }
-
-      bd.boxlen = be64toh (t64);
-      boxheadsz += sizeof (uint64_t);
-    }
-
-    bd.len = bd.boxlen - boxheadsz;
-    if (boxlen == 0) {
-      libmp4tag->rem_length [level] = bd.boxlen;
-    }
-
-    /* save the name of the box */
-    if (*bh.nm == '\xa9') {
-      /* maximum 5 bytes */
-      strcpy (bd.nm, COPYRIGHT_STR);
-      memcpy (bd.nm + strlen (COPYRIGHT_STR), bh.nm + 1, MP4TAG_ID_LEN - 1);
-      bd.nm [MP4TAG_ID_LEN + strlen (COPYRIGHT_STR) - 1] = '\0';
-    } else {
-      memcpy (bd.nm, bh.nm, MP4TAG_ID_LEN);
-      bd.nm [MP4TAG_ID_LEN] = '\0';
-    }
-
-    bd.data = NULL;
-    bd.dlen = 0;
-    skiplen = bd.len;
-    needdata = false;
-
-    if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_PRINT_FILE_STRUCTURE)) {
-      fprintf (stdout, "%*s %2d %.5s: %" PRId64 " %" PRId64 " rem: %" PRId64 "\n",
-          level*2, " ", level, bd.nm, bd.boxlen, bd.len,
-          libmp4tag->rem_length [level]);
-    }
-
-    descend = false;
-
-    /* hierarchies used: */
-    /*   moov.trak.mdia.mdhd  (has duration) */
-    /*   moov.trak.mdia.minf.stbl.stco  (offset table to update) */
-    /*   moov.trak.mdia.minf.stbl.co64  (offset table to update) */
-    /*   moov.udta.meta.ilst.*  (tags) */
-    if (strcmp (bd.nm, boxids [MP4TAG_MOOV]) == 0 ||
-        strcmp (bd.nm, boxids [MP4TAG_TRAK]) == 0 ||
-        strcmp (bd.nm, boxids [MP4TAG_UDTA]) == 0 ||
-        strcmp (bd.nm, boxids [MP4TAG_MDIA]) == 0 ||
-        strcmp (bd.nm, boxids [MP4TAG_STBL]) == 0 ||
-        strcmp (bd.nm, boxids [MP4TAG_MINF]) == 0 ||
-        strcmp (bd.nm, boxids [MP4TAG_ILST]) == 0) {
-      /* want to descend into this hierarchy */
-      /* container only, don't need to skip over any data */
-      descend = true;
-      skiplen = 0;
-    }
-    if (strcmp (bd.nm, boxids [MP4TAG_META]) == 0) {
-      /* want to descend into this hierarchy */
-      /* skip the 4 bytes of flags */
-      skiplen = MP4TAG_META_SZ - MP4TAG_BOXHEAD_SZ;
-      libmp4tag->insert_delta += MP4TAG_META_SZ;
-      descend = true;
-    }
-
-    /* save off any offsets before any processing is done */
-
-    if (strcmp (bd.nm, boxids [MP4TAG_UDTA]) == 0) {
-      /* need to save this offset in case there is no 'ilst' box */
-      libmp4tag->noilst_offset = libmp4tag->offset - MP4TAG_BOXHEAD_SZ;
-      libmp4tag->after_ilst_offset =
-          libmp4tag->noilst_offset + MP4TAG_BOXHEAD_SZ;
-      libmp4tag->insert_delta = MP4TAG_BOXHEAD_SZ;
-    }
-
-    if (strcmp (bd.nm, boxids [MP4TAG_ILST]) == 0) {
-      libmp4tag->parentidx = level - 1;
-      libmp4tag->taglist_offset = libmp4tag->offset;
-      libmp4tag->taglist_base_offset =
-          libmp4tag->taglist_offset - MP4TAG_BOXHEAD_SZ;
-      /* do not include the ident-len and ident lengths */
-      libmp4tag->taglist_orig_len = bd.len;
-      libmp4tag->taglist_len = bd.len;
-      libmp4tag->after_ilst_offset =
-          libmp4tag->taglist_offset + libmp4tag->taglist_len;
-
-      libmp4tag->processdata = true;
-      if (bd.len == 0) {
-        /* there are no tags */
-        libmp4tag->processdata = false;
-        if (libmp4tag->canwrite) {
-          libmp4tag->checkforfree = true;
-        }
-      }
-    }
-
-    if (strcmp (bd.nm, boxids [MP4TAG_STCO]) == 0) {
-      libmp4tag->stco_offset = libmp4tag->offset;
-      libmp4tag->stco_len = bd.len;
-      if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_DUMP_CO)) {
-        needdata = true;
-      }
-    }
-
-    if (strcmp (bd.nm, boxids [MP4TAG_CO64]) == 0) {
-      libmp4tag->co64_offset = libmp4tag->offset;
-      libmp4tag->co64_len = bd.len;
-      if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_DUMP_CO)) {
-        needdata = true;
-      }
-    }
-
-    if (libmp4tag->checkforfree) {
-      if (libmp4tag->taglist_orig_data_len == 0) {
-        libmp4tag->taglist_orig_data_len = libmp4tag->taglist_len;
-      }
-      /* note that this will also locate free boxes */
-      /* trailing the 'moov' box */
-      /* all free space is consolidated */
-      if (strcmp (bd.nm, boxids [MP4TAG_FREE]) == 0) {
-        if (level == 0) {
-          libmp4tag->exterior_free_len += bd.boxlen;
-        } else {
-          libmp4tag->interior_free_len += bd.boxlen;
-        }
-        libmp4tag->taglist_len += bd.boxlen;
-        libmp4tag->after_ilst_offset += bd.boxlen;
-        /* continue on and see if there are more 'free' boxes to add */
-      } else {
-        /* if this spot was reached, there is some other */
-        /* box after the 'ilst' or 'free' boxes */
-        /* set check-for-free to false so that the unlimited flag */
-        /* will not be set, and so that any future free space is */
-        /* not added in to the available space */
-        libmp4tag->checkforfree = false;
-        if (! mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_PRINT_FILE_STRUCTURE)) {
-          libmp4tag->parsedone = true;
-          break;
-        }
-      }
-    }
-
-    if (descend && bd.len > 0) {
-      /* only want to update the base-offsets if the 'ilst' */
-      /* has not been found */
-      if (level < MP4TAG_LEVEL_MAX &&
-          libmp4tag->taglist_offset == 0) {
-        ssize_t      offset;
-
-        offset = libmp4tag->offset;
+  walk.enter = mp4tag_parse_enter;
+  walk.leave = mp4tag_parse_leave;
+  walk.finish = mp4tag_parse_finish;
+  walk.flags = MP4TAG_WALK_NONE;
+  mp4tag_walk (libmp4tag, &walk);
 
-        libmp4tag->base_lengths [level] = bd.boxlen;
-        snprintf (libmp4tag->base_name [level], sizeof (libmp4tag->base_name [level]),
-            "%s", bd.nm);
-        libmp4tag->base_offsets [level] = offset - MP4TAG_BOXHEAD_SZ;
-        if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_OTHER)) {
-          fprintf (stdout, "%*s %2d store base %s len:%" PRIu64 " offset:%08" PRIx64 "\n",
-              level*2, " ", level, bd.nm, bd.len + MP4TAG_BOXHEAD_SZ, (int64_t) libmp4tag->base_offsets [level]);
-        }
-        libmp4tag->base_offset_count = level + 1;
-      }
-
-      if (skiplen > 0) {
-        mp4tag_data_seek (libmp4tag, skiplen);
-      }
+  return libmp4tag->mp4error;
+}
 
-      mp4tag_parse_file (libmp4tag, bd.boxlen - skiplen, level + 1);
-      /* when descending, the box's data has already been skipped or read */
-      skiplen = 0;
-    }
+/* only descends into the 'mdhd' boxes, all other boxes are skipped. */
+/* every track is checked, so that the duration is the same as */
+/* that found by mp4tag_parse_file. */
+/* sets parsedone at the end of the 'moov' box, */
+/* or if no further processing is possible. */
+int
+mp4tag_probe_file (libmp4tag_t *libmp4tag)
+{
+  mp4tagwalk_t    walk;
 
-    if (libmp4tag->taglist_orig_data_len == 0) {
-      libmp4tag->taglist_orig_data_len = libmp4tag->taglist_len;
-    }
+  walk.enter = mp4tag_probe_enter;
+  walk.leave = mp4tag_probe_leave;
+  walk.finish = NULL;
+  /* the box lengths are not trusted */
+  walk.flags = MP4TAG_WALK_CHECK_LEN;
+  mp4tag_walk (libmp4tag, &walk);
 
-    /* if descended into the hierarchy, now done */
+  return libmp4tag->mp4error;
+}
 
-    if (strcmp (bd.nm, boxids [MP4TAG_MOOV]) == 0 &&
-        libmp4tag->noilst_offset == 0) {
-      libmp4tag->noilst_offset = libmp4tag->offset;
-      libmp4tag->after_ilst_offset = libmp4tag->noilst_offset;
-    }
+/* the parse is resumed each time more data is fed. */
+/* returns MP4TAG_NEED_DATA or MP4TAG_NEED_SKIP while the parse */
+/* is waiting for more data. */
+int
+mp4tag_feed_file (libmp4tag_t *libmp4tag)
+{
+  mp4tagwalk_t    *walk;
+  int64_t         used;
+  int             rc;
 
-    /* out of 'ilst', do not process more tags */
-    /* only need to check for any 'free' boxes trailing the 'ilst'.*/
-    if (strcmp (bd.nm, boxids [MP4TAG_ILST]) == 0) {
-      libmp4tag->processdata = false;
-      if (libmp4tag->canwrite) {
-        libmp4tag->checkforfree = true;    // not quite done yet
-      }
-    }
+  libmp4tag->feedneed = false;
 
-    /* the 'needdata' flag indicates that the data in the box needs */
-    /* to be read and will be processed */
-    if (strcmp (bd.nm, boxids [MP4TAG_MDHD]) == 0) {
-      needdata = true;
+  if (! libmp4tag->feedftyp) {
+    rc = mp4tag_parse_ftyp (libmp4tag);
+    if (libmp4tag->feedneed) {
+      libmp4tag->offset = 0;
+      return MP4TAG_NEED_DATA;
     }
-    if (libmp4tag->processdata) {
-      needdata = true;
+    if (rc != MP4TAG_OK) {
+      libmp4tag->mp4error = rc;
+      return rc;
     }
+    libmp4tag->feedftyp = true;
+  }
 
-    if (needdata && bd.len > 0) {
-      bd.data = malloc (bd.len);
-      if (bd.data == NULL) {
-        libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
-        return libmp4tag->mp4error;
-      }
-      rrc = mp4tag_data_read (libmp4tag, bd.data, bd.len);
-      if (rrc != MP4TAG_READ_OK) {
-        free (bd.data);
-        bd.data = NULL;
-        break;
-      }
-    }
-    if (! needdata && skiplen > 0) {
-      rrc = mp4tag_data_seek (libmp4tag, skiplen);
-      if (rrc != MP4TAG_READ_OK) {
-        free (bd.data);
-        bd.data = NULL;
-        break;
-      }
-    }
-
-    if (needdata && bd.data != NULL && bd.len > 0) {
-      if (! libmp4tag->isstream &&
-          mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_DUMP_CO) &&
-          (strcmp (bd.nm, boxids [MP4TAG_STCO]) == 0 ||
-          strcmp (bd.nm, boxids [MP4TAG_CO64]) == 0)) {
-        /* debugging */
-        mp4tag_dump_co (libmp4tag, bd.nm, bd.len, bd.data);
-      }
-      if (strcmp (bd.nm, boxids [MP4TAG_MDHD]) == 0) {
-        mp4tag_process_mdhd (libmp4tag, bd.data);
-      }
-      if (libmp4tag->processdata) {
-        if (strcmp (bd.nm, boxids [MP4TAG_COVR]) == 0) {
-          mp4tag_process_covr (libmp4tag, bd.nm, bd.len, bd.data);
-        } else {
-          mp4tag_process_tag (libmp4tag, bd.nm, bd.len, bd.data);
-        }
-      }
-      free (bd.data);
-      bd.data = NULL;
-    }
-
-    libmp4tag->rem_length [level] -= bd.boxlen;
-    if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_PRINT_FILE_STRUCTURE)) {
-      fprintf (stdout, "%*s    %.5s: end: rem: %" PRId64 "\n",
-          level*2, " ", bd.nm, libmp4tag->rem_length [level]);
-      fflush (stdout);
-    }
-
-    /* check for version 1.3.0 bug */
-    if (strcmp (bd.nm, boxids [MP4TAG_ILST]) == 0) {
-      libmp4tag->ilst_remaining = libmp4tag->rem_length [level];
-      libmp4tag->ilstend = true;
-      /* reached the end of the 'ilst' box and there is data remaining */
-      /* to be processed. */
-      /* if the 'ilst' box is not processed in the normal exit below, */
-      /* this is a probable indicator that the 1.3.0 bug is present */
-      if (libmp4tag->ilst_remaining > 0) {
-        libmp4tag->ilstremain = true;
-        if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_BUG)) {
-          fprintf (stdout, "ilst-rem %" PRIu64 "\n", libmp4tag->ilst_remaining);
-        }
-      }
-    }
-
-    if (libmp4tag->rem_length [level] <= 0 && boxlen != 0) {
-      /* this is the normal exit when done with a level */
-
-      /* checks for version 1.3.0 bug */
-      if (strcmp (bd.nm, boxids [MP4TAG_ILST]) == 0) {
-        libmp4tag->ilstdone = true;
-        if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_BUG)) {
-          fprintf (stdout, "ilst-done\n");
-        }
-      }
-      if (strcmp (bd.nm, boxids [MP4TAG_FREE]) == 0) {
-        /* only applies to first free box immediately after an 'ilst' */
-        /* if the 'ilst' box finishes properly, there is no bug */
-        if (libmp4tag->ilstend &&
-            ! libmp4tag->ilstdone &&
-            libmp4tag->rem_length [level] < 0) {
-          libmp4tag->freeneg = true;
-          if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_BUG)) {
-            fprintf (stdout, "free-neg\n");
-          }
-        }
-      }
-      if (strcmp (bd.nm, boxids [MP4TAG_UDTA]) == 0) {
-        if (libmp4tag->rem_length [level] == 0) {
-          libmp4tag->udtazero = true;
-          if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_BUG)) {
-            fprintf (stdout, "udta-zero\n");
-          }
-        }
-
-        /* if ilstdone is true, then 'ilst' was properly processed */
-        if (libmp4tag->ilstremain &&
-            ! libmp4tag->ilstdone &&
-            libmp4tag->freeneg &&
-            libmp4tag->udtazero) {
-          libmp4tag->dofix = true;
-          if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_BUG)) {
-            fprintf (stdout, "do-fix\n");
-          }
-        }
-      }
-
-      libmp4tag->ilstend = false;
-
+  if (libmp4tag->feedwalk == NULL) {
+    walk = malloc (sizeof (mp4tagwalk_t));
+    if (walk == NULL) {
+      libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
       return libmp4tag->mp4error;
     }
-
-    rrc = mp4tag_data_read (libmp4tag, &bh, MP4TAG_BOXHEAD_SZ);
+    walk->enter = mp4tag_parse_enter;
+    walk->leave = mp4tag_parse_leave;
+    walk->finish = mp4tag_parse_finish;
+    walk->flags = MP4TAG_WALK_NONE;
+    walk->level = 0;
+    walk->frames [0].remlen = 0;
+    libmp4tag->feedwalk = walk;
   }
 
-  if (level == 0) {
-    if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_PRINT_FILE_STRUCTURE)) {
-      fprintf (stdout, "taglist-data-len: %d\n", libmp4tag->taglist_orig_data_len);
-      fprintf (stdout, "taglist-len: %d\n", libmp4tag->taglist_len);
-    }
+  mp4tag_walk_resume (libmp4tag, libmp4tag->feedwalk);
 
-    if (libmp4tag->checkforfree) {
-      /* if checkforfree is still true, check and see if the end of file */
-      /* was reached */
-      mp4tag_parse_check_end (libmp4tag);
+  if (libmp4tag->feedneed) {
+    /* the data before the current offset has been used */
+    used = libmp4tag->offset - libmp4tag->feedoffset;
+    if (used > (int64_t) libmp4tag->feedlen) {
+      /* the next data fed must start at the current offset */
+      libmp4tag->feedlen = 0;
+      libmp4tag->feedoffset = libmp4tag->offset;
+      return MP4TAG_NEED_SKIP;
     }
-
-    mp4tag_sort_tags (libmp4tag);
-
-    if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_PRINT_FILE_STRUCTURE)) {
-      fprintf (stdout, "interior-free: %d\n", libmp4tag->interior_free_len);
-      fprintf (stdout, "exterior-free: %d\n", libmp4tag->exterior_free_len);
-      fprintf (stdout, "ilst-remaining: %" PRId64 "\n", libmp4tag->ilst_remaining);
+    if (used > 0) {
+      libmp4tag->feedlen -= used;
+      memmove (libmp4tag->feedbuff, libmp4tag->feedbuff + used,
+          libmp4tag->feedlen);
+      libmp4tag->feedoffset = libmp4tag->offset;
     }
+    return MP4TAG_NEED_DATA;
   }
 
-  /* at this time, do not look for more free boxes after the 'udta' */
-  /* hierarchy.  processing gets messy.  and i don't have a sample */
-  if (libmp4tag->checkforfree) {
-    libmp4tag->checkforfree = false;
-    libmp4tag->parsedone = true;
-  }
+  free (libmp4tag->feedwalk);
+  libmp4tag->feedwalk = NULL;
 
   return libmp4tag->mp4error;
 }
@@ -489,12 +273,17 @@ mp4tag_parse_ftyp (libmp4tag_t *libmp4tag)
 
   rrc = mp4tag_data_read (libmp4tag, &bh, MP4TAG_BOXHEAD_SZ);
   if (rrc != MP4TAG_READ_OK) {
+    /* too short to have an 'ftyp' box */
+    if (libmp4tag->mp4error == MP4TAG_OK) {
+      return MP4TAG_ERR_NOT_MP4;
+    }
     return libmp4tag->mp4error;
   }
 
   /* the total length includes the length and the identifier */
   len = be32toh (bh.len) - MP4TAG_BOXHEAD_SZ;
-  if (memcmp (bh.nm, boxids [MP4TAG_FTYP], MP4TAG_ID_LEN) != 0) {
+  if (memcmp (bh.nm, boxids [MP4TAG_FTYP], MP4TAG_ID_LEN) != 0 ||
+      be32toh (bh.len) < MP4TAG_BOXHEAD_SZ) {
     libmp4tag->mp4error = MP4TAG_ERR_NOT_MP4;
     return libmp4tag->mp4error;
   }
@@ -507,6 +296,10 @@ mp4tag_parse_ftyp (libmp4tag_t *libmp4tag)
   }
   rrc = mp4tag_data_read (libmp4tag, buff, len);
   if (rrc != MP4TAG_READ_OK) {
+    free (buff);
+    if (libmp4tag->mp4error == MP4TAG_OK) {
+      return MP4TAG_ERR_NOT_MP4;
+    }
     return libmp4tag->mp4error;
   }
 
@@ -583,13 +376,794 @@ mp4tag_parse_ftyp (libmp4tag_t *libmp4tag)
   return ok >= 3 ? MP4TAG_OK : MP4TAG_ERR_NOT_MP4;
 }
 
+/* walks the box tree, starting at the current position. */
+/* the enter callback is called after each box header is read, */
+/* and returns whether to descend into the box, skip the remainder */
+/* of the box, or stop. */
+/* the leave callback is called once the box (and its contents) */
+/* are done, and the remaining length of the level has been updated. */
+/* the finish callback is called when a level ends before its */
+/* contents are used up (end of data, or the walk was stopped). */
+/* the top level has no container, and ends at the end of the data. */
+/* the walk stops when parsedone is set. */
+static void
+mp4tag_walk (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk)
+{
+  walk->level = 0;
+  walk->frames [0].remlen = 0;
+  mp4tag_walk_resume (libmp4tag, walk);
+}
+
+/* with mp4tag_feed, the walk is suspended when the data for a box */
+/* has not arrived yet, and that box is started over when the walk */
+/* is resumed */
+static void
+mp4tag_walk_resume (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk)
+{
+  mp4tagframe_t   *frame;
+  boxdata_t       bd;
+  int64_t         offset;
+  int             action = MP4TAG_WALK_SKIP;
+  int             rrc;
+  bool            ended;
+
+  /* checked once, rather than for every box */
+  walk->flags &= ~MP4TAG_WALK_TRACE;
+  if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_PRINT_FILE_STRUCTURE)) {
+    walk->flags |= MP4TAG_WALK_TRACE;
+  }
+
+  while (walk->level >= 0) {
+    frame = &walk->frames [walk->level];
+
+    if ((walk->flags & MP4TAG_WALK_CHECK_LEN) == MP4TAG_WALK_CHECK_LEN &&
+        walk->level > 0 &&
+        frame->remlen > 0 &&
+        frame->remlen < MP4TAG_BOXHEAD_SZ &&
+        ! libmp4tag->parsedone) {
+      /* skip any trailing bytes in the container */
+      if (mp4tag_data_seek (libmp4tag, frame->remlen) == MP4TAG_READ_OK) {
+        frame->remlen = 0;
+      } else {
+        libmp4tag->parsedone = true;
+      }
+    }
+
+    if (walk->level > 0 && frame->remlen <= 0) {
+      /* this is the normal exit when done with a level */
+      mp4tag_walk_pop (libmp4tag, walk);
+      continue;
+    }
+
+    ended = true;
+    offset = libmp4tag->offset;
+    if (! libmp4tag->parsedone) {
+      rrc = mp4tag_walk_head (libmp4tag, walk, &bd);
+      ended = rrc != MP4TAG_READ_OK;
+    }
+
+    if (! ended) {
+      action = walk->enter (libmp4tag, walk, &bd);
+      if (action == MP4TAG_WALK_STOP) {
+        libmp4tag->parsedone = true;
+        ended = true;
+      }
+    }
+
+    if (libmp4tag->feedneed) {
+      /* any processing of the box before the data ran out */
+      /* is done again */
+      libmp4tag->offset = offset;
+      libmp4tag->parsedone = false;
+      return;
+    }
+
+    if (! ended && action == MP4TAG_WALK_DESCEND && bd.len > bd.used) {
+      if (walk->level + 1 >= MP4TAG_LEVEL_MAX) {
+        libmp4tag->mp4error = MP4TAG_ERR_UNABLE_TO_PROCESS;
+        libmp4tag->parsedone = true;
+        ended = true;
+      } else {
+        walk->level += 1;
+        walk->frames [walk->level].bd = bd;
+        walk->frames [walk->level].remlen = bd.len - bd.used;
+        continue;
+      }
+    }
+
+    if (! ended && bd.len > bd.used) {
+      rrc = mp4tag_data_seek (libmp4tag, bd.len - bd.used);
+      ended = rrc != MP4TAG_READ_OK;
+    }
+
+    if (! ended) {
+      mp4tag_walk_done (libmp4tag, walk, &bd);
+      continue;
+    }
+
+    /* the level ended before its contents were used up */
+    if (walk->finish != NULL) {
+      walk->finish (libmp4tag, walk);
+    }
+    if (walk->level == 0) {
+      break;
+    }
+    mp4tag_walk_pop (libmp4tag, walk);
+  }
+}
+
+/* reads the box header, and fills in the box data */
+static int
+mp4tag_walk_head (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk, boxdata_t *bd)
+{
+  boxhead_t             bh;
+  mp4tagframe_t         *frame;
+  const mp4tagboxtype_t *boxtype;
+  uint32_t              boxheadsz;
+  uint32_t              t32;
+  int                   rrc;
+
+  frame = &walk->frames [walk->level];
+
+  rrc = mp4tag_data_read (libmp4tag, &bh, MP4TAG_BOXHEAD_SZ);
+  if (rrc != MP4TAG_READ_OK) {
+    return rrc;
+  }
+
+  boxheadsz = MP4TAG_BOXHEAD_SZ;
+
+  /* the box-length includes the length and the identifier */
+  bd->boxlen = be32toh (bh.len);
+
+  if (bd->boxlen == 0) {
+    /* indicates that the 'mdat' box continues to the end of the file */
+    libmp4tag->parsedone = true;
+    return MP4TAG_READ_NONE;
+  }
+
+  if (bd->boxlen == 1) {
+    uint64_t    t64 = 0;
+
+    rrc = mp4tag_data_read (libmp4tag, &t64, sizeof (uint64_t));
+    if (rrc != MP4TAG_READ_OK) {
+      return rrc;
+    }
+
+    bd->boxlen = be64toh (t64);
+    boxheadsz += sizeof (uint64_t);
+  }
+
+  if (bd->boxlen < boxheadsz ||
+      ((walk->flags & MP4TAG_WALK_CHECK_LEN) == MP4TAG_WALK_CHECK_LEN &&
+      walk->level > 0 &&
+      bd->boxlen > (uint64_t) frame->remlen)) {
+    /* not valid, no further processing is possible */
+    libmp4tag->parsedone = true;
+    return MP4TAG_READ_NONE;
+  }
+
+  bd->len = bd->boxlen - boxheadsz;
+  if (walk->level == 0) {
+    frame->remlen = bd->boxlen;
+  }
+
+  memcpy (&t32, bh.nm, sizeof (t32));
+  bd->fourcc = be32toh (t32);
+  boxtype = mp4tag_box_type (bd->fourcc);
+  bd->boxid = MP4TAG_NOTFOUND;
+  bd->boxflags = MP4TAG_BOX_NONE;
+  if (boxtype != NULL) {
+    bd->boxid = boxtype->boxid;
+    bd->boxflags = boxtype->flags;
+  }
+  *bd->nm = '\0';
+
+  bd->data = NULL;
+  bd->dalloc = NULL;
+  bd->used = 0;
+
+  if ((walk->flags & MP4TAG_WALK_TRACE) == MP4TAG_WALK_TRACE) {
+    fprintf (stdout, "%*s %2d %.5s: %" PRId64 " %" PRId64 " rem: %" PRId64 "\n",
+        walk->level*2, " ", walk->level, mp4tag_box_name (bd), bd->boxlen, bd->len,
+        frame->remlen);
+  }
+
+  return MP4TAG_READ_OK;
+}
+
+/* the box, and any contents, are done */
+static void
+mp4tag_walk_done (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk, boxdata_t *bd)
+{
+  mp4tagframe_t   *frame;
+
+  frame = &walk->frames [walk->level];
+  frame->remlen -= bd->boxlen;
+  if ((walk->flags & MP4TAG_WALK_TRACE) == MP4TAG_WALK_TRACE) {
+    fprintf (stdout, "%*s    %.5s: end: rem: %" PRId64 "\n",
+        walk->level*2, " ", mp4tag_box_name (bd), frame->remlen);
+    fflush (stdout);
+  }
+
+  if (walk->leave != NULL) {
+    walk->leave (libmp4tag, walk, bd);
+  }
+}
+
+/* returns to the container's level, the container is done */
+static void
+mp4tag_walk_pop (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk)
+{
+  boxdata_t   bd;
+
+  bd = walk->frames [walk->level].bd;
+  walk->level -= 1;
+  mp4tag_walk_done (libmp4tag, walk, &bd);
+}
+
+/* the box types are located using a binary search on the fourcc. */
+/* returns null if the box type is not used by the parser */
+static const mp4tagboxtype_t *
+mp4tag_box_type (uint32_t fourcc)
+{
+  int     lo = 0;
+  int     hi = mp4tagboxtypeslen - 1;
+  int     mid;
+
+  while (lo <= hi) {
+    mid = (lo + hi) / 2;
+    if (mp4tagboxtypes [mid].fourcc == fourcc) {
+      return &mp4tagboxtypes [mid];
+    }
+    if (mp4tagboxtypes [mid].fourcc < fourcc) {
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  return NULL;
+}
+
+/* the name of the box, with the copyright symbol as utf-8 */
+static const char *
+mp4tag_box_name (boxdata_t *bd)
+{
+  uint32_t    t32;
+  char        tnm [MP4TAG_ID_LEN];
+
+  if (*bd->nm != '\0') {
+    return bd->nm;
+  }
+
+  t32 = htobe32 (bd->fourcc);
+  memcpy (tnm, &t32, MP4TAG_ID_LEN);
+  if (*tnm == '\xa9') {
+    /* maximum 5 bytes */
+    strcpy (bd->nm, COPYRIGHT_STR);
+    memcpy (bd->nm + strlen (COPYRIGHT_STR), tnm + 1, MP4TAG_ID_LEN - 1);
+    bd->nm [MP4TAG_ID_LEN + strlen (COPYRIGHT_STR) - 1] = '\0';
+  } else {
+    memcpy (bd->nm, tnm, MP4TAG_ID_LEN);
+    bd->nm [MP4TAG_ID_LEN] = '\0';
+  }
+
+  return bd->nm;
+}
+
+static int
+mp4tag_parse_enter (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk,
+    boxdata_t *bd)
+{
+  int         level = walk->level;
+  int         boxflags = bd->boxflags;
+  uint32_t    skiplen = 0;
+  bool        needdata = false;
+  bool        descend = false;
+  bool        skiptag = false;
+  int         rrc;
+  char        sbuff [MP4TAG_BOX_BUFF_SZ];
+
+  /* most boxes are not used, and are skipped */
+  if (boxflags == MP4TAG_BOX_NONE &&
+      ! libmp4tag->processdata &&
+      ! libmp4tag->checkforfree &&
+      ! libmp4tag->cotablescan) {
+    return MP4TAG_WALK_SKIP;
+  }
+
+  /* hierarchies used: */
+  /*   moov.mvhd  (has duration, read-only) */
+  /*   moov.trak.mdia.mdhd  (has duration) */
+  /*   moov.trak.mdia.minf.stbl.stco  (offset table to update) */
+  /*   moov.trak.mdia.minf.stbl.co64  (offset table to update) */
+  /*   moov.udta.meta.ilst.*  (tags) */
+  if ((boxflags & MP4TAG_BOX_DESCEND) == MP4TAG_BOX_DESCEND) {
+    /* want to descend into this hierarchy */
+    descend = true;
+  }
+  if (bd->boxid == MP4TAG_META) {
+    /* skip the 4 bytes of flags */
+    skiplen = MP4TAG_META_SZ - MP4TAG_BOXHEAD_SZ;
+    libmp4tag->insert_delta += MP4TAG_META_SZ;
+  }
+  /* a read-only handle never updates the offset tables, */
+  /* and the sample tables can be very large. */
+  /* if the 'mvhd' box had the duration, the tracks are not needed */
+  if (libmp4tag->readonly &&
+      (bd->boxid == MP4TAG_MINF ||
+      (bd->boxid == MP4TAG_TRAK && libmp4tag->duration > 0))) {
+    descend = false;
+  }
+
+  /* once the tags are done, only the chunk offset tables */
+  /* of any tracks that follow are needed */
+  if (libmp4tag->cotablescan) {
+    if (level == 0) {
+      return MP4TAG_WALK_STOP;
+    }
+    if (bd->boxid == MP4TAG_STCO) {
+      mp4tag_add_cotable (libmp4tag, libmp4tag->offset, bd->len, sizeof (uint32_t));
+    }
+    if (bd->boxid == MP4TAG_CO64) {
+      mp4tag_add_cotable (libmp4tag, libmp4tag->offset, bd->len, sizeof (uint64_t));
+    }
+    if ((bd->boxid == MP4TAG_STCO || bd->boxid == MP4TAG_CO64) &&
+        mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_DUMP_CO)) {
+      /* debugging */
+      mp4tag_dump_co_file (libmp4tag, mp4tag_box_name (bd), bd->len);
+    }
+    if ((boxflags & MP4TAG_BOX_TRACK) == MP4TAG_BOX_TRACK) {
+      return MP4TAG_WALK_DESCEND;
+    }
+    return MP4TAG_WALK_SKIP;
+  }
+
+  /* save off any offsets before any processing is done */
+  if ((boxflags & MP4TAG_BOX_OFFSET) == MP4TAG_BOX_OFFSET) {
+    mp4tag_parse_offset (libmp4tag, walk, bd);
+  }
+  if ((bd->boxid == MP4TAG_STCO || bd->boxid == MP4TAG_CO64) &&
+      mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_DUMP_CO)) {
+    needdata = true;
+  }
+
+  if (libmp4tag->checkforfree) {
+    if (libmp4tag->taglist_orig_data_len == 0) {
+      libmp4tag->taglist_orig_data_len = libmp4tag->taglist_len;
+    }
+    /* note that this will also locate free boxes */
+    /* trailing the 'moov' box */
+    /* all free space is consolidated */
+    if (bd->boxid == MP4TAG_FREE) {
+      if (level == 0) {
+        libmp4tag->exterior_free_len += bd->boxlen;
+      } else {
+        libmp4tag->interior_free_len += bd->boxlen;
+      }
+      libmp4tag->taglist_len += bd->boxlen;
+      libmp4tag->after_ilst_offset += bd->boxlen;
+      /* continue on and see if there are more 'free' boxes to add */
+    } else {
+      /* if this spot was reached, there is some other */
+      /* box after the 'ilst' or 'free' boxes */
+      /* set check-for-free to false so that the unlimited flag */
+      /* will not be set, and so that any future free space is */
+      /* not added in to the available space */
+      libmp4tag->checkforfree = false;
+      if (! mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_PRINT_FILE_STRUCTURE)) {
+        if (level == 0) {
+          return MP4TAG_WALK_STOP;
+        }
+        /* a track may follow the 'udta' box, and its */
+        /* chunk offset table must be updated when writing */
+        libmp4tag->cotablescan = true;
+        if (bd->boxid == MP4TAG_TRAK) {
+          return MP4TAG_WALK_DESCEND;
+        }
+        return MP4TAG_WALK_SKIP;
+      }
+    }
+  }
+
+  if (descend && bd->len > 0) {
+    /* only want to update the base-offsets if the 'ilst' */
+    /* has not been found */
+    if (libmp4tag->taglist_offset == 0) {
+      ssize_t      offset;
+
+      offset = libmp4tag->offset;
+
+      libmp4tag->base_lengths [level] = bd->boxlen;
+      snprintf (libmp4tag->base_name [level], sizeof (libmp4tag->base_name [level]),
+          "%s", mp4tag_box_name (bd));
+      libmp4tag->base_offsets [level] = offset - MP4TAG_BOXHEAD_SZ;
+      if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_OTHER)) {
+        fprintf (stdout, "%*s %2d store base %s len:%" PRIu64 " offset:%08" PRIx64 "\n",
+            level*2, " ", level, mp4tag_box_name (bd), bd->len + MP4TAG_BOXHEAD_SZ, (int64_t) libmp4tag->base_offsets [level]);
+      }
+      libmp4tag->base_offset_count = level + 1;
+    }
+
+    if (skiplen > 0) {
+      mp4tag_data_seek (libmp4tag, skiplen);
+      bd->used = skiplen;
+    }
+
+    /* with the ilst view, the entire 'ilst' box is read in, */
+    /* and the tags are processed from the view */
+    if (bd->boxid == MP4TAG_ILST &&
+        (libmp4tag->options & MP4TAG_OPTION_ILST_VIEW) ==
+        MP4TAG_OPTION_ILST_VIEW &&
+        libmp4tag->viewbuff == NULL) {
+      rrc = mp4tag_view_load (libmp4tag, bd->len);
+      if (rrc != MP4TAG_READ_OK) {
+        return MP4TAG_WALK_STOP;
+      }
+    }
+
+    return MP4TAG_WALK_DESCEND;
+  }
+
+  /* the 'needdata' flag indicates that the data in the box needs */
+  /* to be read and will be processed */
+  /* the movie header is only used by a read-only handle */
+  if ((boxflags & MP4TAG_BOX_DATA) == MP4TAG_BOX_DATA &&
+      (bd->boxid != MP4TAG_MVHD || libmp4tag->readonly)) {
+    needdata = true;
+  }
+  /* tags that are not in the tag filter are skipped */
+  skiptag = libmp4tag->processdata &&
+      ! mp4tag_filter_box (libmp4tag, mp4tag_box_name (bd));
+  if (libmp4tag->processdata && ! skiptag) {
+    needdata = true;
+  }
+
+  /* cover images and other large tags are not read in, */
+  /* the data is read from the file when it is needed. */
+  /* a stream cannot be re-read */
+  /* the data in the ilst view has already been read */
+  if (libmp4tag->processdata &&
+      ! skiptag &&
+      ! libmp4tag->isstream &&
+      mp4tag_view_avail (libmp4tag) < bd->len &&
+      bd->len > 0 &&
+      bd->boxid != MP4TAG_FREE &&
+      (bd->boxid == MP4TAG_COVR ||
+      bd->len >= MP4TAG_LAZY_SZ)) {
+    rrc = mp4tag_process_lazy (libmp4tag, mp4tag_box_name (bd), bd->len);
+    if (rrc != MP4TAG_READ_OK) {
+      return MP4TAG_WALK_STOP;
+    }
+    bd->used = bd->len;
+    return MP4TAG_WALK_SKIP;
+  }
+
+  if (! needdata || bd->len == 0) {
+    return MP4TAG_WALK_SKIP;
+  }
+
+  if (libmp4tag->mapdata != NULL ||
+      mp4tag_view_avail (libmp4tag) >= bd->len) {
+    /* the box data is processed directly from the mapped file */
+    /* or the ilst view */
+    rrc = mp4tag_data_ref (libmp4tag, &bd->data, bd->len);
+    if (rrc != MP4TAG_READ_OK) {
+      bd->data = NULL;
+      return MP4TAG_WALK_STOP;
+    }
+  } else {
+    char    *dbuff = sbuff;
+
+    /* most tags fit in the stack buffer */
+    if (bd->len > sizeof (sbuff)) {
+      bd->dalloc = malloc (bd->len);
+      if (bd->dalloc == NULL) {
+        libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+        return MP4TAG_WALK_STOP;
+      }
+      dbuff = bd->dalloc;
+    }
+    rrc = mp4tag_data_read (libmp4tag, dbuff, bd->len);
+    if (rrc != MP4TAG_READ_OK) {
+      if (bd->dalloc != NULL) {
+        free (bd->dalloc);
+        bd->dalloc = NULL;
+      }
+      return MP4TAG_WALK_STOP;
+    }
+    bd->data = dbuff;
+  }
+  bd->used = bd->len;
+
+  if (! libmp4tag->isstream &&
+      mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_DUMP_CO) &&
+      (bd->boxid == MP4TAG_STCO || bd->boxid == MP4TAG_CO64)) {
+    /* debugging */
+    mp4tag_dump_co (libmp4tag, mp4tag_box_name (bd), bd->len, bd->data);
+  }
+  if (bd->boxid == MP4TAG_MDHD) {
+    mp4tag_process_mdhd (libmp4tag, bd->data);
+  }
+  if (bd->boxid == MP4TAG_MVHD &&
+      bd->len >= sizeof (boxmdhd8pack_t)) {
+    mp4tag_process_mvhd (libmp4tag, bd->data);
+  }
+  if (libmp4tag->processdata) {
+    if (bd->boxid == MP4TAG_COVR) {
+      mp4tag_process_covr (libmp4tag, mp4tag_box_name (bd), bd->len, bd->data);
+    } else {
+      mp4tag_process_tag (libmp4tag, mp4tag_box_name (bd), bd->len, bd->data);
+    }
+  }
+  if (bd->dalloc != NULL) {
+    free (bd->dalloc);
+    bd->dalloc = NULL;
+  }
+  bd->data = NULL;
+
+  return MP4TAG_WALK_SKIP;
+}
+
+/* the locations of the boxes that are updated when writing */
+static void
+mp4tag_parse_offset (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk,
+    boxdata_t *bd)
+{
+  switch (bd->boxid) {
+    case MP4TAG_UDTA: {
+      /* need to save this offset in case there is no 'ilst' box */
+      libmp4tag->noilst_offset = libmp4tag->offset - MP4TAG_BOXHEAD_SZ;
+      libmp4tag->after_ilst_offset =
+          libmp4tag->noilst_offset + MP4TAG_BOXHEAD_SZ;
+      libmp4tag->insert_delta = MP4TAG_BOXHEAD_SZ;
+      break;
+    }
+    case MP4TAG_ILST: {
+      libmp4tag->parentidx = walk->level - 1;
+      libmp4tag->taglist_offset = libmp4tag->offset;
+      libmp4tag->taglist_base_offset =
+          libmp4tag->taglist_offset - MP4TAG_BOXHEAD_SZ;
+      /* do not include the ident-len and ident lengths */
+      libmp4tag->taglist_orig_len = bd->len;
+      libmp4tag->taglist_len = bd->len;
+      libmp4tag->after_ilst_offset =
+          libmp4tag->taglist_offset + libmp4tag->taglist_len;
+
+      libmp4tag->processdata = true;
+      if (bd->len == 0) {
+        /* there are no tags */
+        libmp4tag->processdata = false;
+        if (libmp4tag->canwrite) {
+          libmp4tag->checkforfree = true;
+        }
+      }
+      break;
+    }
+    /* every track has its own chunk offset table */
+    case MP4TAG_STCO: {
+      mp4tag_add_cotable (libmp4tag, libmp4tag->offset, bd->len, sizeof (uint32_t));
+      break;
+    }
+    case MP4TAG_CO64: {
+      mp4tag_add_cotable (libmp4tag, libmp4tag->offset, bd->len, sizeof (uint64_t));
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+}
+
+static void
+mp4tag_parse_leave (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk,
+    boxdata_t *bd)
+{
+  int         level = walk->level;
+  int64_t     remlen = walk->frames [level].remlen;
+
+  if (libmp4tag->taglist_orig_data_len == 0) {
+    libmp4tag->taglist_orig_data_len = libmp4tag->taglist_len;
+  }
+
+  /* if descended into the hierarchy, now done */
+
+  if (bd->boxid == MP4TAG_MOOV &&
+      libmp4tag->noilst_offset == 0) {
+    libmp4tag->noilst_offset = libmp4tag->offset;
+    libmp4tag->after_ilst_offset = libmp4tag->noilst_offset;
+  }
+
+  /* a stream is never written, and nothing after the 'moov' box */
+  /* is needed.  skipping the 'mdat' box could mean waiting for */
+  /* the remainder of the stream */
+  if (bd->boxid == MP4TAG_MOOV &&
+      libmp4tag->isstream &&
+      ! mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_PRINT_FILE_STRUCTURE)) {
+    libmp4tag->parsedone = true;
+  }
+
+  /* out of 'ilst', do not process more tags */
+  /* only need to check for any 'free' boxes trailing the 'ilst'.*/
+  if (bd->boxid == MP4TAG_ILST) {
+    libmp4tag->processdata = false;
+    if (libmp4tag->canwrite) {
+      libmp4tag->checkforfree = true;    // not quite done yet
+    }
+  }
+
+  /* check for version 1.3.0 bug */
+  if (bd->boxid == MP4TAG_ILST) {
+    libmp4tag->ilst_remaining = remlen;
+    libmp4tag->ilstend = true;
+    /* reached the end of the 'ilst' box and there is data remaining */
+    /* to be processed. */
+    /* if the 'ilst' box is not processed in the normal exit below, */
+    /* this is a probable indicator that the 1.3.0 bug is present */
+    if (libmp4tag->ilst_remaining > 0) {
+      libmp4tag->ilstremain = true;
+      if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_BUG)) {
+        fprintf (stdout, "ilst-rem %" PRIu64 "\n", libmp4tag->ilst_remaining);
+      }
+    }
+  }
+
+  if (remlen <= 0 && level > 0) {
+    /* this is the normal exit when done with a level */
+
+    /* checks for version 1.3.0 bug */
+    if (bd->boxid == MP4TAG_ILST) {
+      libmp4tag->ilstdone = true;
+      if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_BUG)) {
+        fprintf (stdout, "ilst-done\n");
+      }
+    }
+    if (bd->boxid == MP4TAG_FREE) {
+      /* only applies to first free box immediately after an 'ilst' */
+      /* if the 'ilst' box finishes properly, there is no bug */
+      if (libmp4tag->ilstend &&
+          ! libmp4tag->ilstdone &&
+          remlen < 0) {
+        libmp4tag->freeneg = true;
+        if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_BUG)) {
+          fprintf (stdout, "free-neg\n");
+        }
+      }
+    }
+    if (bd->boxid == MP4TAG_UDTA) {
+      if (remlen == 0) {
+        libmp4tag->udtazero = true;
+        if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_BUG)) {
+          fprintf (stdout, "udta-zero\n");
+        }
+      }
+
+      /* if ilstdone is true, then 'ilst' was properly processed */
+      if (libmp4tag->ilstremain &&
+          ! libmp4tag->ilstdone &&
+          libmp4tag->freeneg &&
+          libmp4tag->udtazero) {
+        libmp4tag->dofix = true;
+        if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_BUG)) {
+          fprintf (stdout, "do-fix\n");
+        }
+      }
+    }
+
+    libmp4tag->ilstend = false;
+  }
+}
+
+/* the level ended before the contents of the container were */
+/* used up, or the top level is done */
+static void
+mp4tag_parse_finish (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk)
+{
+  if (walk->level == 0) {
+    if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_PRINT_FILE_STRUCTURE)) {
+      fprintf (stdout, "taglist-data-len: %d\n", libmp4tag->taglist_orig_data_len);
+      fprintf (stdout, "taglist-len: %d\n", libmp4tag->taglist_len);
+    }
+
+    if (libmp4tag->checkforfree) {
+      /* if checkforfree is still true, check and see if the end of file */
+      /* was reached */
+      mp4tag_parse_check_end (libmp4tag);
+    }
+
+    mp4tag_sort_tags (libmp4tag);
+
+    if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_PRINT_FILE_STRUCTURE)) {
+      fprintf (stdout, "interior-free: %d\n", libmp4tag->interior_free_len);
+      fprintf (stdout, "exterior-free: %d\n", libmp4tag->exterior_free_len);
+      fprintf (stdout, "ilst-remaining: %" PRId64 "\n", libmp4tag->ilst_remaining);
+    }
+  }
+
+  /* at this time, do not look for more free boxes after the 'udta' */
+  /* hierarchy.  processing gets messy.  and i don't have a sample */
+  if (libmp4tag->checkforfree) {
+    libmp4tag->checkforfree = false;
+    libmp4tag->parsedone = true;
+  }
+}
+
+static int
+mp4tag_probe_enter (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk,
+    boxdata_t *bd)
+{
+  char        data [sizeof (boxmdhd8pack_t)];
+  size_t      dlen;
+  int         rrc;
+
+  /* moov.trak.mdia.mdhd */
+  if (bd->boxid == MP4TAG_MOOV ||
+      bd->boxid == MP4TAG_TRAK ||
+      bd->boxid == MP4TAG_MDIA) {
+    return MP4TAG_WALK_DESCEND;
+  }
+
+  if (bd->boxid == MP4TAG_MDHD) {
+    memset (data, '\0', sizeof (data));
+    dlen = bd->len < sizeof (data) ? bd->len : sizeof (data);
+    rrc = mp4tag_data_read (libmp4tag, data, dlen);
+    if (rrc != MP4TAG_READ_OK) {
+      return MP4TAG_WALK_STOP;
+    }
+    mp4tag_process_mdhd (libmp4tag, data);
+    bd->used = dlen;
+  }
+
+  return MP4TAG_WALK_SKIP;
+}
+
+static void
+mp4tag_probe_leave (libmp4tag_t *libmp4tag, mp4tagwalk_t *walk,
+    boxdata_t *bd)
+{
+  if (bd->boxid == MP4TAG_MOOV) {
+    /* the tracks have all been seen */
+    libmp4tag->parsedone = true;
+  }
+}
+
 static void
 mp4tag_process_mdhd (libmp4tag_t *libmp4tag, const char *data)
+{
+  boxmdhd8_t      mdhd8;
+
+  mp4tag_decode_mdhd (data, &mdhd8);
+  if (mdhd8.duration > 0) {
+    libmp4tag->creationdate = mdhd8.creationdate;
+    libmp4tag->modifieddate = mdhd8.modifieddate;
+    libmp4tag->samplerate = mdhd8.timescale;
+    libmp4tag->duration = (int64_t)
+        ((double) mdhd8.duration * 1000.0 / (double) mdhd8.timescale);
+  }
+}
+
+/* the start of the 'mvhd' box has the same layout as the 'mdhd' box. */
+/* the movie time-scale is not the sample rate. */
+static void
+mp4tag_process_mvhd (libmp4tag_t *libmp4tag, const char *data)
+{
+  boxmdhd8_t      mvhd8;
+
+  mp4tag_decode_mdhd (data, &mvhd8);
+  if (mvhd8.duration > 0 && mvhd8.timescale > 0) {
+    libmp4tag->creationdate = mvhd8.creationdate;
+    libmp4tag->modifieddate = mvhd8.modifieddate;
+    libmp4tag->duration = (int64_t)
+        ((double) mvhd8.duration * 1000.0 / (double) mvhd8.timescale);
+  }
+}
+
+static void
+mp4tag_decode_mdhd (const char *data, boxmdhd8_t *mdhd8)
 {
   boxmdhd_t       mdhd;
   boxmdhd4_t      mdhd4;
   boxmdhd8pack_t  mdhd8p;
-  boxmdhd8_t      mdhd8;
 
   memcpy (&mdhd, data, sizeof (boxmdhd_t));
   mdhd.flags = be32toh (mdhd.flags);
@@ -597,33 +1171,26 @@ mp4tag_process_mdhd (libmp4tag_t *libmp4tag, const char *data)
     /* version 0 is 32-bit */
     /* a packed version of mdhd4 is not necessary as all data is aligned */
     memcpy (&mdhd4, data, sizeof (boxmdhd4_t));
-    mdhd8.flags = be32toh (mdhd4.flags);
-    mdhd8.creationdate = be32toh (mdhd4.creationdate);
-    mdhd8.modifieddate = be32toh (mdhd4.modifieddate);
-    mdhd8.timescale = be32toh (mdhd4.timescale);
-    mdhd8.duration = be32toh (mdhd4.duration);
-    mdhd8.moreflags = be32toh (mdhd4.moreflags);
+    mdhd8->flags = be32toh (mdhd4.flags);
+    mdhd8->creationdate = be32toh (mdhd4.creationdate);
+    mdhd8->modifieddate = be32toh (mdhd4.modifieddate);
+    mdhd8->timescale = be32toh (mdhd4.timescale);
+    mdhd8->duration = be32toh (mdhd4.duration);
+    mdhd8->moreflags = be32toh (mdhd4.moreflags);
   } else {
     /* version 1 is 64-bit */
     memcpy (&mdhd8p, data, sizeof (boxmdhd8pack_t));
-    memcpy (&mdhd8.creationdate, &mdhd8p.creationdate, sizeof (mdhd8.creationdate));
-    memcpy (&mdhd8.modifieddate, &mdhd8p.modifieddate, sizeof (mdhd8.modifieddate));
-    memcpy (&mdhd8.duration, &mdhd8p.duration, sizeof (mdhd8.duration));
-    memcpy (&mdhd8.timescale, &mdhd8p.timescale, sizeof (mdhd8.timescale));
-    memcpy (&mdhd8.moreflags, &mdhd8p.moreflags, sizeof (mdhd8.moreflags));
-    mdhd8.flags = be32toh (mdhd8p.flags);
-    mdhd8.creationdate = be64toh (mdhd8.creationdate);
-    mdhd8.modifieddate = be64toh (mdhd8.modifieddate);
-    mdhd8.timescale = be32toh (mdhd8.timescale);
-    mdhd8.duration = be64toh (mdhd8.duration);
-    mdhd8.moreflags = be32toh (mdhd8.moreflags);
-  }
-  if (mdhd8.duration > 0) {
-    libmp4tag->creationdate = mdhd8.creationdate;
-    libmp4tag->modifieddate = mdhd8.modifieddate;
-    libmp4tag->samplerate = mdhd8.timescale;
-    libmp4tag->duration = (int64_t)
-        ((double) mdhd8.duration * 1000.0 / (double) mdhd8.timescale);
+    memcpy (&mdhd8->creationdate, &mdhd8p.creationdate, sizeof (mdhd8->creationdate));
+    memcpy (&mdhd8->modifieddate, &mdhd8p.modifieddate, sizeof (mdhd8->modifieddate));
+    memcpy (&mdhd8->duration, &mdhd8p.duration, sizeof (mdhd8->duration));
+    memcpy (&mdhd8->timescale, &mdhd8p.timescale, sizeof (mdhd8->timescale));
+    memcpy (&mdhd8->moreflags, &mdhd8p.moreflags, sizeof (mdhd8->moreflags));
+    mdhd8->flags = be32toh (mdhd8p.flags);
+    mdhd8->creationdate = be64toh (mdhd8->creationdate);
+    mdhd8->modifieddate = be64toh (mdhd8->modifieddate);
+    mdhd8->timescale = be32toh (mdhd8->timescale);
+    mdhd8->duration = be64toh (mdhd8->duration);
+    mdhd8->moreflags = be32toh (mdhd8->moreflags);
   }
 }
 
@@ -635,13 +1202,8 @@ mp4tag_process_tag (libmp4tag_t *libmp4tag, const char *tag,
   /* tnm must be large enough to hold any custom tag name */
   char        tnm [MP4TAG_ID_MAX];
   uint32_t    type;
-  uint8_t     t8;
-  uint16_t    t16;
-  uint32_t    t32;
-  uint64_t    t64;
   uint32_t    tlen;       /* length of data item */
   uint32_t    plen;       /* processed length */
-  char        tmp [40];
 
   p = data;
 
@@ -684,6 +1246,10 @@ mp4tag_process_tag (libmp4tag_t *libmp4tag, const char *tag,
     len += tlen;
     tnm [len] = '\0';
 
+    if (! mp4tag_filter_tag (libmp4tag, tnm)) {
+      return;
+    }
+
     /* reduce the max length by the data size, two more boxes, */
     /* and the length of the custom name */
     blen -= MP4TAG_DATA_SZ;
@@ -700,92 +1266,12 @@ mp4tag_process_tag (libmp4tag_t *libmp4tag, const char *tag,
 
   if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_OTHER)) {
     fprintf (stdout, "%s %03x tlen:%" PRId32 " blen:%" PRId32 "\n", tnm, type, tlen, blen);
-  }
-
-  do {
-    plen += tlen;
-
-    /* general data */
-    if (type == MP4TAG_ID_DATA ||
-        type == MP4TAG_ID_NUM) {
-
-      /* 'disk' and 'trkn' must be handle as special cases. */
-      /* they are marked as data (0x00). */
-      if (strcmp (tnm, boxids [MP4TAG_DISK]) == 0 ||
-          strcmp (tnm, boxids [MP4TAG_TRKN]) == 0) {
-        t16 = 0;
-
-        /* pair of 32 bit and 16 bit numbers */
-        /* trkn has an extra 2 bytes of padding */
-        memcpy (&t32, p, sizeof (uint32_t));
-        t32 = be32toh (t32);
-
-        /* apparently there exist track number boxes */
-        /* that are not the full size */
-        if (strcmp (tnm, boxids [MP4TAG_TRKN]) != 0 ||
-            tlen >= sizeof (uint32_t) + sizeof (uint16_t)) {
-          p += sizeof (uint32_t);
-          memcpy (&t16, p, sizeof (uint16_t));
-          t16 = be16toh (t16);
-        }
-
-        /* trkn has an additional two trailing bytes that are not used */
-
-        if (t16 == 0) {
-          snprintf (tmp, sizeof (tmp), "%" PRId32, t32);
-        } else {
-          snprintf (tmp, sizeof (tmp), "%" PRId32 "/%" PRId16, t32, t16);
-        }
-        mp4tag_add_tag (libmp4tag, tnm, tmp, MP4TAG_STRING, type, tlen, NULL);
-      } else if (tlen == sizeof (uint32_t)) {
-        memcpy (&t32, p, sizeof (uint32_t));
-        t32 = be32toh (t32);
-        snprintf (tmp, sizeof (tmp), "%" PRId32, t32);
-        mp4tag_add_tag (libmp4tag, tnm, tmp, MP4TAG_STRING, type, tlen, NULL);
-      } else if (tlen == sizeof (uint16_t)) {
-        memcpy (&t16, p, sizeof (uint16_t));
-        t16 = be16toh (t16);
-
-        /* the 'gnre' tag is converted to '©gen' */
-        /* hard-coded lists of genres are not good */
-        if (strcmp (tnm, boxids [MP4TAG_GNRE]) == 0) {
-          /* the itunes value is offset by 1 */
-          t16 -= 1;
-          if (t16 < mp4tagoldgenrelistsz) {
-            /* do not use the 'gnre' identifier */
-            strcpy (tnm, COPYRIGHT_STR);
-            strcat (tnm, boxids [MP4TAG_GEN]);
-            mp4tag_add_tag (libmp4tag, tnm, mp4tagoldgenrelist [t16],
-                MP4TAG_STRING, MP4TAG_ID_STRING,
-                strlen (mp4tagoldgenrelist [t16]), NULL);
-          }
-        } else {
-          snprintf (tmp, sizeof (tmp), "%" PRId16, t16);
-          mp4tag_add_tag (libmp4tag, tnm, tmp, MP4TAG_STRING, type, tlen, NULL);
-        }
-      } else if (tlen == sizeof (uint64_t)) {
-        memcpy (&t64, p, sizeof (uint64_t));
-        t64 = be64toh (t64);
-        snprintf (tmp, sizeof (tmp), "%" PRId64, t64);
-        mp4tag_add_tag (libmp4tag, tnm, tmp, MP4TAG_STRING, type, tlen, NULL);
-      } else if (tlen == sizeof (uint8_t)) {
-        memcpy (&t8, p, sizeof (uint8_t));
-        snprintf (tmp, sizeof (tmp), "%" PRId8, t8);
-        mp4tag_add_tag (libmp4tag, tnm, tmp, MP4TAG_STRING, type, tlen, NULL);
-      } else {
-        /* binary data */
-        mp4tag_add_tag (libmp4tag, tnm, p, tlen, type, tlen, NULL);
-      }
-    }
+  }
 
-    /* string type */
-    if (type == MP4TAG_ID_STRING && tlen > 0) {
-      /* pass as negative len to indicate a string that needs a terminator */
-      mp4tag_add_tag (libmp4tag, tnm, p, - (ssize_t) tlen, type, tlen, NULL);
-      if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_OTHER)) {
-        fprintf (stdout, "add-tag %s %.*s\n", tnm, tlen, p);
-      }
-    }
+  do {
+    plen += tlen;
+
+    mp4tag_process_item (libmp4tag, tnm, type, tlen, p);
 
     // fprintf (stdout, "%" PRId32 " >= %" PRId32 "\n", plen + MP4TAG_DATA_SZ, blen);
     if (plen + MP4TAG_DATA_SZ >= blen) {
@@ -804,6 +1290,100 @@ mp4tag_process_tag (libmp4tag_t *libmp4tag, const char *tag,
   } while (1);
 }
 
+/* processes a single data item, and adds the tag */
+/* the tag name may be changed ('gnre') */
+static void
+mp4tag_process_item (libmp4tag_t *libmp4tag, char *tnm,
+    uint32_t type, uint32_t tlen, const char *p)
+{
+  uint8_t     t8;
+  uint16_t    t16;
+  uint32_t    t32;
+  uint64_t    t64;
+  char        tmp [40];
+
+  /* general data */
+  if (type == MP4TAG_ID_DATA ||
+      type == MP4TAG_ID_NUM) {
+
+    /* 'disk' and 'trkn' must be handle as special cases. */
+    /* they are marked as data (0x00). */
+    if (strcmp (tnm, boxids [MP4TAG_DISK]) == 0 ||
+        strcmp (tnm, boxids [MP4TAG_TRKN]) == 0) {
+      t16 = 0;
+
+      /* pair of 32 bit and 16 bit numbers */
+      /* trkn has an extra 2 bytes of padding */
+      memcpy (&t32, p, sizeof (uint32_t));
+      t32 = be32toh (t32);
+
+      /* apparently there exist track number boxes */
+      /* that are not the full size */
+      if (strcmp (tnm, boxids [MP4TAG_TRKN]) != 0 ||
+          tlen >= sizeof (uint32_t) + sizeof (uint16_t)) {
+        memcpy (&t16, p + sizeof (uint32_t), sizeof (uint16_t));
+        t16 = be16toh (t16);
+      }
+
+      /* trkn has an additional two trailing bytes that are not used */
+
+      if (t16 == 0) {
+        snprintf (tmp, sizeof (tmp), "%" PRId32, t32);
+      } else {
+        snprintf (tmp, sizeof (tmp), "%" PRId32 "/%" PRId16, t32, t16);
+      }
+      mp4tag_add_tag (libmp4tag, tnm, tmp, MP4TAG_STRING, type, tlen, NULL);
+    } else if (tlen == sizeof (uint32_t)) {
+      memcpy (&t32, p, sizeof (uint32_t));
+      t32 = be32toh (t32);
+      snprintf (tmp, sizeof (tmp), "%" PRId32, t32);
+      mp4tag_add_tag (libmp4tag, tnm, tmp, MP4TAG_STRING, type, tlen, NULL);
+    } else if (tlen == sizeof (uint16_t)) {
+      memcpy (&t16, p, sizeof (uint16_t));
+      t16 = be16toh (t16);
+
+      /* the 'gnre' tag is converted to '©gen' */
+      /* hard-coded lists of genres are not good */
+      if (strcmp (tnm, boxids [MP4TAG_GNRE]) == 0) {
+        /* the itunes value is offset by 1 */
+        t16 -= 1;
+        if (t16 < mp4tagoldgenrelistsz) {
+          /* do not use the 'gnre' identifier */
+          strcpy (tnm, COPYRIGHT_STR);
+          strcat (tnm, boxids [MP4TAG_GEN]);
+          mp4tag_add_tag (libmp4tag, tnm, mp4tagoldgenrelist [t16],
+              MP4TAG_STRING, MP4TAG_ID_STRING,
+              strlen (mp4tagoldgenrelist [t16]), NULL);
+        }
+      } else {
+        snprintf (tmp, sizeof (tmp), "%" PRId16, t16);
+        mp4tag_add_tag (libmp4tag, tnm, tmp, MP4TAG_STRING, type, tlen, NULL);
+      }
+    } else if (tlen == sizeof (uint64_t)) {
+      memcpy (&t64, p, sizeof (uint64_t));
+      t64 = be64toh (t64);
+      snprintf (tmp, sizeof (tmp), "%" PRId64, t64);
+      mp4tag_add_tag (libmp4tag, tnm, tmp, MP4TAG_STRING, type, tlen, NULL);
+    } else if (tlen == sizeof (uint8_t)) {
+      memcpy (&t8, p, sizeof (uint8_t));
+      snprintf (tmp, sizeof (tmp), "%" PRId8, t8);
+      mp4tag_add_tag (libmp4tag, tnm, tmp, MP4TAG_STRING, type, tlen, NULL);
+    } else {
+      /* binary data */
+      mp4tag_add_tag (libmp4tag, tnm, p, tlen, type, tlen, NULL);
+    }
+  }
+
+  /* string type */
+  if (type == MP4TAG_ID_STRING && tlen > 0) {
+    /* pass as negative len to indicate a string that needs a terminator */
+    mp4tag_add_tag (libmp4tag, tnm, p, - (ssize_t) tlen, type, tlen, NULL);
+    if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_OTHER)) {
+      fprintf (stdout, "add-tag %s %.*s\n", tnm, tlen, p);
+    }
+  }
+}
+
 /* 'covr' can have additional data */
 /* there can be multiple images, and names present */
 static void
@@ -863,6 +1443,218 @@ mp4tag_process_covr (libmp4tag_t *libmp4tag, const char *tag,
   }
 }
 
+/* processes a tag box without reading in the large binary data. */
+/* the location of the binary data is saved, and the data is read */
+/* when it is needed. */
+/* the boxes within the tag are read one at a time. */
+static int
+mp4tag_process_lazy (libmp4tag_t *libmp4tag, const char *tag, uint64_t blen)
+{
+  boxhead_t   bh;
+  char        tnm [MP4TAG_ID_MAX];
+  size_t      len;
+  uint32_t    sublen;
+  uint32_t    tlen;
+  uint32_t    type;
+  uint32_t    t32 [2];
+  char        *buff;
+  bool        iscovr;
+  bool        iscustom;
+  bool        lazy;
+  int         rrc = MP4TAG_READ_OK;
+  /* a cover is not added until its name has been seen */
+  int         cflag = 0;
+  int64_t     coffset = 0;
+  uint32_t    clen = 0;
+  uint32_t    ctype = MP4TAG_ID_JPG;
+  char        *cname = NULL;
+
+  iscovr = strcmp (tag, boxids [MP4TAG_COVR]) == 0;
+  iscustom = strcmp (tag, boxids [MP4TAG_CUSTOM]) == 0;
+  snprintf (tnm, sizeof (tnm), "%s", tag);
+  if (iscustom) {
+    snprintf (tnm + strlen (tnm), sizeof (tnm) - strlen (tnm), ":");
+  }
+
+  while (rrc == MP4TAG_READ_OK && blen >= MP4TAG_BOXHEAD_SZ) {
+    rrc = mp4tag_data_read (libmp4tag, &bh, MP4TAG_BOXHEAD_SZ);
+    if (rrc != MP4TAG_READ_OK) {
+      break;
+    }
+    sublen = be32toh (bh.len);
+    if (sublen < MP4TAG_BOXHEAD_SZ || sublen > blen) {
+      /* not valid, skip the remainder of the tag */
+      blen -= MP4TAG_BOXHEAD_SZ;
+      break;
+    }
+    blen -= sublen;
+    sublen -= MP4TAG_BOXHEAD_SZ;
+
+    if (memcmp (bh.nm, boxids [MP4TAG_DATA], MP4TAG_ID_LEN) == 0 &&
+        sublen >= sizeof (t32)) {
+      /* data flags and reserved */
+      rrc = mp4tag_data_read (libmp4tag, t32, sizeof (t32));
+      if (rrc != MP4TAG_READ_OK) {
+        break;
+      }
+      type = be32toh (t32 [0]) & 0x00ffffff;
+      tlen = sublen - sizeof (t32);
+
+      if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_OTHER)) {
+        fprintf (stdout, "%s %03x tlen:%" PRId32 " lazy\n", tnm, type, tlen);
+      }
+
+      if (iscustom && ! mp4tag_filter_tag (libmp4tag, tnm)) {
+        rrc = mp4tag_data_seek (libmp4tag, tlen);
+        continue;
+      }
+
+      if (iscovr) {
+        if (cflag > 0) {
+          mp4tag_add_lazy (libmp4tag, boxids [MP4TAG_COVR], coffset, clen, ctype, cname);
+          if (cname != NULL) {
+            free (cname);
+          }
+          cname = NULL;
+        }
+        coffset = libmp4tag->offset;
+        clen = tlen;
+        ctype = type == 0 ? MP4TAG_ID_JPG : type;
+        ++cflag;
+        rrc = mp4tag_data_seek (libmp4tag, tlen);
+        continue;
+      }
+
+      lazy = (type == MP4TAG_ID_DATA || type == MP4TAG_ID_NUM) &&
+          tlen >= MP4TAG_LAZY_SZ &&
+          strcmp (tnm, boxids [MP4TAG_DISK]) != 0 &&
+          strcmp (tnm, boxids [MP4TAG_TRKN]) != 0;
+      if (lazy) {
+        mp4tag_add_lazy (libmp4tag, tnm, libmp4tag->offset, tlen, type, NULL);
+        rrc = mp4tag_data_seek (libmp4tag, tlen);
+        continue;
+      }
+
+      /* small data items are processed as usual */
+      buff = malloc (tlen + 1);
+      if (buff == NULL) {
+        libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+        rrc = MP4TAG_READ_NONE;
+        break;
+      }
+      rrc = mp4tag_data_read (libmp4tag, buff, tlen);
+      if (rrc == MP4TAG_READ_OK) {
+        mp4tag_process_item (libmp4tag, tnm, type, tlen, buff);
+      }
+      free (buff);
+      continue;
+    }
+
+    if ((iscustom &&
+        memcmp (bh.nm, boxids [MP4TAG_MEAN], MP4TAG_ID_LEN) == 0) ||
+        ((iscustom || iscovr) &&
+        memcmp (bh.nm, boxids [MP4TAG_NAME], MP4TAG_ID_LEN) == 0)) {
+      buff = malloc (sublen + 1);
+      if (buff == NULL) {
+        libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+        rrc = MP4TAG_READ_NONE;
+        break;
+      }
+      rrc = mp4tag_data_read (libmp4tag, buff, sublen);
+      if (rrc != MP4TAG_READ_OK) {
+        free (buff);
+        break;
+      }
+      buff [sublen] = '\0';
+
+      if (iscovr) {
+        /* the cover name has no flags */
+        if (cname != NULL) {
+          free (cname);
+        }
+        cname = buff;
+        continue;
+      }
+
+      /* 'mean' and 'name' have 4 bytes of flags */
+      if (sublen >= sizeof (uint32_t)) {
+        len = strlen (tnm);
+        snprintf (tnm + len, sizeof (tnm) - len, "%.*s%s",
+            (int) (sublen - sizeof (uint32_t)), buff + sizeof (uint32_t),
+            memcmp (bh.nm, boxids [MP4TAG_MEAN], MP4TAG_ID_LEN) == 0 ? ":" : "");
+      }
+      free (buff);
+      continue;
+    }
+
+    rrc = mp4tag_data_seek (libmp4tag, sublen);
+  }
+
+  if (rrc == MP4TAG_READ_OK && cflag > 0) {
+    mp4tag_add_lazy (libmp4tag, boxids [MP4TAG_COVR], coffset, clen, ctype, cname);
+  }
+  if (cname != NULL) {
+    free (cname);
+  }
+
+  if (rrc == MP4TAG_READ_OK && blen > 0) {
+    rrc = mp4tag_data_seek (libmp4tag, blen);
+  }
+
+  return rrc;
+}
+
+/* adds a binary tag, the data is not read until it is needed */
+static void
+mp4tag_add_lazy (libmp4tag_t *libmp4tag, const char *tag,
+    int64_t offset, uint32_t len, uint32_t type, const char *covername)
+{
+  int     tagidx;
+
+  if (len == 0) {
+    /* a zero length is processed as an empty string */
+    mp4tag_add_tag (libmp4tag, tag, "", len, type, len, covername);
+    return;
+  }
+
+  /* a null data pointer will not allocate any space for the data */
+  tagidx = mp4tag_add_tag (libmp4tag, tag, NULL, len, type, len, covername);
+  if (tagidx >= 0) {
+    libmp4tag->tags [tagidx].dataoffset = offset;
+  }
+}
+
+static void
+mp4tag_add_cotable (libmp4tag_t *libmp4tag, int64_t offset,
+    uint32_t len, int offsetsz)
+{
+  mp4tagcotable_t   *cotable;
+
+  if (! libmp4tag->canwrite) {
+    /* the tables are only needed by the write process */
+    return;
+  }
+
+  if (libmp4tag->cotablecount >= libmp4tag->cotablealloc) {
+    mp4tagcotable_t   *tcotables;
+
+    tcotables = realloc (libmp4tag->cotables,
+        sizeof (mp4tagcotable_t) * (libmp4tag->cotablealloc + 10));
+    if (tcotables == NULL) {
+      libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+      return;
+    }
+    libmp4tag->cotables = tcotables;
+    libmp4tag->cotablealloc += 10;
+  }
+
+  cotable = &libmp4tag->cotables [libmp4tag->cotablecount];
+  cotable->offset = offset;
+  cotable->len = len;
+  cotable->offsetsz = offsetsz;
+  ++libmp4tag->cotablecount;
+}
+
 static void
 mp4tag_process_data (const char *p, uint32_t *plen, uint32_t *ptype)
 {
@@ -889,20 +1681,205 @@ mp4tag_parse_check_end (libmp4tag_t *libmp4tag)
   }
 }
 
+/* reads the entire 'ilst' box into the ilst view. */
+/* the view is followed by a pool that is large enough to hold */
+/* the tag names and string values, so that no allocations are */
+/* needed for each tag. */
+/* binary data is not copied. */
+static int
+mp4tag_view_load (libmp4tag_t *libmp4tag, uint64_t len)
+{
+  char      *buff;
+  char      *tbuff;
+  int64_t   offset;
+  size_t    poolsz;
+  int       count;
+  int       rrc;
+
+  if (len == 0 || len >= SIZE_MAX / 2) {
+    return MP4TAG_READ_OK;
+  }
+
+  offset = libmp4tag->offset;
+
+  buff = malloc (len);
+  if (buff == NULL) {
+    libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+    return MP4TAG_READ_NONE;
+  }
+  rrc = mp4tag_data_read (libmp4tag, buff, len);
+  if (rrc != MP4TAG_READ_OK) {
+    free (buff);
+    if (libmp4tag->isstream) {
+      return rrc;
+    }
+    /* the box is processed without the view */
+    libmp4tag->offset = offset;
+    return MP4TAG_READ_OK;
+  }
+
+  mp4tag_view_size (buff, len, &poolsz, &count);
+  tbuff = realloc (buff, len + poolsz);
+  if (tbuff == NULL) {
+    free (buff);
+    libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+    return MP4TAG_READ_NONE;
+  }
+
+  /* the tag list only needs to be allocated once */
+  if (count > libmp4tag->tagalloccount - libmp4tag->tagcount) {
+    mp4tag_t    *ttags;
+
+    ttags = realloc (libmp4tag->tags,
+        sizeof (mp4tag_t) * (libmp4tag->tagcount + count));
+    if (ttags == NULL) {
+      free (tbuff);
+      libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+      return MP4TAG_READ_NONE;
+    }
+    libmp4tag->tags = ttags;
+    libmp4tag->tagalloccount = libmp4tag->tagcount + count;
+  }
+
+  libmp4tag->viewbuff = tbuff;
+  libmp4tag->viewlen = len;
+  libmp4tag->viewalloc = len + poolsz;
+  libmp4tag->viewidx = len;
+  libmp4tag->viewoffset = offset;
+  /* the file remains positioned at the end of the 'ilst' box, */
+  /* the parse continues from the view */
+  libmp4tag->offset = offset;
+
+  return MP4TAG_READ_OK;
+}
+
+/* determines the size of the pool needed for the ilst view, */
+/* and the maximum number of tags. */
+/* the size is generous, the pool does not need to be exact. */
+static void
+mp4tag_view_size (const char *data, uint64_t len, size_t *poolsz, int *count)
+{
+  const char  *p;
+  const char  *end;
+  const char  *sp;
+  const char  *send;
+  uint32_t    boxlen;
+  uint32_t    sublen;
+  uint32_t    tlen;
+  uint32_t    type;
+
+  *poolsz = 0;
+  *count = 0;
+
+  p = data;
+  end = data + len;
+  while (end - p >= MP4TAG_BOXHEAD_SZ) {
+    memcpy (&boxlen, p, sizeof (uint32_t));
+    boxlen = be32toh (boxlen);
+    if (boxlen < MP4TAG_BOXHEAD_SZ || boxlen > (uint64_t) (end - p)) {
+      break;
+    }
+
+    /* the tag name */
+    *poolsz += MP4TAG_ID_DISP_LEN;
+
+    sp = p + MP4TAG_BOXHEAD_SZ;
+    send = p + boxlen;
+    while (send - sp >= MP4TAG_BOXHEAD_SZ) {
+      memcpy (&sublen, sp, sizeof (uint32_t));
+      sublen = be32toh (sublen);
+      if (sublen < MP4TAG_BOXHEAD_SZ || sublen > (uint64_t) (send - sp)) {
+        break;
+      }
+
+      if (memcmp (sp + sizeof (uint32_t), boxids [MP4TAG_DATA],
+          MP4TAG_ID_LEN) == 0 &&
+          sublen >= MP4TAG_DATA_SZ) {
+        mp4tag_process_data (sp, &tlen, &type);
+        if (type == MP4TAG_ID_STRING) {
+          *poolsz += tlen + 1;
+        } else if ((type == MP4TAG_ID_DATA || type == MP4TAG_ID_NUM) &&
+            tlen <= sizeof (uint64_t)) {
+          /* numeric values, 'trkn', 'disk' and 'gnre' are converted */
+          *poolsz += MP4TAG_VIEW_NUM_SZ;
+        }
+        /* the name may be repeated if the data items are not together */
+        *poolsz += MP4TAG_ID_DISP_LEN;
+        *count += 1;
+      } else {
+        /* custom tag names and cover names */
+        *poolsz += sublen + 1;
+      }
+      sp += sublen;
+    }
+
+    p += boxlen;
+  }
+}
+
+/* returns the number of bytes remaining in the ilst view */
+/* at the current offset */
+static size_t
+mp4tag_view_avail (libmp4tag_t *libmp4tag)
+{
+  int64_t   end;
+
+  if (libmp4tag->viewbuff == NULL) {
+    return 0;
+  }
+
+  end = libmp4tag->viewoffset + (int64_t) libmp4tag->viewlen;
+  if (libmp4tag->offset < libmp4tag->viewoffset ||
+      libmp4tag->offset >= end) {
+    return 0;
+  }
+  return end - libmp4tag->offset;
+}
+
 static int
 mp4tag_data_seek (libmp4tag_t *libmp4tag, int64_t skiplen)
 {
   int     rc;
+  size_t  pending;
+
+  pending = mp4tag_view_avail (libmp4tag);
+  if (pending > 0) {
+    if ((uint64_t) skiplen <= pending) {
+      libmp4tag->offset += skiplen;
+      return MP4TAG_READ_OK;
+    }
+    /* the file is positioned at the end of the ilst view */
+    libmp4tag->offset += pending;
+    skiplen -= pending;
+  }
+
+  if (libmp4tag->mapdata != NULL || libmp4tag->isfeed) {
+    /* any read past the end of the mapping will fail */
+    /* with mp4tag_feed, the skipped data does not need to be fed */
+    libmp4tag->offset += skiplen;
+    return MP4TAG_READ_OK;
+  }
 
   if (! libmp4tag->isstream) {
-    rc = mp4tag_fseek (libmp4tag->fh, skiplen, SEEK_CUR);
+    /* files are read at the parse offset */
+    rc = 0;
   } else {
     if (libmp4tag->seekcb == NULL) {
       libmp4tag->mp4error = MP4TAG_ERR_NO_CALLBACK;
       return MP4TAG_READ_NONE;
     }
 
-    rc = libmp4tag->seekcb (skiplen, libmp4tag->userdata);
+    pending = libmp4tag->rabufflen - libmp4tag->rabuffidx;
+    if ((uint64_t) skiplen <= pending) {
+      /* the skip is satisfied by the read-ahead buffer */
+      libmp4tag->rabuffidx += skiplen;
+      rc = 0;
+    } else {
+      /* the stream is already positioned past the buffered data */
+      libmp4tag->rabufflen = 0;
+      libmp4tag->rabuffidx = 0;
+      rc = libmp4tag->seekcb (skiplen - pending, libmp4tag->userdata);
+    }
   }
   if (rc != 0) {
     libmp4tag->mp4error = MP4TAG_ERR_FILE_SEEK_ERROR;
@@ -923,6 +1900,47 @@ mp4tag_data_read (libmp4tag_t *libmp4tag, void *buff, size_t sz)
   time_t    ttm = 0;
   int       rc = 0;
   char      *cbuff = buff;
+  const char  *dptr;
+
+  totbr = mp4tag_view_avail (libmp4tag);
+  if (totbr > 0) {
+    if (totbr > sz) {
+      totbr = sz;
+    }
+    memcpy (cbuff, libmp4tag->viewbuff +
+        (libmp4tag->offset - libmp4tag->viewoffset), totbr);
+    libmp4tag->offset += totbr;
+    if (totbr == sz) {
+      return MP4TAG_READ_OK;
+    }
+    /* the remainder follows the ilst view */
+    bwant -= totbr;
+  }
+
+  if (libmp4tag->mapdata != NULL) {
+    if (mp4tag_data_ref (libmp4tag, &dptr, bwant) != MP4TAG_READ_OK) {
+      return MP4TAG_READ_NONE;
+    }
+    memcpy (cbuff + totbr, dptr, bwant);
+    return MP4TAG_READ_OK;
+  }
+
+  if (libmp4tag->isfeed) {
+    if (libmp4tag->offset < libmp4tag->feedoffset ||
+        libmp4tag->offset + (int64_t) bwant >
+        libmp4tag->feedoffset + (int64_t) libmp4tag->feedlen) {
+      /* the walk is suspended until more data is fed */
+      if (! libmp4tag->feedend) {
+        libmp4tag->feedneed = true;
+        libmp4tag->feedwant = libmp4tag->offset + bwant;
+      }
+      return MP4TAG_READ_NONE;
+    }
+    memcpy (cbuff + totbr, libmp4tag->feedbuff +
+        (libmp4tag->offset - libmp4tag->feedoffset), bwant);
+    libmp4tag->offset += bwant;
+    return MP4TAG_READ_OK;
+  }
 
   if (libmp4tag->isstream) {
     if (libmp4tag->readcb == NULL) {
@@ -936,9 +1954,9 @@ mp4tag_data_read (libmp4tag_t *libmp4tag, void *buff, size_t sz)
 
   while (bwant > 0) {
     if (! libmp4tag->isstream) {
-      br = fread (cbuff + totbr, 1, bwant, libmp4tag->fh);
+      br = mp4tag_file_read (libmp4tag, cbuff + totbr, bwant);
     } else {
-      br = libmp4tag->readcb (cbuff + totbr, 1, bwant, libmp4tag->userdata);
+      br = mp4tag_stream_read (libmp4tag, cbuff + totbr, bwant);
     }
     if (br > 0) {
       totbr += br;
@@ -949,12 +1967,28 @@ mp4tag_data_read (libmp4tag_t *libmp4tag, void *buff, size_t sz)
       rc = MP4TAG_READ_OK;
       break;
     }
-    if (! libmp4tag->isstream && bwant != 0) {
+    if (! libmp4tag->isstream && br == 0) {
       /* probably end-of-file */
       return MP4TAG_READ_NONE;
     }
 
-    if (libmp4tag->isstream) {
+    if (libmp4tag->isstream && br == 0 && libmp4tag->waitcb != NULL) {
+      ttm = mp4tag_get_time ();
+      if (ttm > tmval) {
+        /* no more data found within timeout period */
+        return MP4TAG_READ_NONE;
+      }
+      /* the application waits for more data to arrive, */
+      /* for no longer than the remainder of the timeout */
+      if (libmp4tag->waitcb ((uint32_t) (tmval - ttm),
+          libmp4tag->userdata) != 0) {
+        /* the stream has ended */
+        return MP4TAG_READ_NONE;
+      }
+      continue;
+    }
+
+    if (libmp4tag->isstream && br == 0) {
       mp4tag_sleep (MP4TAG_SLEEP_TIME);
 
       ttm = mp4tag_get_time ();
@@ -968,6 +2002,100 @@ mp4tag_data_read (libmp4tag_t *libmp4tag, void *buff, size_t sz)
   return rc;
 }
 
+/* returns a pointer to the data within the ilst view or the */
+/* memory-mapped file and advances the offset.  no copy is made. */
+static int
+mp4tag_data_ref (libmp4tag_t *libmp4tag, const char **dptr, size_t sz)
+{
+  if (sz > 0 && mp4tag_view_avail (libmp4tag) >= sz) {
+    *dptr = libmp4tag->viewbuff +
+        (libmp4tag->offset - libmp4tag->viewoffset);
+    libmp4tag->offset += sz;
+    return MP4TAG_READ_OK;
+  }
+
+  if (libmp4tag->offset < 0 ||
+      (size_t) libmp4tag->offset > libmp4tag->mapsz ||
+      sz > libmp4tag->mapsz - (size_t) libmp4tag->offset) {
+    /* end-of-file */
+    return MP4TAG_READ_NONE;
+  }
+
+  *dptr = libmp4tag->mapdata + libmp4tag->offset;
+  libmp4tag->offset += sz;
+
+  return MP4TAG_READ_OK;
+}
+
+/* returns the data from the read-ahead buffer.  the read callback */
+/* is only called when the buffer is empty.  may return partial data. */
+static size_t
+mp4tag_stream_read (libmp4tag_t *libmp4tag, char *buff, size_t sz)
+{
+  size_t    pending;
+
+  pending = libmp4tag->rabufflen - libmp4tag->rabuffidx;
+  if (pending == 0) {
+    libmp4tag->rabufflen = 0;
+    libmp4tag->rabuffidx = 0;
+    if (sz >= libmp4tag->rabuffsz) {
+      /* large reads bypass the buffer */
+      return libmp4tag->readcb (buff, 1, sz, libmp4tag->userdata);
+    }
+    pending = libmp4tag->readcb (libmp4tag->rabuff, 1,
+        libmp4tag->rabuffsz, libmp4tag->userdata);
+    libmp4tag->rabufflen = pending;
+  }
+
+  if (sz > pending) {
+    sz = pending;
+  }
+  memcpy (buff, libmp4tag->rabuff + libmp4tag->rabuffidx, sz);
+  libmp4tag->rabuffidx += sz;
+
+  return sz;
+}
+
+/* files are read at the parse offset using positional reads, */
+/* through the read-ahead buffer.  may return partial data. */
+static size_t
+mp4tag_file_read (libmp4tag_t *libmp4tag, char *buff, size_t sz)
+{
+  int64_t   offset = libmp4tag->offset;
+  size_t    idx;
+
+  if (libmp4tag->rabufflen > 0 &&
+      offset >= libmp4tag->rabuffoffset &&
+      offset < libmp4tag->rabuffoffset + (int64_t) libmp4tag->rabufflen) {
+    idx = offset - libmp4tag->rabuffoffset;
+    if (sz > libmp4tag->rabufflen - idx) {
+      sz = libmp4tag->rabufflen - idx;
+    }
+    memcpy (buff, libmp4tag->rabuff + idx, sz);
+    return sz;
+  }
+
+  if (libmp4tag->rabuff == NULL) {
+    libmp4tag->rabuff = malloc (MP4TAG_READ_BUFF_SZ);
+    if (libmp4tag->rabuff != NULL) {
+      libmp4tag->rabuffsz = MP4TAG_READ_BUFF_SZ;
+    }
+  }
+  if (libmp4tag->rabuff == NULL || sz >= libmp4tag->rabuffsz) {
+    /* large reads bypass the buffer */
+    return mp4tag_pread (libmp4tag->fh, buff, sz, offset);
+  }
+
+  libmp4tag->rabufflen = mp4tag_pread (libmp4tag->fh, libmp4tag->rabuff,
+      libmp4tag->rabuffsz, offset);
+  libmp4tag->rabuffoffset = offset;
+  if (sz > libmp4tag->rabufflen) {
+    sz = libmp4tag->rabufflen;
+  }
+  memcpy (buff, libmp4tag->rabuff, sz);
+  return sz;
+}
+
 static time_t
 mp4tag_get_time (void)
 {
@@ -994,12 +2122,6 @@ mp4tag_dump_co (libmp4tag_t *libmp4tag, const char *ident, size_t len, const cha
   int           offsetsz;
   uint32_t      t32;
   int64_t       t64 = 0;
-  int64_t       origoffset = 0;
-
-  if (libmp4tag->isstream == false) {
-    /* preserve the current position */
-    origoffset = mp4tag_ftell (libmp4tag->fh);
-  }
 
   if (strcmp (ident, boxids [MP4TAG_STCO]) == 0) {
     offsetsz = sizeof (uint32_t);
@@ -1013,6 +2135,9 @@ mp4tag_dump_co (libmp4tag_t *libmp4tag, const char *ident, size_t len, const cha
   memcpy (&t32, dptr, sizeof (uint32_t));
   dptr += sizeof (uint32_t);
   numoffsets = be32toh (t32);
+  if (numoffsets > (len - sizeof (uint32_t) * 2) / offsetsz) {
+    numoffsets = (len - sizeof (uint32_t) * 2) / offsetsz;
+  }
 
   for (uint32_t i = 0; i < numoffsets; ++i) {
     if (offsetsz == sizeof (uint32_t)) {
@@ -1030,11 +2155,27 @@ mp4tag_dump_co (libmp4tag_t *libmp4tag, const char *ident, size_t len, const cha
     fprintf (stdout, "\n");
     dptr += offsetsz;
   }
+}
+
+/* the chunk offset tables that follow the tags are not read by the */
+/* parse, the table is read from the file at the current offset */
+static void
+mp4tag_dump_co_file (libmp4tag_t *libmp4tag, const char *ident, size_t len)
+{
+  char    *data;
+
+  if (libmp4tag->isstream || len < sizeof (uint32_t) * 2) {
+    return;
+  }
 
-  if (libmp4tag->isstream == false) {
-    /* restore the original position */
-    mp4tag_fseek (libmp4tag->fh, origoffset, SEEK_SET);
+  data = malloc (len);
+  if (data == NULL) {
+    return;
   }
+  if (mp4tag_pread (libmp4tag->fh, data, len, libmp4tag->offset) == len) {
+    mp4tag_dump_co (libmp4tag, ident, len, data);
+  }
+  free (data);
 }
 
 static void
@@ -1046,11 +2187,9 @@ mp4tag_dump_data (libmp4tag_t *libmp4tag, int64_t offset)
     return;
   }
 
-  if (mp4tag_fseek (libmp4tag->fh, offset, SEEK_SET) == 0) {
-    if (fread (buff, sizeof (buff), 1, libmp4tag->fh) == 1) {
-      for (size_t j = 0; j < sizeof (buff); ++j) {
-        fprintf (stdout, "%02x", buff [j]);
-      }
+  if (mp4tag_pread (libmp4tag->fh, buff, sizeof (buff), offset) == sizeof (buff)) {
+    for (size_t j = 0; j < sizeof (buff); ++j) {
+      fprintf (stdout, "%02x", buff [j]);
     }
   }
 }
@@ -0,0 +1,330 @@
+/*
+ * Copyright 2026 Brad Lanam Pleasant Hill CA
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if _lib_CreateThread
+# define WIN32_LEAN_AND_MEAN 1
+# include <windows.h>
+#endif
+#if ! _lib_CreateThread && _hdr_pthread
+# include <pthread.h>
+# include <unistd.h>
+#endif
+
+#include "libmp4tag.h"
+#include "mp4tagint.h"
+
+typedef struct mp4tagpool mp4tagpool_t;
+
+/* each worker has a range of file indexes.  the worker takes files */
+/* from the head of its range, and when the range is empty, takes */
+/* half of the remaining files from the tail of another worker's range. */
+typedef struct {
+  mp4tagpool_t        *pool;
+  /* the head is in the low 32 bits, the tail in the high 32 bits */
+  uint64_t            range;
+  mp4tagworkerstats_t stats;
+  int                 widx;
+  bool                started;
+#if _lib_CreateThread
+  HANDLE              thread;
+#endif
+#if ! _lib_CreateThread && _hdr_pthread
+  pthread_t           thread;
+#endif
+} mp4tagworker_t;
+
+struct mp4tagpool {
+  const char          **fn;
+  mp4tag_batchcb_t    batchcb;
+  void                *udata;
+  int                 *results;
+  mp4tagworker_t      *workers;
+  int                 workercount;
+};
+
+static void mp4tag_pool_worker (mp4tagworker_t *worker);
+static int  mp4tag_pool_next (mp4tagworker_t *worker);
+static int  mp4tag_pool_steal (mp4tagworker_t *worker);
+static int  mp4tag_pool_cpus (void);
+static bool mp4tag_pool_start (mp4tagworker_t *worker);
+static void mp4tag_pool_join (mp4tagworker_t *worker);
+#if _lib_CreateThread
+static DWORD WINAPI mp4tag_pool_thread (LPVOID arg);
+#endif
+#if ! _lib_CreateThread && _hdr_pthread
+static void * mp4tag_pool_thread (void *arg);
+#endif
+
+/* the calling thread is used as the first worker */
+int
+mp4tag_parse_many (const char *fn [], int count, int workers,
+    mp4tag_batchcb_t batchcb, void *udata, int results [],
+    mp4tagworkerstats_t stats [])
+{
+  mp4tagpool_t    pool;
+  int             statcount = 0;
+
+  if (count <= 0) {
+    return MP4TAG_OK;
+  }
+  if (fn == NULL || (batchcb == NULL && results == NULL)) {
+    return MP4TAG_ERR_NULL_VALUE;
+  }
+
+  if (workers > 0) {
+    statcount = workers;
+  }
+  if (workers <= 0) {
+    workers = mp4tag_pool_cpus ();
+  }
+#if ! _lib_CreateThread && ! _hdr_pthread
+  workers = 1;
+#endif
+  if (workers > count) {
+    workers = count;
+  }
+
+  pool.fn = fn;
+  pool.batchcb = batchcb;
+  pool.udata = udata;
+  pool.results = results;
+  pool.workercount = workers;
+  pool.workers = malloc (sizeof (mp4tagworker_t) * workers);
+  if (pool.workers == NULL) {
+    return MP4TAG_ERR_OUT_OF_MEMORY;
+  }
+
+  for (int i = 0; i < workers; ++i) {
+    mp4tagworker_t  *worker = &pool.workers [i];
+    uint64_t        head;
+    uint64_t        tail;
+
+    head = (uint64_t) count * i / workers;
+    tail = (uint64_t) count * (i + 1) / workers;
+    worker->pool = &pool;
+    worker->range = (tail << 32) | head;
+    worker->widx = i;
+    worker->started = false;
+    memset (&worker->stats, 0, sizeof (mp4tagworkerstats_t));
+  }
+
+  /* if a thread cannot be started, its files are taken by the */
+  /* other workers */
+  for (int i = 1; i < workers; ++i) {
+    pool.workers [i].started = mp4tag_pool_start (&pool.workers [i]);
+  }
+  mp4tag_pool_worker (&pool.workers [0]);
+  for (int i = 1; i < workers; ++i) {
+    mp4tag_pool_join (&pool.workers [i]);
+  }
+
+  if (stats != NULL) {
+    for (int i = 0; i < statcount; ++i) {
+      memset (&stats [i], 0, sizeof (mp4tagworkerstats_t));
+      if (i < workers) {
+        stats [i] = pool.workers [i].stats;
+      }
+    }
+  }
+
+  free (pool.workers);
+  return MP4TAG_OK;
+}
+
+/* the worker's handle is re-used for each file */
+static void
+mp4tag_pool_worker (mp4tagworker_t *worker)
+{
+  mp4tagpool_t    *pool = worker->pool;
+  libmp4tag_t     *libmp4tag = NULL;
+  int             idx;
+  int             rc;
+
+  while ((idx = mp4tag_pool_next (worker)) >= 0 ||
+      (idx = mp4tag_pool_steal (worker)) >= 0) {
+    if (libmp4tag == NULL) {
+      libmp4tag = mp4tag_open_readonly (pool->fn [idx], &rc);
+    } else {
+      rc = mp4tag_reopen (libmp4tag, pool->fn [idx]);
+    }
+
+    if (rc == MP4TAG_OK) {
+      rc = mp4tag_parse (libmp4tag);
+      if (libmp4tag->filesz > 0) {
+        worker->stats.bytes += libmp4tag->filesz;
+      }
+    }
+
+    worker->stats.files += 1;
+    if (rc != MP4TAG_OK) {
+      worker->stats.errors += 1;
+    }
+    if (pool->results != NULL) {
+      pool->results [idx] = rc;
+    }
+    if (pool->batchcb != NULL) {
+      /* a handle that could not be re-opened has no file */
+      pool->batchcb (libmp4tag != NULL && libmp4tag->fh != NULL ?
+          libmp4tag : NULL, idx, rc, pool->udata);
+    }
+  }
+
+  mp4tag_free (libmp4tag);
+}
+
+/* returns -1 if the worker's range is empty */
+static int
+mp4tag_pool_next (mp4tagworker_t *worker)
+{
+  uint64_t    range;
+  uint64_t    nrange;
+  uint32_t    head;
+  uint32_t    tail;
+
+  range = __atomic_load_n (&worker->range, __ATOMIC_ACQUIRE);
+  while (true) {
+    head = range & UINT32_MAX;
+    tail = range >> 32;
+    if (head >= tail) {
+      return -1;
+    }
+    nrange = ((uint64_t) tail << 32) | (head + 1);
+    if (__atomic_compare_exchange_n (&worker->range, &range, nrange,
+        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return head;
+    }
+  }
+}
+
+/* takes half of the largest remaining range.  returns the first of */
+/* the files taken, the rest become the worker's range. */
+/* a file index never returns to a range, so a range value is never */
+/* re-used, and the compare-exchange cannot succeed on a stale value */
+static int
+mp4tag_pool_steal (mp4tagworker_t *worker)
+{
+  mp4tagpool_t    *pool = worker->pool;
+  mp4tagworker_t  *victim;
+  uint64_t        range;
+  uint64_t        nrange;
+  uint32_t        head;
+  uint32_t        tail;
+  uint32_t        take;
+
+  while (true) {
+    victim = NULL;
+    take = 0;
+    for (int i = 1; i < pool->workercount; ++i) {
+      mp4tagworker_t  *tworker;
+
+      tworker = &pool->workers [(worker->widx + i) % pool->workercount];
+      range = __atomic_load_n (&tworker->range, __ATOMIC_ACQUIRE);
+      head = range & UINT32_MAX;
+      tail = range >> 32;
+      if (head < tail && tail - head > take) {
+        victim = tworker;
+        take = tail - head;
+      }
+    }
+    if (victim == NULL) {
+      return -1;
+    }
+
+    range = __atomic_load_n (&victim->range, __ATOMIC_ACQUIRE);
+    head = range & UINT32_MAX;
+    tail = range >> 32;
+    if (head >= tail) {
+      continue;
+    }
+    take = (tail - head + 1) / 2;
+    nrange = ((uint64_t) tail << 32) | head;
+    nrange -= (uint64_t) take << 32;
+    if (__atomic_compare_exchange_n (&victim->range, &range, nrange,
+        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+  }
+
+  worker->stats.steals += 1;
+  /* the worker's range is empty, no other worker will change it */
+  __atomic_store_n (&worker->range,
+      ((uint64_t) tail << 32) | (tail - take + 1), __ATOMIC_RELEASE);
+  return tail - take;
+}
+
+static int
+mp4tag_pool_cpus (void)
+{
+  int     cpus = 1;
+
+#if _lib_CreateThread
+  SYSTEM_INFO   si;
+
+  GetSystemInfo (&si);
+  cpus = si.dwNumberOfProcessors;
+#endif
+#if ! _lib_CreateThread && _hdr_pthread && defined (_SC_NPROCESSORS_ONLN)
+  cpus = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+  if (cpus < 1) {
+    cpus = 1;
+  }
+  return cpus;
+}
+
+static bool
+mp4tag_pool_start (mp4tagworker_t *worker)
+{
+#if _lib_CreateThread
+  worker->thread = CreateThread (NULL, 0, mp4tag_pool_thread, worker, 0, NULL);
+  return worker->thread != NULL;
+#endif
+#if ! _lib_CreateThread && _hdr_pthread
+  return pthread_create (&worker->thread, NULL, mp4tag_pool_thread, worker) == 0;
+#endif
+#if ! _lib_CreateThread && ! _hdr_pthread
+  return false;
+#endif
+}
+
+static void
+mp4tag_pool_join (mp4tagworker_t *worker)
+{
+  if (! worker->started) {
+    return;
+  }
+#if _lib_CreateThread
+  WaitForSingleObject (worker->thread, INFINITE);
+  CloseHandle (worker->thread);
+#endif
+#if ! _lib_CreateThread && _hdr_pthread
+  pthread_join (worker->thread, NULL);
+#endif
+}
+
+#if _lib_CreateThread
+static DWORD WINAPI
+mp4tag_pool_thread (LPVOID arg)
+{
+  mp4tag_pool_worker (arg);
+  return 0;
+}
+#endif
+
+#if ! _lib_CreateThread && _hdr_pthread
+static void *
+mp4tag_pool_thread (void *arg)
+{
+  mp4tag_pool_worker (arg);
+  return NULL;
+}
+#endif
@@ -19,15 +19,32 @@
 
 #include "libmp4tag.h"
 #include "mp4tagint.h"
+#include "mp4taghash.h"
 #include "nodiscard.h"
 
-const char *MP4TAG_INPUT_DELIM = ":";
+const char * const MP4TAG_INPUT_DELIM = ":";
 
 static int  mp4tag_check_covr (const char *tag, const char *fn);
-
+static uint32_t mp4tag_tag_key (const char *tag);
+static int  mp4tag_compare_key (const void *a, const void *b);
+static char * mp4tag_tag_dup (libmp4tag_t *libmp4tag, const char *str, size_t len);
+static char * mp4tag_view_dup (libmp4tag_t *libmp4tag, const char *str, size_t len);
+static bool mp4tag_view_owns (libmp4tag_t *libmp4tag, const char *ptr);
+static int  mp4tag_scan_tags (libmp4tag_t *libmp4tag, const char *tag, int dataidx);
+
+/* tags are added to the end of the tag list, the list is sorted */
+/* when the order is needed (iteration, writing). */
+/* the tags that have been added since the last sort are sorted, */
+/* and merged with the tags that are already in order */
 void
 mp4tag_sort_tags (libmp4tag_t *libmp4tag)
 {
+  mp4tagkey_t   *tagkeys;
+  mp4tagkey_t   *sorted;
+  int           count;
+  int           a;
+  int           b;
+
   if (libmp4tag == NULL || libmp4tag->libmp4tagident != MP4TAG_IDENT) {
     return;
   }
@@ -35,12 +52,130 @@ mp4tag_sort_tags (libmp4tag_t *libmp4tag)
     return;
   }
 
+  mp4tag_compact_tags (libmp4tag);
+  if (libmp4tag->tagsortcount >= libmp4tag->tagcount) {
+    return;
+  }
+  if (! mp4tag_alloc_keys (libmp4tag)) {
+    return;
+  }
+
+  /* the keys are sorted rather than the tags */
+  tagkeys = libmp4tag->tagkeys;
+  for (int i = 0; i < libmp4tag->tagcount; ++i) {
+    mp4tagkey_t   *tkey = &tagkeys [i];
+
+    tkey->tag = libmp4tag->tags [i].tag == NULL ? "" : libmp4tag->tags [i].tag;
+    tkey->key = mp4tag_tag_key (tkey->tag);
+    tkey->dataidx = libmp4tag->tags [i].dataidx;
+    tkey->idx = i;
+  }
+
+  count = libmp4tag->tagsortcount;
   /* it's available in libc ... */
-  qsort (libmp4tag->tags, libmp4tag->tagcount, sizeof (mp4tag_t),
-      mp4tag_compare);
+  qsort (tagkeys + count, libmp4tag->tagcount - count, sizeof (mp4tagkey_t),
+      mp4tag_compare_key);
+
+  /* the second half of the key list receives the merged keys */
+  sorted = tagkeys + libmp4tag->tagkeyalloc;
+  a = 0;
+  b = count;
+  for (int i = 0; i < libmp4tag->tagcount; ++i) {
+    if (b >= libmp4tag->tagcount ||
+        (a < count && mp4tag_compare_key (&tagkeys [a], &tagkeys [b]) <= 0)) {
+      sorted [i] = tagkeys [a++];
+    } else {
+      sorted [i] = tagkeys [b++];
+    }
+  }
+
+  /* the tags are moved into the sorted order, one cycle at a time */
+  for (int i = 0; i < libmp4tag->tagcount; ++i) {
+    mp4tag_t    tmp;
+    int         j;
+
+    if (sorted [i].idx == i) {
+      continue;
+    }
+    tmp = libmp4tag->tags [i];
+    j = i;
+    while (sorted [j].idx != i) {
+      int     k = sorted [j].idx;
+
+      libmp4tag->tags [j] = libmp4tag->tags [k];
+      sorted [j].idx = j;
+      j = k;
+    }
+    libmp4tag->tags [j] = tmp;
+    sorted [j].idx = j;
+  }
+
   for (int i = 0; i < libmp4tag->tagcount; ++i) {
     libmp4tag->tags [i].idx = i;
   }
+  libmp4tag->tagsortcount = libmp4tag->tagcount;
+  mp4tag_index_invalidate (libmp4tag);
+}
+
+/* the key list has room for two keys for each tag, */
+/* and is only re-allocated when the tag list has grown */
+bool
+mp4tag_alloc_keys (libmp4tag_t *libmp4tag)
+{
+  mp4tagkey_t   *tagkeys;
+
+  if (libmp4tag->tagcount <= libmp4tag->tagkeyalloc) {
+    return true;
+  }
+
+  tagkeys = realloc (libmp4tag->tagkeys,
+      sizeof (mp4tagkey_t) * libmp4tag->tagalloccount * 2);
+  if (tagkeys == NULL) {
+    libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+    return false;
+  }
+  libmp4tag->tagkeys = tagkeys;
+  libmp4tag->tagkeyalloc = libmp4tag->tagalloccount;
+
+  return true;
+}
+
+/* a deleted tag is left in the tag list with no name. */
+/* the deleted tags are removed in a single pass */
+void
+mp4tag_compact_tags (libmp4tag_t *libmp4tag)
+{
+  int     count = 0;
+  int     sortcount = 0;
+
+  if (libmp4tag->tagdeleted == 0) {
+    return;
+  }
+
+  for (int i = 0; i < libmp4tag->tagcount; ++i) {
+    if (libmp4tag->tags [i].tag == NULL) {
+      continue;
+    }
+    if (i < libmp4tag->tagsortcount) {
+      /* the tags that were in order remain in order */
+      ++sortcount;
+    }
+    if (count != i) {
+      libmp4tag->tags [count] = libmp4tag->tags [i];
+    }
+    libmp4tag->tags [count].idx = count;
+    ++count;
+  }
+  for (int i = count; i < libmp4tag->tagcount; ++i) {
+    libmp4tag->tags [i].tag = NULL;
+    libmp4tag->tags [i].data = NULL;
+    libmp4tag->tags [i].covername = NULL;
+  }
+
+  libmp4tag->tagcount = count;
+  libmp4tag->tagsortcount = sortcount;
+  libmp4tag->tagdeleted = 0;
+  mp4tag_index_invalidate (libmp4tag);
 }
 
 int
@@ -94,10 +229,6 @@ mp4tag_parse_tagname (char *tag, int *pdataidx)
 int
 mp4tag_find_tag (libmp4tag_t *libmp4tag, const char *tag, int dataidx)
 {
-  mp4tag_t    key;
-  mp4tag_t    *result;
-  int         idx = MP4TAG_NOTFOUND;
-
   if (libmp4tag == NULL || libmp4tag->libmp4tagident != MP4TAG_IDENT) {
     return -1;
   }
@@ -111,99 +242,77 @@ mp4tag_find_tag (libmp4tag_t *libmp4tag, const char *tag, int dataidx)
     return -1;
   }
 
+  /* if the index cannot be built, the tag list is searched */
+  if (! libmp4tag->tagindexvalid) {
+    mp4tag_index_build (libmp4tag);
+  }
+
+  return mp4tag_locate_tag (libmp4tag, tag, dataidx);
+}
+
+/* locates a tag without changing the handle, the index is not built. */
+/* the get functions use this, as they may be called from several */
+/* threads on a parsed handle. */
+int
+mp4tag_locate_tag (libmp4tag_t *libmp4tag, const char *tag, int dataidx)
+{
+  if (tag == NULL || libmp4tag->tagcount == 0 || libmp4tag->tags == NULL) {
+    return MP4TAG_NOTFOUND;
+  }
+
   if (dataidx < 0) {
     dataidx = 0;
   }
-  key.tag = (char *) tag;
-  key.dataidx = dataidx;
-  result = bsearch (&key, libmp4tag->tags, libmp4tag->tagcount,
-      sizeof (mp4tag_t), mp4tag_compare);
 
-  if (result != NULL) {
-    idx = result->idx;
+  if (libmp4tag->tagindexvalid) {
+    return mp4tag_index_find (libmp4tag, tag, dataidx);
   }
-
-  return idx;
+  return mp4tag_scan_tags (libmp4tag, tag, dataidx);
 }
 
+/* the known tags are located using the perfect hash table */
+/* generated from mp4taglist at build time */
 NODISCARD
-mp4tagdef_t *
+const mp4tagdef_t *
 mp4tag_check_tag (const char *tag)
 {
-  mp4tagdef_t key;
-  mp4tagdef_t *result;
-  char        tmp [MP4TAG_ID_DISP_LEN];
+  const mp4taghash_t  *hent;
+  uint32_t            fourcc;
+  size_t              clen;
 
-  if (tag == NULL) {
+  if (tag == NULL || strlen (tag) < MP4TAG_ID_LEN) {
     return NULL;
   }
 
   /* note that custom tags have already been handled */
   /* but the tag could still be "covr:1:name" */
-  /* be careful with copying here */
-
-  snprintf (tmp, sizeof (tmp), "%s", tag);
-  if (memcmp (tag, boxids [MP4TAG_COVR], MP4TAG_ID_LEN) == 0) {
-    memcpy (tmp, tag, MP4TAG_ID_LEN);
-    tmp [MP4TAG_ID_LEN] = '\0';
-  }
-
-  key.tag = tmp;
-  result = bsearch (&key, mp4taglist, mp4taglistlen,
-      sizeof (mp4tagdef_t), mp4tag_compare_list);
 
-  return result;
-}
-
-/* for comparison within the list of parsed tags */
-int
-mp4tag_compare (const void *a, const void *b)
-{
-  const mp4tag_t  *ta = a;
-  const mp4tag_t  *tb = b;
-  int             rc;
-
-  if (ta->tag == NULL && tb->tag == NULL) {
-    return 0;
-  } else if (ta->tag == NULL && tb->tag != NULL) {
-    return -1;
-  } else if (ta->tag != NULL && tb->tag == NULL) {
-    return 1;
-  }
-
-  rc = strcmp (ta->tag, tb->tag);
-  if (rc == 0) {
-    /* sort by both the name and the data index */
-    if (ta->dataidx == tb->dataidx) {
-      rc = 0;
-    } else if (ta->dataidx < tb->dataidx) {
-      rc = -1;
-    } else if (ta->dataidx > tb->dataidx) {
-      rc = 1;
+  clen = strlen (COPYRIGHT_STR);
+  if (strncmp (tag, COPYRIGHT_STR, clen) == 0) {
+    /* the copyright symbol is a single byte in the identifier */
+    if (strlen (tag) < clen + MP4TAG_ID_LEN - 1) {
+      return NULL;
+    }
+    fourcc = MP4TAG_FOURCC (MP4TAG_PREFIX_CHAR, tag [clen],
+        tag [clen + 1], tag [clen + 2]);
+  } else {
+    if ((uint8_t) *tag == MP4TAG_PREFIX_CHAR ||
+        (tag [MP4TAG_ID_LEN] != '\0' &&
+        memcmp (tag, boxids [MP4TAG_COVR], MP4TAG_ID_LEN) != 0)) {
+      return NULL;
     }
+    fourcc = MP4TAG_FOURCC (tag [0], tag [1], tag [2], tag [3]);
   }
-  return rc;
-}
 
-/* for comparison within the list of valid tags */
-int
-mp4tag_compare_list (const void *a, const void *b)
-{
-  const mp4tagdef_t  *ta = a;
-  const mp4tagdef_t  *tb = b;
-
-  if (ta->tag == NULL && tb->tag == NULL) {
-    return 0;
-  }
-  if (ta->tag == NULL && tb->tag != NULL) {
-    return -1;
-  }
-  if (ta->tag != NULL && tb->tag == NULL) {
-    return 1;
+  hent = &mp4taghash [(uint32_t) (fourcc * MP4TAG_HASH_MULT) >> MP4TAG_HASH_SHIFT];
+  if (hent->idx < 0 || hent->fourcc != fourcc) {
+    return NULL;
   }
-  return strcmp (ta->tag, tb->tag);
+
+  return &mp4taglist [hent->idx];
 }
 
+/* for comparison within the list of parsed tags */
 int
 mp4tag_add_tag (libmp4tag_t *libmp4tag, const char *tag,
     const char *data, ssize_t sz, uint32_t origflag, size_t origlen,
@@ -212,10 +321,23 @@ mp4tag_add_tag (libmp4tag_t *libmp4tag, const char *tag,
   int   tagidx;
   char  *ttag;
   int   dataidx = -1;
+  bool  useview;
+  int   inpool = 0;
+
+  /* while parsing with the ilst view, the tag names and values */
+  /* are placed in the view's pool */
+  useview = libmp4tag->viewbuff != NULL && ! libmp4tag->parsed;
+  /* while parsing, the tag names and values are placed in the */
+  /* view's pool or the tag arena (see mp4tag_tag_dup) */
+  if (! libmp4tag->parsed) {
+    inpool = MP4TAG_INPOOL_TAG | MP4TAG_INPOOL_DATA | MP4TAG_INPOOL_COVERNAME;
+  }
 
   tagidx = libmp4tag->tagcount;
   if (tagidx >= libmp4tag->tagalloccount) {
-    libmp4tag->tagalloccount += 10;
+    /* the tag list is doubled in size as it grows */
+    libmp4tag->tagalloccount += libmp4tag->tagalloccount < 10 ?
+        10 : libmp4tag->tagalloccount;
     libmp4tag->tags = realloc (libmp4tag->tags,
         sizeof (mp4tag_t) * libmp4tag->tagalloccount);
     if (libmp4tag->tags == NULL) {
@@ -227,53 +349,65 @@ mp4tag_add_tag (libmp4tag_t *libmp4tag, const char *tag,
   libmp4tag->tags [tagidx].tag = NULL;
   libmp4tag->tags [tagidx].data = NULL;
   libmp4tag->tags [tagidx].covername = NULL;
+  libmp4tag->tags [tagidx].inpool = 0;
+  libmp4tag->tags [tagidx].dataoffset = 0;
+  libmp4tag->tags [tagidx].writeoffset = 0;
   libmp4tag->tags [tagidx].dataidx = 0;
   libmp4tag->tags [tagidx].binary = false;
   libmp4tag->tags [tagidx].priority = MP4TAG_PRI_MAX,
+  libmp4tag->tags [tagidx].idx = tagidx;
   /* save these off so that writing the tags back out is easier */
   libmp4tag->tags [tagidx].identtype = origflag;
   libmp4tag->tags [tagidx].internallen = origlen;
 
   if (tagidx > 0 &&
+      libmp4tag->tags [tagidx - 1].tag != NULL &&
       strcmp (libmp4tag->tags [tagidx - 1].tag, tag) == 0) {
     libmp4tag->tags [tagidx].dataidx = libmp4tag->tags [tagidx - 1].dataidx;
     ++libmp4tag->tags [tagidx].dataidx;
   }
 
-  ttag = strdup (tag);
+  ttag = mp4tag_tag_dup (libmp4tag, tag, strlen (tag));
   if (ttag == NULL) {
-    libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
     return -1;
   }
 
   mp4tag_parse_tagname (ttag, &dataidx);
-  libmp4tag->tags [tagidx].tag = strdup (ttag);
-  free (ttag);
-
-  if (libmp4tag->tags [tagidx].tag == NULL) {
-    libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
-    return -1;
+  if (useview && tagidx > 0 &&
+      mp4tag_view_owns (libmp4tag, libmp4tag->tags [tagidx - 1].tag) &&
+      strcmp (libmp4tag->tags [tagidx - 1].tag, ttag) == 0) {
+    /* the data items of a tag share the name */
+    if (mp4tag_view_owns (libmp4tag, ttag)) {
+      /* the copy was the last allocation from the pool */
+      libmp4tag->viewidx = ttag - libmp4tag->viewbuff;
+    }
+    ttag = libmp4tag->tags [tagidx - 1].tag;
   }
+  libmp4tag->tags [tagidx].tag = ttag;
+  libmp4tag->tags [tagidx].inpool |= inpool & MP4TAG_INPOOL_TAG;
   // fprintf (stdout, "add-tag: %s\n", tag);
 
   if (memcmp (tag, boxids [MP4TAG_COVR], MP4TAG_ID_LEN) == 0) {
 
     /* make sure the base tag is set properly */
-    if (libmp4tag->tags [tagidx].tag != NULL) {
-      free (libmp4tag->tags [tagidx].tag);
-    }
-    libmp4tag->tags [tagidx].tag = strdup (boxids [MP4TAG_COVR]);
-    if (libmp4tag->tags [tagidx].tag == NULL) {
-      libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
-      return -1;
+    if (strcmp (libmp4tag->tags [tagidx].tag, boxids [MP4TAG_COVR]) != 0) {
+      mp4tag_free_data (&libmp4tag->tags [tagidx],
+          libmp4tag->tags [tagidx].tag, MP4TAG_INPOOL_TAG);
+      libmp4tag->tags [tagidx].tag = mp4tag_tag_dup (libmp4tag,
+          boxids [MP4TAG_COVR], MP4TAG_ID_LEN);
+      if (libmp4tag->tags [tagidx].tag == NULL) {
+        return -1;
+      }
+      libmp4tag->tags [tagidx].inpool |= inpool & MP4TAG_INPOOL_TAG;
     }
 
     if (covername != NULL) {
-      libmp4tag->tags [tagidx].covername = strdup (covername);
+      libmp4tag->tags [tagidx].covername =
+          mp4tag_tag_dup (libmp4tag, covername, strlen (covername));
       if (libmp4tag->tags [tagidx].covername == NULL) {
-        libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
         return -1;
       }
+      libmp4tag->tags [tagidx].inpool |= inpool & MP4TAG_INPOOL_COVERNAME;
     }
 
     if (dataidx == -1) {
@@ -286,32 +420,42 @@ mp4tag_add_tag (libmp4tag_t *libmp4tag, const char *tag,
 
   if (sz == MP4TAG_STRING) {
     /* string with null terminator */
-    libmp4tag->tags [tagidx].data = strdup (data);
+    libmp4tag->tags [tagidx].datalen = strlen (data);
+    libmp4tag->tags [tagidx].data = mp4tag_tag_dup (libmp4tag, data,
+        libmp4tag->tags [tagidx].datalen);
     if (libmp4tag->tags [tagidx].data == NULL) {
-      libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
       return -1;
     }
-    libmp4tag->tags [tagidx].datalen = strlen (data);
+    libmp4tag->tags [tagidx].inpool |= inpool & MP4TAG_INPOOL_DATA;
   } else if (sz < 0) {
-    /* string w/o null terminator, cannot use strdup */
+    /* string w/o null terminator */
     sz = - sz;
-    libmp4tag->tags [tagidx].data = malloc (sz + 1);
+    libmp4tag->tags [tagidx].data = mp4tag_tag_dup (libmp4tag, data, sz);
     if (libmp4tag->tags [tagidx].data == NULL) {
-      libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
       return -1;
     }
-    memcpy (libmp4tag->tags [tagidx].data, data, sz);
-    libmp4tag->tags [tagidx].data [sz] = '\0';
+    libmp4tag->tags [tagidx].inpool |= inpool & MP4TAG_INPOOL_DATA;
     libmp4tag->tags [tagidx].datalen = sz;
   } else {
     /* binary data */
-    if (sz > 0) {
-      libmp4tag->tags [tagidx].data = malloc (sz);
+    /* if data is null, the data has not been read in yet */
+    if (useview && mp4tag_view_owns (libmp4tag, data)) {
+      /* binary data is not copied, the tag points into the ilst view */
+      libmp4tag->tags [tagidx].data =
+          libmp4tag->viewbuff + (data - libmp4tag->viewbuff);
+      libmp4tag->tags [tagidx].inpool |= MP4TAG_INPOOL_DATA;
+    } else if (sz > 0 && data != NULL) {
+      if (libmp4tag->parsed) {
+        libmp4tag->tags [tagidx].data = malloc (sz);
+      } else {
+        libmp4tag->tags [tagidx].data = mp4tag_arena_alloc (libmp4tag, sz);
+      }
       if (libmp4tag->tags [tagidx].data == NULL) {
         libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
         return -1;
       }
       memcpy (libmp4tag->tags [tagidx].data, data, sz);
+      libmp4tag->tags [tagidx].inpool |= inpool & MP4TAG_INPOOL_DATA;
     }
     libmp4tag->tags [tagidx].binary = true;
     libmp4tag->tags [tagidx].datalen = sz;
@@ -326,6 +470,7 @@ mp4tag_set_tag_string (libmp4tag_t *libmp4tag, const char *tag,
     int idx, const char *data)
 {
   char    *ttag;
+  char    *value;
   int     offset;
   int     dataidx;
 
@@ -368,12 +513,11 @@ mp4tag_set_tag_string (libmp4tag_t *libmp4tag, const char *tag,
       /* only cover filenames are allowed for set-tag-str */
 
       if (offset > 0) {
-        if (mp4tag->covername != NULL) {
-          free (mp4tag->covername);
-        }
-        mp4tag->covername = strdup (data);
-        if (mp4tag->covername == NULL) {
+        value = mp4tag_alloc_tag_value (data, 0, false);
+        if (value == NULL) {
           libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+        } else {
+          mp4tag_replace_tag_value (libmp4tag, tag, idx, value, 0, false, NULL);
         }
       } else {
         libmp4tag->mp4error = MP4TAG_ERR_MISMATCH;
@@ -389,17 +533,13 @@ mp4tag_set_tag_string (libmp4tag_t *libmp4tag, const char *tag,
         return libmp4tag->mp4error;
       }
 
-      if (mp4tag->data != NULL) {
-        free (mp4tag->data);
-      }
-      mp4tag->data = strdup (data);
-      if (mp4tag->data == NULL) {
+      value = mp4tag_alloc_tag_value (data, 0, false);
+      if (value == NULL) {
         libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
         free (ttag);
         return libmp4tag->mp4error;
-      } else {
-        mp4tag->datalen = strlen (data);
       }
+      mp4tag_replace_tag_value (libmp4tag, tag, idx, value, 0, false, NULL);
     }
   } else {
     const mp4tagdef_t *tagdef = NULL;
@@ -453,9 +593,10 @@ mp4tag_set_tag_string (libmp4tag_t *libmp4tag, const char *tag,
       tagidx = mp4tag_add_tag (libmp4tag, tag, data, MP4TAG_STRING, tflag, tlen, NULL);
       if (tagidx >= 0) {
         /* preserve the tag ordering */
-        libmp4tag->tags [tagidx].dataidx = dataidx;
+        /* a tag name without a data index is the first data item */
+        libmp4tag->tags [tagidx].dataidx = dataidx < 0 ? 0 : dataidx;
       }
-      mp4tag_sort_tags (libmp4tag);
+      mp4tag_index_add_tag (libmp4tag, tagidx);
     } else {
       libmp4tag->mp4error = MP4TAG_ERR_TAG_NOT_FOUND;
     }
@@ -470,6 +611,7 @@ mp4tag_set_tag_binary (libmp4tag_t *libmp4tag,
     const char *tag, int idx, const char *data, size_t sz, const char *fn)
 {
   int       identtype = MP4TAG_ID_DATA;
+  char      *value;
 
   if (libmp4tag == NULL || libmp4tag->libmp4tagident != MP4TAG_IDENT) {
     return MP4TAG_ERR_BAD_STRUCT;
@@ -493,23 +635,15 @@ mp4tag_set_tag_binary (libmp4tag_t *libmp4tag,
       libmp4tag->mp4error = MP4TAG_ERR_MISMATCH;
       return libmp4tag->mp4error;
     }
-    if (mp4tag->data != NULL) {
-      free (mp4tag->data);
-    }
-    mp4tag->data = malloc (sz);
-    if (mp4tag->data == NULL) {
+    value = mp4tag_alloc_tag_value (data, sz, true);
+    if (value == NULL) {
       libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
       return libmp4tag->mp4error;
     }
-
-    memcpy (mp4tag->data, data, sz);
-    mp4tag->datalen = sz;
-    mp4tag->internallen = sz;
-    identtype = mp4tag_check_covr (tag, fn);
-    mp4tag->identtype = identtype;
+    mp4tag_replace_tag_value (libmp4tag, tag, idx, value, sz, true, fn);
   } else {
-    mp4tagdef_t *tagdef = NULL;
-    bool        ok = false;
+    const mp4tagdef_t *tagdef = NULL;
+    bool              ok = false;
 
     /* a new binary data tag */
     /* check to make sure this tag exists in the valid list */
@@ -541,14 +675,172 @@ mp4tag_set_tag_binary (libmp4tag_t *libmp4tag,
 
     if (ok) {
       identtype = mp4tag_check_covr (tag, fn);
-      mp4tag_add_tag (libmp4tag, tag, data, sz, identtype, sz, NULL);
-      mp4tag_sort_tags (libmp4tag);
+      mp4tag_index_add_tag (libmp4tag,
+          mp4tag_add_tag (libmp4tag, tag, data, sz, identtype, sz, NULL));
     }
   }
 
   return libmp4tag->mp4error;
 }
 
+/* allocates the new value of an existing tag, so that the value */
+/* may be replaced without an allocation failure */
+char *
+mp4tag_alloc_tag_value (const char *data, size_t sz, bool binary)
+{
+  char    *value;
+
+  if (! binary) {
+    return strdup (data);
+  }
+
+  value = malloc (sz);
+  if (value != NULL) {
+    memcpy (value, data, sz);
+  }
+  return value;
+}
+
+/* replaces the value of the existing tag at idx with the value */
+/* from mp4tag_alloc_tag_value.  a string value for a cover image */
+/* is the cover name.  this cannot fail. */
+void
+mp4tag_replace_tag_value (libmp4tag_t *libmp4tag, const char *tag, int idx,
+    char *value, size_t sz, bool binary, const char *fn)
+{
+  mp4tag_t  *mp4tag;
+
+  mp4tag = &libmp4tag->tags [idx];
+
+  if (! binary &&
+      memcmp (tag, boxids [MP4TAG_COVR], MP4TAG_ID_LEN) == 0) {
+    mp4tag_free_data (mp4tag, mp4tag->covername, MP4TAG_INPOOL_COVERNAME);
+    mp4tag->covername = value;
+    return;
+  }
+
+  mp4tag_free_data (mp4tag, mp4tag->data, MP4TAG_INPOOL_DATA);
+  mp4tag->data = value;
+  if (! binary) {
+    mp4tag->datalen = strlen (value);
+    return;
+  }
+
+  mp4tag->datalen = sz;
+  mp4tag->dataoffset = 0;
+  mp4tag->internallen = sz;
+  mp4tag->identtype = mp4tag_check_covr (tag, fn);
+}
+
+/* checks that the tag may be set to a string or binary value, */
+/* the tag list is not changed.  the index of an existing tag */
+/* is returned in pidx, -1 if the tag is new. */
+int
+mp4tag_check_set_tag (libmp4tag_t *libmp4tag, const char *tag, bool binary,
+    int *pidx)
+{
+  const mp4tagdef_t *tagdef;
+  char              tbuff [TEMP_NM_SZ];
+  char              *ttag;
+  size_t            len;
+  int               offset;
+  int               dataidx;
+  int               idx;
+  bool              iscovr;
+
+  *pidx = -1;
+
+  /* the name is parsed in place, a copy is only allocated */
+  /* for a very long name */
+  ttag = tbuff;
+  len = strlen (tag);
+  if (len >= sizeof (tbuff)) {
+    ttag = malloc (len + 1);
+    if (ttag == NULL) {
+      return MP4TAG_ERR_OUT_OF_MEMORY;
+    }
+  }
+  memcpy (ttag, tag, len + 1);
+  offset = mp4tag_parse_tagname (ttag, &dataidx);
+  idx = mp4tag_find_tag (libmp4tag, ttag, dataidx);
+  if (ttag != tbuff) {
+    free (ttag);
+  }
+
+  iscovr = memcmp (tag, boxids [MP4TAG_COVR], MP4TAG_ID_LEN) == 0;
+
+  if (idx >= 0 && idx < libmp4tag->tagcount) {
+    *pidx = idx;
+    if (iscovr && ! binary) {
+      /* only the cover name may be set to a string */
+      return offset > 0 ? MP4TAG_OK : MP4TAG_ERR_MISMATCH;
+    }
+    if (libmp4tag->tags [idx].binary != binary) {
+      return MP4TAG_ERR_MISMATCH;
+    }
+    return MP4TAG_OK;
+  }
+
+  /* a new tag */
+
+  if (iscovr && offset > 0) {
+    /* the cover name, but no associated cover image */
+    return MP4TAG_ERR_TAG_NOT_FOUND;
+  }
+  if (binary && (strcmp (tag, boxids [MP4TAG_TRKN]) == 0 ||
+      strcmp (tag, boxids [MP4TAG_DISK]) == 0)) {
+    return MP4TAG_ERR_MISMATCH;
+  }
+
+  /* custom tags are always valid */
+  if (memcmp (tag, boxids [MP4TAG_CUSTOM], MP4TAG_ID_LEN) == 0) {
+    return MP4TAG_OK;
+  }
+
+  tagdef = mp4tag_check_tag (tag);
+  if (tagdef == NULL) {
+    return MP4TAG_ERR_TAG_NOT_FOUND;
+  }
+
+  if (binary) {
+    if (tagdef->identtype != MP4TAG_ID_DATA &&
+        tagdef->identtype != MP4TAG_ID_JPG &&
+        tagdef->identtype != MP4TAG_ID_PNG) {
+      return MP4TAG_ERR_MISMATCH;
+    }
+    return MP4TAG_OK;
+  }
+
+  /* valid: strings, numerics have string representation, trkn, disk */
+  if (tagdef->identtype != MP4TAG_ID_STRING &&
+      tagdef->identtype != MP4TAG_ID_NUM &&
+      ! (tagdef->identtype == MP4TAG_ID_DATA &&
+      (strcmp (tag, boxids [MP4TAG_TRKN]) == 0 ||
+      strcmp (tag, boxids [MP4TAG_DISK]) == 0))) {
+    return MP4TAG_ERR_MISMATCH;
+  }
+
+  return MP4TAG_OK;
+}
+
+/* the tags added after the first tagcount tags are removed */
+void
+mp4tag_truncate_tags (libmp4tag_t *libmp4tag, int tagcount)
+{
+  if (tagcount >= libmp4tag->tagcount) {
+    return;
+  }
+
+  for (int i = tagcount; i < libmp4tag->tagcount; ++i) {
+    mp4tag_free_tag (&libmp4tag->tags [i]);
+  }
+  libmp4tag->tagcount = tagcount;
+  if (libmp4tag->tagsortcount > tagcount) {
+    libmp4tag->tagsortcount = tagcount;
+  }
+  mp4tag_index_invalidate (libmp4tag);
+}
+
 void
 mp4tag_del_tag (libmp4tag_t *libmp4tag, int idx)
 {
@@ -563,23 +855,16 @@ mp4tag_del_tag (libmp4tag_t *libmp4tag, int idx)
     return;
   }
 
-  mp4tag_free_tag_by_idx (libmp4tag, idx);
-
-  for (int i = idx; i < libmp4tag->tagcount; ++i) {
-    int     next;
-
-    next = i + 1;
-    if (next < libmp4tag->tagcount) {
-      libmp4tag->tags [i] = libmp4tag->tags [next];
-    }
+  if (libmp4tag->tags [idx].tag == NULL) {
+    /* already deleted */
+    return;
   }
 
-  libmp4tag->tagcount -= 1;
-  libmp4tag->tags [libmp4tag->tagcount].tag = NULL;
-  libmp4tag->tags [libmp4tag->tagcount].data = NULL;
-  for (int i = 0; i < libmp4tag->tagcount; ++i) {
-    libmp4tag->tags [i].idx = i;
-  }
+  /* the tag is left in place with no name, and is removed when */
+  /* the tag list is compacted */
+  mp4tag_index_remove (libmp4tag, idx);
+  mp4tag_free_tag_by_idx (libmp4tag, idx);
+  libmp4tag->tagdeleted += 1;
 }
 
 void
@@ -603,23 +888,43 @@ void
 mp4tag_free_tag (mp4tag_t *mp4tag)
 {
   if (mp4tag->tag != NULL) {
-    free (mp4tag->tag);
+    mp4tag_free_data (mp4tag, mp4tag->tag, MP4TAG_INPOOL_TAG);
     mp4tag->tag = NULL;
   }
   if (mp4tag->data != NULL) {
-    free (mp4tag->data);
+    mp4tag_free_data (mp4tag, mp4tag->data, MP4TAG_INPOOL_DATA);
     mp4tag->data = NULL;
     mp4tag->datalen = 0;
   }
+  mp4tag->dataoffset = 0;
   if (mp4tag->covername != NULL) {
-    free (mp4tag->covername);
+    mp4tag_free_data (mp4tag, mp4tag->covername, MP4TAG_INPOOL_COVERNAME);
     mp4tag->covername = NULL;
   }
 }
 
+/* frees a tag name or value, unless it is located in the ilst view */
+/* or the tag arena. inpool is the MP4TAG_INPOOL_* flag for the data, */
+/* the caller replaces the data. */
+void
+mp4tag_free_data (mp4tag_t *mp4tag, void *data, int inpool)
+{
+  if ((mp4tag->inpool & inpool) == inpool) {
+    /* released when the tags are freed */
+    mp4tag->inpool &= ~ inpool;
+    return;
+  }
+  if (data == NULL) {
+    return;
+  }
+  free (data);
+}
+
 void
 mp4tag_clone_tag (libmp4tag_t *libmp4tag, mp4tag_t *target, mp4tag_t *source)
 {
+  int     rc;
+
   target->tag = NULL;
   if (source->tag != NULL) {
     target->tag = strdup (source->tag);
@@ -629,6 +934,15 @@ mp4tag_clone_tag (libmp4tag_t *libmp4tag, mp4tag_t *target, mp4tag_t *source)
   }
 
   target->datalen = source->datalen;
+  target->dataoffset = 0;
+  target->writeoffset = 0;
+
+  /* the clone may be used with a different file, */
+  /* so the data must be read in */
+  rc = mp4tag_load_tag_data (libmp4tag, source);
+  if (rc != MP4TAG_OK) {
+    libmp4tag->mp4error = rc;
+  }
 
   target->data = NULL;
   if (source->datalen > 0 && source->data != NULL) {
@@ -655,6 +969,7 @@ mp4tag_clone_tag (libmp4tag_t *libmp4tag, mp4tag_t *target, mp4tag_t *source)
     }
   }
 
+  target->inpool = 0;
   target->dataidx = source->dataidx;
   target->idx = source->idx;
   target->identtype = source->identtype;
@@ -663,6 +978,107 @@ mp4tag_clone_tag (libmp4tag_t *libmp4tag, mp4tag_t *target, mp4tag_t *source)
   target->binary = source->binary;
 }
 
+/* reads in the binary data that was not read during the parse. */
+/* this is called by the get functions, which may be called from */
+/* several threads on a parsed handle.  the data is published with */
+/* a single compare-and-swap, if another thread has already loaded */
+/* the data, this copy is discarded.  the file offset is left as is, */
+/* the data is used when it is present. */
+/* the error is returned, it is not stored in the handle. */
+int
+mp4tag_load_tag_data (libmp4tag_t *libmp4tag, mp4tag_t *mp4tag)
+{
+  char    *data;
+  char    *expected = NULL;
+
+  if (__atomic_load_n (&mp4tag->data, __ATOMIC_ACQUIRE) != NULL ||
+      mp4tag->dataoffset == 0) {
+    return MP4TAG_OK;
+  }
+
+  if (libmp4tag->fh == NULL) {
+    return MP4TAG_ERR_NOT_OPEN;
+  }
+
+  data = malloc (mp4tag->datalen);
+  if (data == NULL) {
+    return MP4TAG_ERR_OUT_OF_MEMORY;
+  }
+
+  if (mp4tag_pread (libmp4tag->fh, data, mp4tag->datalen,
+      mp4tag->dataoffset) != mp4tag->datalen) {
+    free (data);
+    return MP4TAG_ERR_FILE_READ_ERROR;
+  }
+
+  if (! __atomic_compare_exchange_n (&mp4tag->data, &expected, data,
+      false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    free (data);
+  }
+  return MP4TAG_OK;
+}
+
+/* returns true if the tag is in the tag filter, */
+/* or if there is no tag filter */
+/* a filter entry ending with a colon matches any tag with that prefix */
+bool
+mp4tag_filter_tag (libmp4tag_t *libmp4tag, const char *tag)
+{
+  size_t    len;
+
+  if (libmp4tag->filtercount == 0) {
+    return true;
+  }
+
+  for (int i = 0; i < libmp4tag->filtercount; ++i) {
+    if (strcmp (libmp4tag->filter [i], tag) == 0) {
+      return true;
+    }
+    len = strlen (libmp4tag->filter [i]);
+    if (len > 0 &&
+        libmp4tag->filter [i][len - 1] == *MP4TAG_INPUT_DELIM &&
+        strncmp (libmp4tag->filter [i], tag, len) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* returns true if the 'ilst' child box may hold a tag */
+/* that is in the tag filter */
+bool
+mp4tag_filter_box (libmp4tag_t *libmp4tag, const char *boxnm)
+{
+  char    tnm [MP4TAG_ID_DISP_LEN];
+
+  if (libmp4tag->filtercount == 0) {
+    return true;
+  }
+
+  /* the full name of a custom tag is not known until the */
+  /* box is read */
+  if (strcmp (boxnm, boxids [MP4TAG_CUSTOM]) == 0) {
+    for (int i = 0; i < libmp4tag->filtercount; ++i) {
+      if (memcmp (libmp4tag->filter [i], boxids [MP4TAG_CUSTOM],
+          MP4TAG_ID_LEN) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /* the 'gnre' tag is converted to '©gen' */
+  if (strcmp (boxnm, boxids [MP4TAG_GNRE]) == 0) {
+    snprintf (tnm, sizeof (tnm), "%s%s", COPYRIGHT_STR, boxids [MP4TAG_GEN]);
+    if (mp4tag_filter_tag (libmp4tag, tnm)) {
+      return true;
+    }
+  }
+
+  return mp4tag_filter_tag (libmp4tag, boxnm);
+}
+
 void
 mp4tag_sleep (uint32_t ms)
 {
@@ -745,3 +1161,121 @@ mp4tag_check_covr (const char *tag, const char *fn)
 
   return identtype;
 }
+
+/* copies a tag name or string value. */
+/* while parsing, the copy is placed in the ilst view's pool */
+/* or the tag arena */
+static char *
+mp4tag_tag_dup (libmp4tag_t *libmp4tag, const char *str, size_t len)
+{
+  char    *p;
+
+  if (libmp4tag->viewbuff != NULL && ! libmp4tag->parsed) {
+    return mp4tag_view_dup (libmp4tag, str, len);
+  }
+  if (! libmp4tag->parsed) {
+    return mp4tag_arena_dup (libmp4tag, str, len);
+  }
+
+  p = malloc (len + 1);
+  if (p == NULL) {
+    libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+    return NULL;
+  }
+  memcpy (p, str, len);
+  p [len] = '\0';
+
+  return p;
+}
+
+/* copies a string into the ilst view's pool */
+/* if the pool is full, the string is placed in the tag arena */
+static char *
+mp4tag_view_dup (libmp4tag_t *libmp4tag, const char *str, size_t len)
+{
+  char    *p;
+
+  if (libmp4tag->viewalloc - libmp4tag->viewidx <= len) {
+    return mp4tag_arena_dup (libmp4tag, str, len);
+  }
+
+  p = libmp4tag->viewbuff + libmp4tag->viewidx;
+  libmp4tag->viewidx += len + 1;
+  memcpy (p, str, len);
+  p [len] = '\0';
+
+  return p;
+}
+
+static bool
+mp4tag_view_owns (libmp4tag_t *libmp4tag, const char *ptr)
+{
+  uintptr_t   uptr = (uintptr_t) ptr;
+  uintptr_t   ubuff = (uintptr_t) libmp4tag->viewbuff;
+
+  if (libmp4tag->viewbuff == NULL) {
+    return false;
+  }
+  return uptr >= ubuff && uptr < ubuff + libmp4tag->viewalloc;
+}
+
+/* the first four bytes of the tag name, the remainder is zero filled */
+static uint32_t
+mp4tag_tag_key (const char *tag)
+{
+  uint32_t    key = 0;
+
+  for (int i = 0; i < MP4TAG_ID_LEN; ++i) {
+    key <<= 8;
+    if (*tag) {
+      key |= (unsigned char) *tag++;
+    }
+  }
+
+  return key;
+}
+
+/* sorts by the tag name, then the data index */
+static int
+mp4tag_compare_key (const void *a, const void *b)
+{
+  const mp4tagkey_t   *ka = a;
+  const mp4tagkey_t   *kb = b;
+  int                 rc;
+
+  if (ka->key != kb->key) {
+    return ka->key < kb->key ? -1 : 1;
+  }
+  if ((ka->key & 0xff) != 0) {
+    /* the names are longer than the key (custom tags) */
+    rc = strcmp (ka->tag + MP4TAG_ID_LEN, kb->tag + MP4TAG_ID_LEN);
+    if (rc != 0) {
+      return rc;
+    }
+  }
+  if (ka->dataidx != kb->dataidx) {
+    return ka->dataidx < kb->dataidx ? -1 : 1;
+  }
+  /* the order of identical tags does not change */
+  if (ka->idx != kb->idx) {
+    return ka->idx < kb->idx ? -1 : 1;
+  }
+  return 0;
+}
+
+/* the index is not valid, the tag list is searched */
+static int
+mp4tag_scan_tags (libmp4tag_t *libmp4tag, const char *tag, int dataidx)
+{
+  for (int i = 0; i < libmp4tag->tagcount; ++i) {
+    const mp4tag_t  *mp4tag = &libmp4tag->tags [i];
+
+    if (mp4tag->tag != NULL &&
+        mp4tag->dataidx == dataidx &&
+        strcmp (mp4tag->tag, tag) == 0) {
+      return i;
+    }
+  }
+
+  return MP4TAG_NOTFOUND;
+}
@@ -16,71 +16,176 @@
 #include "mp4tagbe.h"
 #include "nodiscard.h"
 
-static const char *MP4TAG_CUSTOM_DELIM = ":";
-static const char *MP4TAG_TEMP_SUFFIX = "-mp4tag.tmp";
-static const char *MP4TAG_BACKUP_SUFFIX = "-mp4tag.bak";
+static const char * const MP4TAG_CUSTOM_DELIM = ":";
+static const char * const MP4TAG_TEMP_SUFFIX = "-mp4tag.tmp";
+static const char * const MP4TAG_BACKUP_SUFFIX = "-mp4tag.bak";
 
-static int  mp4tag_write_inplace (libmp4tag_t *libmp4tag, const char *data, uint32_t datalen);
-static int  mp4tag_write_rewrite (libmp4tag_t *libmp4tag, const char *data, uint32_t datalen);
-static int  mp4tag_write_freebox (libmp4tag_t *libmp4tag, FILE *ofh, uint32_t freelen);
+/* the parts of a tag's name used by the writer */
+typedef struct {
+  const char  *appname;
+  size_t      appnamelen;
+  const char  *customname;
+  size_t      customnamelen;
+  uint32_t    savelen;
+  char        tnm [MP4TAG_ID_LEN + 1];
+  bool        iscustom;
+} mp4tagbuild_t;
+
+static int  mp4tag_write_inplace (libmp4tag_t *libmp4tag, mp4tagilst_t *ilst);
+static int  mp4tag_write_rewrite (libmp4tag_t *libmp4tag, mp4tagilst_t *ilst);
+static int  mp4tag_write_ilst (libmp4tag_t *libmp4tag, FILE *ofh, mp4tagilst_t *ilst, int64_t woffset);
+static int  mp4tag_read_moved_data (libmp4tag_t *libmp4tag, mp4tagilst_t *ilst, int64_t woffset);
+static int  mp4tag_write_freebox (libmp4tag_t *libmp4tag, FILE *ofh, int64_t woffset, uint32_t freelen);
 static void mp4tag_update_offsets (libmp4tag_t *libmp4tag, FILE *ofh, int32_t delta, uint64_t foffset);
-static void mp4tag_update_offset_block (libmp4tag_t *libmp4tag, FILE *ofh, int32_t delta, uint64_t foffset, uint64_t boffset, uint32_t blen, int offsetsz);
-static char * mp4tag_build_append (libmp4tag_t *libmp4tag, int idx, char *data, uint32_t *dlen);
+static void mp4tag_update_offset_group (libmp4tag_t *libmp4tag, FILE *ofh, int32_t delta, uint64_t foffset, mp4tagcotable_t *cotables, int count);
+static void mp4tag_update_offset_block (libmp4tag_t *libmp4tag, int32_t delta, uint64_t foffset, char *buff, uint32_t blen, int offsetsz);
+static uint32_t mp4tag_build_len (libmp4tag_t *libmp4tag, mp4tag_t *mp4tag, mp4tagbuild_t *build);
+static uint32_t mp4tag_build_ref (mp4tag_t *mp4tag, mp4tagbuild_t *build);
+static void mp4tag_build_append (libmp4tag_t *libmp4tag, int idx, mp4tagilst_t *ilst);
+static void mp4tag_build_iov (mp4tagilst_t *ilst, const char *data, int64_t offset, size_t len);
 static void mp4tag_parse_pair (const char *data, int *a, int *b);
 static char * mp4tag_append_data (char *dptr, const char *tnm, uint32_t sz);
+static char * mp4tag_append_binary (libmp4tag_t *libmp4tag, char *dptr, mp4tag_t *mp4tag, uint32_t doffset);
+static char * mp4tag_append_ref (mp4tagilst_t *ilst, char *dptr, mp4tag_t *mp4tag, uint32_t doffset);
 static char * mp4tag_append_len_8 (char *dptr, uint64_t val);
 static char * mp4tag_append_len_16 (char *dptr, uint64_t val);
 static char * mp4tag_append_len_32 (char *dptr, uint64_t val);
 static char * mp4tag_append_len_64 (char *dptr, uint64_t val);
 static void mp4tag_update_data_len (libmp4tag_t *libmp4tag, char *data, uint32_t len);
-static int  mp4tag_copy_file_data (FILE *ifh, FILE *ofh, int64_t offset, size_t len);
+static int  mp4tag_copy_file_data (FILE *ifh, FILE *ofh, int64_t offset, size_t len, int64_t woffset);
 static void mp4tag_debug_write_vals (libmp4tag_t *libmp4tag, uint32_t datalen, int32_t delta, int32_t totdelta, int32_t freelen);
 
-/* if there are no tags, null will be returned. */
-NODISCARD
-char *
-mp4tag_build_data (libmp4tag_t *libmp4tag, uint32_t *datalen)
+/* the box headers and the smaller values are built in ilst->buff, */
+/* the larger values are written from the tags or copied from the file. */
+/* if there are no tags, the ilst data will be empty. */
+int
+mp4tag_build_data (libmp4tag_t *libmp4tag, mp4tagilst_t *ilst)
 {
-  char        *data = NULL;
-
-  *datalen = 0;
+  uint32_t    bufflen = 0;
+  int         iovmax = 1;
+  int         count [MP4TAG_PRI_MAX + 1];
+  int         tagcount = 0;
+
+  ilst->iov = NULL;
+  ilst->iovcount = 0;
+  ilst->buff = NULL;
+  ilst->bufflen = 0;
+  ilst->datalen = 0;
+
+  mp4tag_sort_tags (libmp4tag);
+  if (! mp4tag_alloc_keys (libmp4tag)) {
+    return libmp4tag->mp4error;
+  }
 
+  for (int pri = 0; pri <= MP4TAG_PRI_MAX; ++pri) {
+    count [pri] = 0;
+  }
   for (int i = 0; i < libmp4tag->tagcount; ++i) {
     const mp4tagdef_t   *result = NULL;
+    mp4tag_t            *mp4tag = &libmp4tag->tags [i];
 
-    if (memcmp (libmp4tag->tags [i].tag, boxids [MP4TAG_CUSTOM], MP4TAG_ID_LEN) == 0) {
-      libmp4tag->tags [i].priority = MP4TAG_PRI_CUSTOM;
+    if (memcmp (mp4tag->tag, boxids [MP4TAG_CUSTOM], MP4TAG_ID_LEN) == 0) {
+      mp4tag->priority = MP4TAG_PRI_CUSTOM;
     } else {
-      result = mp4tag_check_tag (libmp4tag->tags [i].tag);
+      result = mp4tag_check_tag (mp4tag->tag);
       if (result != NULL) {
-        libmp4tag->tags [i].priority = result->priority;
+        mp4tag->priority = result->priority;
       } else {
         /* unknown tag */
-        libmp4tag->tags [i].priority = MP4TAG_PRI_CUSTOM;
+        mp4tag->priority = MP4TAG_PRI_CUSTOM;
       }
     }
+    if (mp4tag->priority >= 0 && mp4tag->priority < MP4TAG_PRI_MAX) {
+      count [mp4tag->priority + 1] += 1;
+      ++tagcount;
+    }
+  }
+
+  /* tags are written by priority order, then ascii order. */
+  /* the key list holds the write order */
+  for (int pri = 1; pri <= MP4TAG_PRI_MAX; ++pri) {
+    count [pri] += count [pri - 1];
+  }
+  for (int i = 0; i < libmp4tag->tagcount; ++i) {
+    int     pri = libmp4tag->tags [i].priority;
+
+    if (pri >= 0 && pri < MP4TAG_PRI_MAX) {
+      libmp4tag->tagkeys [count [pri]].idx = i;
+      count [pri] += 1;
+    }
   }
 
-  /* mp4tag_build_append will take care of re-setting datacount and lastbox */
+  /* the space needed for all of the tags is determined first, */
+  /* so that the buffer is only allocated once. */
+  /* each value that is not copied to the buffer adds a part, */
+  /* and ends the part before it. */
+  /* mp4tag_build_len will take care of re-setting datacount and lastbox */
   libmp4tag->datacount = 0;
   libmp4tag->lastbox_offset = -1;
   *libmp4tag->lastbox_nm = '\0';
-  /* tags are written by priority order, then ascii order */
-  for (int pri = 0; pri < MP4TAG_PRI_MAX; ++pri) {
-    for (int i = 0; i < libmp4tag->tagcount; ++i) {
-      if (libmp4tag->tags [i].priority == pri) {
-        data = mp4tag_build_append (libmp4tag, i, data, datalen);
+  for (int i = 0; i < tagcount; ++i) {
+    mp4tag_t      *mp4tag;
+    mp4tagbuild_t build;
+    uint32_t      tlen;
+    uint32_t      reflen;
+
+    mp4tag = &libmp4tag->tags [libmp4tag->tagkeys [i].idx];
+    tlen = mp4tag_build_len (libmp4tag, mp4tag, &build);
+    if (tlen > 0) {
+      reflen = mp4tag_build_ref (mp4tag, &build);
+      bufflen += tlen - reflen;
+      if (reflen > 0) {
+        iovmax += 2;
       }
+      libmp4tag->datacount += 1;
     }
   }
+  if (bufflen == 0) {
+    return libmp4tag->mp4error;
+  }
+
+  /* the buffer follows the list of parts */
+  ilst->iov = malloc (sizeof (mp4tagiov_t) * iovmax + bufflen);
+  if (ilst->iov == NULL) {
+    libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+    return libmp4tag->mp4error;
+  }
+  ilst->buff = (char *) (ilst->iov + iovmax);
+
+  libmp4tag->datacount = 0;
+  libmp4tag->lastbox_offset = -1;
+  *libmp4tag->lastbox_nm = '\0';
+  for (int i = 0; i < tagcount; ++i) {
+    mp4tag_build_append (libmp4tag, libmp4tag->tagkeys [i].idx, ilst);
+  }
 
-  return data;
+  return libmp4tag->mp4error;
+}
+
+void
+mp4tag_free_build_data (mp4tagilst_t *ilst)
+{
+  if (ilst->iov == NULL) {
+    return;
+  }
+
+  for (int i = 0; i < ilst->iovcount; ++i) {
+    if (ilst->iov [i].alloc) {
+      free ((void *) ilst->iov [i].data);
+    }
+  }
+  free (ilst->iov);
+  ilst->iov = NULL;
+  ilst->iovcount = 0;
+  ilst->buff = NULL;
+  ilst->bufflen = 0;
+  ilst->datalen = 0;
 }
 
 int
-mp4tag_write_data (libmp4tag_t *libmp4tag, const char *data,
-    uint32_t datalen)
+mp4tag_write_data (libmp4tag_t *libmp4tag, mp4tagilst_t *ilst)
 {
+  uint32_t datalen = ilst->datalen;
   int32_t  tlen = 0;
 
   /* tlen is the maximum size of an 'ilst' with a free block */
@@ -109,21 +214,34 @@ mp4tag_write_data (libmp4tag_t *libmp4tag, const char *data,
     if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
       fprintf (stdout, "-- write: in-place\n");
     }
-    mp4tag_write_inplace (libmp4tag, data, datalen);
+    mp4tag_write_inplace (libmp4tag, ilst);
   } else {
     if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
       fprintf (stdout, "-- write: rewrite\n");
     }
-    mp4tag_write_rewrite (libmp4tag, data, datalen);
+    mp4tag_write_rewrite (libmp4tag, ilst);
+  }
+
+  if (libmp4tag->mp4error == MP4TAG_OK && libmp4tag->taglist_offset != 0) {
+    /* the binary data that has not been read in has been moved */
+    /* to the new tag list */
+    for (int i = 0; i < libmp4tag->tagcount; ++i) {
+      mp4tag_t    *mp4tag;
+
+      mp4tag = &libmp4tag->tags [i];
+      if (mp4tag->data == NULL && mp4tag->dataoffset != 0) {
+        mp4tag->dataoffset = libmp4tag->taglist_offset + mp4tag->writeoffset;
+      }
+    }
   }
 
   return libmp4tag->mp4error;
 }
 
 static int
-mp4tag_write_inplace (libmp4tag_t *libmp4tag, const char *data,
-    uint32_t datalen)
+mp4tag_write_inplace (libmp4tag_t *libmp4tag, mp4tagilst_t *ilst)
 {
+  uint32_t  datalen = ilst->datalen;
   int32_t   delta;      /* change in 'ilst' size */
   int32_t   freelen;
   int32_t   totdelta;   /* change in delta + freelen */
@@ -145,7 +263,7 @@ mp4tag_write_inplace (libmp4tag_t *libmp4tag, const char *data,
       return libmp4tag->mp4error;
     }
 
-    rc = mp4tag_copy_file_data (libmp4tag->fh, ofh, 0, libmp4tag->filesz);
+    rc = mp4tag_copy_file_data (libmp4tag->fh, ofh, 0, libmp4tag->filesz, 0);
     if (rc != MP4TAG_OK) {
       libmp4tag->mp4error = rc;
       return libmp4tag->mp4error;
@@ -155,14 +273,13 @@ mp4tag_write_inplace (libmp4tag_t *libmp4tag, const char *data,
     fclose (ofh);
   }
 
-  if (mp4tag_fseek (libmp4tag->fh, libmp4tag->taglist_offset, SEEK_SET) != 0) {
-    libmp4tag->mp4error = MP4TAG_ERR_FILE_SEEK_ERROR;
-    return libmp4tag->mp4error;
-  }
-
   if (datalen > 0) {
-    if (fwrite (data, datalen, 1, libmp4tag->fh) != 1) {
-      libmp4tag->mp4error = MP4TAG_ERR_FILE_WRITE_ERROR;
+    int     rc;
+
+    rc = mp4tag_write_ilst (libmp4tag, libmp4tag->fh, ilst,
+        libmp4tag->taglist_offset);
+    if (rc != MP4TAG_OK) {
+      libmp4tag->mp4error = rc;
       return libmp4tag->mp4error;
     }
   }
@@ -222,7 +339,9 @@ mp4tag_write_inplace (libmp4tag_t *libmp4tag, const char *data,
     if (freelen > 8) {
       int     rc;
 
-      rc = mp4tag_write_freebox (libmp4tag, libmp4tag->fh, freelen);
+      /* the free box follows the tag data */
+      rc = mp4tag_write_freebox (libmp4tag, libmp4tag->fh,
+          libmp4tag->taglist_offset + datalen, freelen);
       if (rc != MP4TAG_OK) {
         libmp4tag->mp4error = rc;
         return libmp4tag->mp4error;
@@ -233,20 +352,14 @@ mp4tag_write_inplace (libmp4tag_t *libmp4tag, const char *data,
   /* re-write the taglist length */
   if (delta != 0) {
     uint32_t    t32;
-    int         rc;
-
-    rc = mp4tag_fseek (libmp4tag->fh, libmp4tag->taglist_base_offset, SEEK_SET);
-    if (rc != 0) {
-      libmp4tag->mp4error = MP4TAG_ERR_FILE_SEEK_ERROR;
-      return libmp4tag->mp4error;
-    }
 
     t32 = datalen + MP4TAG_BOXHEAD_SZ;
     if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
       fprintf (stdout, "update taglist len: %d\n", t32);
     }
     t32 = htobe32 (t32);
-    if (fwrite (&t32, sizeof (uint32_t), 1, libmp4tag->fh) != 1) {
+    if (mp4tag_pwrite (libmp4tag->fh, &t32, sizeof (uint32_t),
+        libmp4tag->taglist_base_offset) != sizeof (uint32_t)) {
       libmp4tag->mp4error = MP4TAG_ERR_FILE_WRITE_ERROR;
     }
   }
@@ -262,13 +375,14 @@ mp4tag_write_inplace (libmp4tag_t *libmp4tag, const char *data,
 }
 
 static int
-mp4tag_write_rewrite (libmp4tag_t *libmp4tag, const char *data,
-    uint32_t datalen)
+mp4tag_write_rewrite (libmp4tag_t *libmp4tag, mp4tagilst_t *ilst)
 {
+  uint32_t  datalen = ilst->datalen;
   FILE      *ofh;
   char      ofn [2048];
   int       rc;
   uint64_t  offset;
+  int64_t   woffset;    /* output file offset */
   size_t    wlen;
   int32_t   freelen;
   int32_t   delta;
@@ -309,7 +423,8 @@ mp4tag_write_rewrite (libmp4tag_t *libmp4tag, const char *data,
   if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
     fprintf (stdout, "  copy-data: length:%" PRId64 "\n", offset);
   }
-  rc = mp4tag_copy_file_data (libmp4tag->fh, ofh, 0, offset);
+  rc = mp4tag_copy_file_data (libmp4tag->fh, ofh, 0, offset, 0);
+  woffset = offset;
 
   if (rc == MP4TAG_OK && libmp4tag->taglist_offset == 0) {
     char    *buff;
@@ -377,43 +492,48 @@ mp4tag_write_rewrite (libmp4tag_t *libmp4tag, const char *data,
       dptr = mp4tag_append_len_32 (dptr, len);
       dptr = mp4tag_append_data (dptr, boxids [MP4TAG_ILST], MP4TAG_ID_LEN);
 
-      if (fwrite (buff, alloclen, 1, ofh) != 1) {
+      if (mp4tag_pwrite (ofh, buff, alloclen, woffset) != alloclen) {
         rc = MP4TAG_ERR_FILE_WRITE_ERROR;
       }
+      woffset += alloclen;
       free (buff);
     }
   }
 
   if (rc == MP4TAG_OK && libmp4tag->taglist_offset != 0) {
+    char        head [MP4TAG_BOXHEAD_SZ];
     uint32_t    t32;
 
     t32 = datalen + MP4TAG_BOXHEAD_SZ;
     if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
       fprintf (stdout, "  ilst size w/head: %d\n", t32);
     }
-    t32 = htobe32 (t32);
-    if (fwrite (&t32, sizeof (uint32_t), 1, ofh) != 1) {
-      rc = MP4TAG_ERR_FILE_WRITE_ERROR;
-    }
-    if (fwrite (boxids [MP4TAG_ILST], MP4TAG_ID_LEN, 1, ofh) != 1) {
+    mp4tag_append_data (mp4tag_append_len_32 (head, t32),
+        boxids [MP4TAG_ILST], MP4TAG_ID_LEN);
+    if (mp4tag_pwrite (ofh, head, sizeof (head), woffset) != sizeof (head)) {
       rc = MP4TAG_ERR_FILE_WRITE_ERROR;
     }
+    woffset += sizeof (head);
   }
 
   if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
-    fprintf (stdout, "  data-offset: % " PRId64 "\n", mp4tag_ftell (ofh));
+    fprintf (stdout, "  data-offset: % " PRId64 "\n", woffset);
     fprintf (stdout, "  tags: %ld\n", (long) datalen);
   }
-  if (rc == MP4TAG_OK && fwrite (data, datalen, 1, ofh) != 1) {
-    rc = MP4TAG_ERR_FILE_WRITE_ERROR;
+  if (rc == MP4TAG_OK) {
+    rc = mp4tag_write_ilst (libmp4tag, ofh, ilst, woffset);
   }
+  woffset += datalen;
 
   if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
     fprintf (stdout, "  free-box: %d\n", MP4TAG_BOXHEAD_SZ + libmp4tag->freespacesz);
   }
 
   freelen = MP4TAG_BOXHEAD_SZ + libmp4tag->freespacesz;
-  rc = mp4tag_write_freebox (libmp4tag, ofh, freelen);
+  if (rc == MP4TAG_OK) {
+    rc = mp4tag_write_freebox (libmp4tag, ofh, woffset, freelen);
+  }
+  woffset += freelen;
 
   offset = libmp4tag->after_ilst_offset;
   wlen = libmp4tag->filesz - offset;
@@ -422,14 +542,14 @@ mp4tag_write_rewrite (libmp4tag_t *libmp4tag, const char *data,
     fprintf (stdout, "  copy-final-data: i-offset:%" PRId64 " length:%ld\n", offset, (long) wlen);
   }
   if (rc == MP4TAG_OK) {
-    rc = mp4tag_copy_file_data (libmp4tag->fh, ofh, offset, wlen);
+    rc = mp4tag_copy_file_data (libmp4tag->fh, ofh, offset, wlen, woffset);
   }
 
   /* want a signed value */
+  /* the taglist length includes any free space that was consolidated, */
+  /* all of it is replaced by the new free box */
   delta = (int32_t) datalen - (int32_t) libmp4tag->taglist_len;
   delta += freelen;
-  /* the delta does not include the interior free space */
-  delta -= libmp4tag->interior_free_len;
 
   if (libmp4tag->taglist_offset == 0) {
     /* if the udta & etc. were inserted, adjust the delta size */
@@ -440,7 +560,9 @@ mp4tag_write_rewrite (libmp4tag_t *libmp4tag, const char *data,
   mp4tag_debug_write_vals (libmp4tag, datalen, delta, -1, freelen);
 
   if (rc == MP4TAG_OK) {
-    mp4tag_update_parent_lengths (libmp4tag, ofh, delta);
+    /* the exterior free space was not a part of the parent boxes */
+    mp4tag_update_parent_lengths (libmp4tag, ofh,
+        delta + libmp4tag->exterior_free_len);
     mp4tag_update_offsets (libmp4tag, ofh, delta, offset);
   }
 
@@ -477,8 +599,86 @@ mp4tag_write_rewrite (libmp4tag_t *libmp4tag, const char *data,
   return libmp4tag->mp4error;
 }
 
+/* writes the tag data to ofh at woffset. */
+/* the values that were not read in are copied from the original file. */
 static int
-mp4tag_write_freebox (libmp4tag_t *libmp4tag, FILE *ofh, uint32_t freelen)
+mp4tag_write_ilst (libmp4tag_t *libmp4tag, FILE *ofh, mp4tagilst_t *ilst,
+    int64_t woffset)
+{
+  mp4tagiov_t   *iov = ilst->iov;
+  int           rc = MP4TAG_OK;
+  int           first = 0;
+  int64_t       foffset = woffset;    /* output offset of iov [first] */
+
+  if (ofh == libmp4tag->fh) {
+    /* an in-place write */
+    rc = mp4tag_read_moved_data (libmp4tag, ilst, woffset);
+  }
+
+  for (int i = 0; rc == MP4TAG_OK && i <= ilst->iovcount; ++i) {
+    if (i < ilst->iovcount && iov [i].data != NULL) {
+      woffset += iov [i].len;
+      continue;
+    }
+
+    /* the parts in memory before this part */
+    if (i > first &&
+        mp4tag_pwritev (ofh, iov + first, i - first, foffset) !=
+        (size_t) (woffset - foffset)) {
+      rc = MP4TAG_ERR_FILE_WRITE_ERROR;
+    }
+
+    if (rc == MP4TAG_OK && i < ilst->iovcount) {
+      /* for an in-place write, any part remaining in the file */
+      /* is already in its place */
+      if (ofh != libmp4tag->fh) {
+        rc = mp4tag_copy_file_data (libmp4tag->fh, ofh,
+            iov [i].offset, iov [i].len, woffset);
+      }
+      woffset += iov [i].len;
+    }
+    first = i + 1;
+    foffset = woffset;
+  }
+
+  return rc;
+}
+
+/* for an in-place write, the values that were not read in and */
+/* have moved must be read before any of the tag data is written, */
+/* as the new tag data may overwrite their old location */
+static int
+mp4tag_read_moved_data (libmp4tag_t *libmp4tag, mp4tagilst_t *ilst,
+    int64_t woffset)
+{
+  for (int i = 0; i < ilst->iovcount; ++i) {
+    mp4tagiov_t   *iov = &ilst->iov [i];
+    char          *data;
+
+    if (iov->data != NULL || iov->offset == woffset) {
+      woffset += iov->len;
+      continue;
+    }
+
+    data = malloc (iov->len);
+    if (data == NULL) {
+      return MP4TAG_ERR_OUT_OF_MEMORY;
+    }
+    if (mp4tag_pread (libmp4tag->fh, data, iov->len, iov->offset) != iov->len) {
+      free (data);
+      return MP4TAG_ERR_FILE_READ_ERROR;
+    }
+    iov->data = data;
+    iov->alloc = true;
+    woffset += iov->len;
+  }
+
+  return MP4TAG_OK;
+}
+
+static int
+mp4tag_write_freebox (libmp4tag_t *libmp4tag, FILE *ofh, int64_t woffset,
+    uint32_t freelen)
 {
   char        *buff;
   uint32_t    t32;
@@ -494,7 +694,7 @@ mp4tag_write_freebox (libmp4tag_t *libmp4tag, FILE *ofh, uint32_t freelen)
   t32 = htobe32 (freelen);
   memcpy (buff, &t32, sizeof (uint32_t));
   memcpy (buff + sizeof (uint32_t), boxids [MP4TAG_FREE], MP4TAG_ID_LEN);
-  if (fwrite (buff, freelen, 1, ofh) != 1) {
+  if (mp4tag_pwrite (ofh, buff, freelen, woffset) != freelen) {
     rc = MP4TAG_ERR_FILE_WRITE_ERROR;
   }
   free (buff);
@@ -505,70 +705,120 @@ static void
 mp4tag_update_offsets (libmp4tag_t *libmp4tag, FILE *ofh,
     int32_t delta, uint64_t foffset)
 {
+  mp4tagcotable_t *cotables;
+  int             count;
+  int             first;
+
   /* stco and co64 have different offsets sizes, */
   /* otherwise seem to be the same */
 
+  count = libmp4tag->cotablecount;
+  if (count == 0) {
+    return;
+  }
+
   if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
-    if (libmp4tag->stco_offset != 0 || libmp4tag->co64_offset != 0) {
-      fprintf (stdout, "  update-offsets\n");
-      fprintf (stdout, "    delta: %d\n", delta);
+    fprintf (stdout, "  update-offsets\n");
+    fprintf (stdout, "    delta: %d\n", delta);
+    fprintf (stdout, "    tables: %d\n", count);
+  }
+
+  cotables = malloc (sizeof (mp4tagcotable_t) * count);
+  if (cotables == NULL) {
+    libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+    return;
+  }
+
+  /* the tables were found in file order, and moving the tables */
+  /* that follow the tags does not change that order */
+  for (int i = 0; i < count; ++i) {
+    cotables [i] = libmp4tag->cotables [i];
+    if ((uint64_t) cotables [i].offset >= foffset) {
+      if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
+        fprintf (stdout, "    boffset-b4: %" PRId64 "\n", cotables [i].offset);
+      }
+      cotables [i].offset += delta;
     }
   }
 
-  mp4tag_update_offset_block (libmp4tag, ofh, delta, foffset,
-      libmp4tag->stco_offset, libmp4tag->stco_len, sizeof (uint32_t));
-  mp4tag_update_offset_block (libmp4tag, ofh, delta, foffset,
-      libmp4tag->co64_offset, libmp4tag->co64_len, sizeof (uint64_t));
+  /* tables that are near each other (usually all of them, */
+  /* as they are all in the 'moov' box) are read and written together */
+  first = 0;
+  for (int i = 1; i <= count; ++i) {
+    if (i == count ||
+        cotables [i].offset - (cotables [i - 1].offset + cotables [i - 1].len) >
+        MP4TAG_CO_GAP_SZ) {
+      mp4tag_update_offset_group (libmp4tag, ofh, delta, foffset,
+          cotables + first, i - first);
+      first = i;
+    }
+  }
+
+  free (cotables);
 }
 
 static void
-mp4tag_update_offset_block (libmp4tag_t *libmp4tag, FILE *ofh, int32_t delta,
-    uint64_t foffset, uint64_t boffset, uint32_t blen, int offsetsz)
+mp4tag_update_offset_group (libmp4tag_t *libmp4tag, FILE *ofh, int32_t delta,
+    uint64_t foffset, mp4tagcotable_t *cotables, int count)
 {
-  int       rc;
   char      *buff;
-  char      *dptr;
-  uint32_t  t32;
-  uint64_t  t64;
-  uint32_t  numoffsets;
+  int64_t   goffset;
+  size_t    glen;
 
-  /* stco has 4 bytes version/flags, 4 bytes number of offsets */
-  /* and 32-bit offsets */
-  /* co64 has 4 bytes version/flags, 4 bytes number of offsets */
-  /* and 64-bit offsets */
+  goffset = cotables [0].offset;
+  glen = cotables [count - 1].offset + cotables [count - 1].len - goffset;
+
+  if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
+    fprintf (stdout, "    group: %" PRId64 " %ld %d\n", goffset, (long) glen, count);
+  }
+
+  buff = malloc (glen);
+  if (buff == NULL) {
+    libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
+    return;
+  }
 
-  if (boffset == 0) {
-    /* block does not exist */
+  if (mp4tag_pread (ofh, buff, glen, goffset) != glen) {
+    libmp4tag->mp4error = MP4TAG_ERR_FILE_READ_ERROR;
+    free (buff);
     return;
   }
 
-  if (boffset >= foffset) {
+  for (int i = 0; i < count; ++i) {
     if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
-      fprintf (stdout, "    boffset-b4: %" PRId64 "\n", boffset);
+      fprintf (stdout, "    offsetsz: %d %s\n", cotables [i].offsetsz, cotables [i].offsetsz == sizeof (uint32_t) ? "stco" : "co64");
+      fprintf (stdout, "    foffset: %ld\n", (long) foffset);
+      fprintf (stdout, "    boffset: %" PRId64 "\n", cotables [i].offset);
+      fprintf (stdout, "    blen: %d\n", cotables [i].len);
     }
-    boffset += delta;
+    mp4tag_update_offset_block (libmp4tag, delta, foffset,
+        buff + (cotables [i].offset - goffset), cotables [i].len,
+        cotables [i].offsetsz);
   }
 
-  if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
-    fprintf (stdout, "    offsetsz: %d %s\n", offsetsz, offsetsz == sizeof (uint32_t) ? "stco" : "co64");
-    fprintf (stdout, "    foffset: %ld\n", (long) foffset);
-    fprintf (stdout, "    boffset: %" PRId64 "\n", boffset);
-    fprintf (stdout, "    blen: %d\n", blen);
-  }
-  rc = mp4tag_fseek (ofh, boffset, SEEK_SET);
-  if (rc != 0) {
-    libmp4tag->mp4error = MP4TAG_ERR_FILE_SEEK_ERROR;
+  if (mp4tag_pwrite (ofh, buff, glen, goffset) != glen) {
+    libmp4tag->mp4error = MP4TAG_ERR_FILE_WRITE_ERROR;
+    free (buff);
     return;
   }
 
-  buff = malloc (blen);
-  if (buff == NULL) {
-    libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
-    return;
-  }
+  free (buff);
+}
 
-  if (fread (buff, blen, 1, ofh) != 1) {
-    libmp4tag->mp4error = MP4TAG_ERR_FILE_READ_ERROR;
+static void
+mp4tag_update_offset_block (libmp4tag_t *libmp4tag, int32_t delta,
+    uint64_t foffset, char *buff, uint32_t blen, int offsetsz)
+{
+  char      *dptr;
+  uint32_t  t32;
+  uint32_t  numoffsets;
+
+  /* stco has 4 bytes version/flags, 4 bytes number of offsets */
+  /* and 32-bit offsets */
+  /* co64 has 4 bytes version/flags, 4 bytes number of offsets */
+  /* and 64-bit offsets */
+
+  if (blen < sizeof (uint32_t) * 2) {
     return;
   }
 
@@ -584,153 +834,102 @@ mp4tag_update_offset_block (libmp4tag_t *libmp4tag, FILE *ofh, int32_t delta,
     fprintf (stdout, "    num-offsets: %d\n", numoffsets);
   }
 
-  for (uint32_t i = 0; i < numoffsets; ++i) {
-    if (offsetsz == sizeof (uint32_t)) {
-      memcpy (&t32, dptr, sizeof (uint32_t));
-      t32 = be32toh (t32);
-      if (t32 > foffset) {
-        t32 += delta;
-        t32 = htobe32 (t32);
-        memcpy (dptr, &t32, sizeof (uint32_t));
-      }
-    }
-    if (offsetsz == sizeof (uint64_t)) {
-      memcpy (&t64, dptr, sizeof (uint64_t));
-      t64 = be64toh (t64);
-      if (t64 > foffset) {
-        t64 += delta;
-        t64 = htobe64 (t64);
-        memcpy (dptr, &t64, sizeof (uint64_t));
-      }
-    }
-    dptr += offsetsz;
+  if (numoffsets > (blen - sizeof (uint32_t) * 2) / offsetsz) {
+    /* a damaged table, do not write past the end of the box */
+    numoffsets = (blen - sizeof (uint32_t) * 2) / offsetsz;
   }
 
-  rc = mp4tag_fseek (ofh, boffset, SEEK_SET);
-  if (rc != 0) {
-    libmp4tag->mp4error = MP4TAG_ERR_FILE_SEEK_ERROR;
-    return;
+  if (offsetsz == sizeof (uint32_t)) {
+    mp4tag_relocate_offsets_32 (dptr, numoffsets, foffset, delta);
   }
-
-  if (fwrite (buff, blen, 1, ofh) != 1) {
-    libmp4tag->mp4error = MP4TAG_ERR_FILE_WRITE_ERROR;
-    return;
+  if (offsetsz == sizeof (uint64_t)) {
+    mp4tag_relocate_offsets_64 (dptr, numoffsets, foffset, delta);
   }
-
-  free (buff);
 }
 
-static char *
-mp4tag_build_append (libmp4tag_t *libmp4tag, int idx,
-    char *data, uint32_t *dlen)
+/* the length of the space needed for the tag, 0 if the tag is not */
+/* written.  the array processing state (datacount) is updated */
+static uint32_t
+mp4tag_build_len (libmp4tag_t *libmp4tag, mp4tag_t *mp4tag,
+    mp4tagbuild_t *build)
 {
-  mp4tag_t    *mp4tag;
   uint32_t    tlen;
-  uint32_t    savelen;
-  uint64_t    t64;
-  char        *dptr;
-  char        tnm [MP4TAG_ID_LEN + 1];
-  bool        iscustom = false;
-  char        *appname = NULL;
-  size_t      appnamelen;
-  char        *customname = NULL;
-  size_t      customnamelen;
-  char        *custom = NULL;
   char        tempnm [TEMP_NM_SZ];
   size_t      nmlen;
 
-
-  mp4tag = &libmp4tag->tags [idx];
-
   if (mp4tag->tag == NULL) {
-    return data;
-  }
-
-  if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
-    fprintf (stdout, "name: %s type: %02x dataidx: %d\n", mp4tag->tag, mp4tag->identtype, mp4tag->dataidx);
-    fprintf (stdout, "  int-len: %d data-len: %d\n", mp4tag->internallen, mp4tag->datalen);
-    fflush (stdout);
+    return 0;
   }
 
-  savelen = mp4tag->internallen;
+  build->iscustom = false;
+  build->savelen = mp4tag->internallen;
   if (mp4tag->identtype == MP4TAG_ID_STRING) {
-    savelen = mp4tag->datalen;
+    build->savelen = mp4tag->datalen;
   }
   if (strcmp (mp4tag->tag, boxids [MP4TAG_TRKN]) == 0) {
     /* track number may have been a short variant, and the */
     /* internal length is incorrect in that case. */
-    savelen = sizeof (uint32_t) + sizeof (uint16_t) * 2;
-  }
-  if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
-    fprintf (stdout, "  save-len: %d\n", savelen);
+    build->savelen = sizeof (uint32_t) + sizeof (uint16_t) * 2;
   }
 
   /* boxhead: idlen + ident */
   /* data: dlen + data-ident + data-flags + data-reserved */
-  tlen = MP4TAG_BOXHEAD_SZ + MP4TAG_DATA_SZ + savelen;
+  tlen = MP4TAG_BOXHEAD_SZ + MP4TAG_DATA_SZ + build->savelen;
 
   if (memcmp (mp4tag->tag, boxids [MP4TAG_CUSTOM], MP4TAG_ID_LEN) == 0) {
-    char    *p;
-    char    *tokstr;
+    const char  *p;
 
-    iscustom = true;
-    custom = strdup (mp4tag->tag);
+    build->iscustom = true;
 
     /* the ident, don't need to save this, handled below */
-    p = strtok_r (custom, MP4TAG_CUSTOM_DELIM, &tokstr);
+    p = strstr (mp4tag->tag, MP4TAG_CUSTOM_DELIM);
     if (p == NULL) {
-      free (custom);
-      return data;
+      return 0;
     }
 
     /* the appname string */
-    p = strtok_r (NULL, MP4TAG_CUSTOM_DELIM, &tokstr);
+    build->appname = p + 1;
+    p = strstr (build->appname, MP4TAG_CUSTOM_DELIM);
     if (p == NULL) {
-      free (custom);
-      return data;
+      return 0;
     }
-    appname = p;
+    build->appnamelen = p - build->appname;
 
     /* the custom name */
     /* do not parse here, as there may be a : in the name */
-    p += strlen (appname) + 1;
-    if (p == NULL) {
-      free (custom);
-      return data;
-    }
-    customname = p;
-
-    appnamelen = strlen (appname);
-    customnamelen = strlen (customname);
+    build->customname = p + 1;
+    build->customnamelen = strlen (build->customname);
 
     /* 'mean' len, 'mean' id, flags */
     tlen += sizeof (uint32_t) * 2 + MP4TAG_ID_LEN;
-    tlen += appnamelen;
+    tlen += build->appnamelen;
     /* 'name' len, 'name' id, flags */
     tlen += sizeof (uint32_t) * 2 + MP4TAG_ID_LEN;
-    tlen += customnamelen;
+    tlen += build->customnamelen;
   }
 
   /* the name is needed to check for arrays */
 
   /* ident */
   if (memcmp (mp4tag->tag, COPYRIGHT_STR, strlen (COPYRIGHT_STR)) == 0) {
-    tnm [0] = (char) MP4TAG_PREFIX_CHAR;
-    memcpy (tnm + 1, mp4tag->tag + strlen (COPYRIGHT_STR), 3);
-    tnm [MP4TAG_ID_LEN] = '\0';
+    build->tnm [0] = (char) MP4TAG_PREFIX_CHAR;
+    memcpy (build->tnm + 1, mp4tag->tag + strlen (COPYRIGHT_STR), 3);
   } else {
     /* mp4tag->tag may be custom and much longer than 4 chars */
-    memcpy (tnm, mp4tag->tag, MP4TAG_ID_LEN);
+    memcpy (build->tnm, mp4tag->tag, MP4TAG_ID_LEN);
   }
-  tnm [MP4TAG_ID_LEN] = '\0';
-  strcpy (tempnm, tnm);
+  build->tnm [MP4TAG_ID_LEN] = '\0';
+  strcpy (tempnm, build->tnm);
   nmlen = MP4TAG_ID_LEN;
-  if (iscustom) {
+  if (build->iscustom) {
     snprintf (tempnm + nmlen, sizeof (tempnm) - nmlen,
-        "%s%.*s", MP4TAG_CUSTOM_DELIM, (int) appnamelen, appname);
-    nmlen += appnamelen + strlen (MP4TAG_CUSTOM_DELIM);
-    snprintf (tempnm + nmlen, sizeof (tempnm) - nmlen,
-        "%s%.*s", MP4TAG_CUSTOM_DELIM, (int) customnamelen, customname);
+        "%s%.*s", MP4TAG_CUSTOM_DELIM, (int) build->appnamelen, build->appname);
+    nmlen += build->appnamelen + strlen (MP4TAG_CUSTOM_DELIM);
+    if (nmlen < sizeof (tempnm)) {
+      snprintf (tempnm + nmlen, sizeof (tempnm) - nmlen,
+          "%s%.*s", MP4TAG_CUSTOM_DELIM, (int) build->customnamelen,
+          build->customname);
+    }
   }
 
   /* array processing */
@@ -742,38 +941,111 @@ mp4tag_build_append (libmp4tag_t *libmp4tag, int idx,
     strcpy (libmp4tag->lastbox_nm, tempnm);
   }
 
-  if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
-    fprintf (stdout, "  datacount: %d\n", libmp4tag->datacount);
-    fprintf (stdout, "  lastbox offset %" PRId64 "\n", libmp4tag->lastbox_offset);
-  }
-
   if (libmp4tag->datacount > 0) {
     /* if processing a second cover or array item, */
     /* do not allocate extra space for the */
     /* ident-len and ident */
     tlen -= MP4TAG_BOXHEAD_SZ;
-    if (iscustom) {
+    if (build->iscustom) {
       /* mean */
       tlen -= sizeof (uint32_t) * 2 + MP4TAG_ID_LEN;
-      tlen -= appnamelen;
+      tlen -= build->appnamelen;
       /* name */
       tlen -= sizeof (uint32_t) * 2 + MP4TAG_ID_LEN;
-      tlen -= customnamelen;
+      tlen -= build->customnamelen;
     }
   }
 
   if (mp4tag->covername != NULL) {
-    /* if a cover name is present, include that length for the realloc */
+    /* if a cover name is present, include that length */
     tlen += MP4TAG_BOXHEAD_SZ + strlen (mp4tag->covername);
   }
 
-  data = realloc (data, *dlen + tlen);
-  if (data == NULL) {
-    libmp4tag->mp4error = MP4TAG_ERR_OUT_OF_MEMORY;
-    return NULL;
+  return tlen;
+}
+
+/* the length of the tag's value if the value is written from the */
+/* tag, or from the file if it has not been read in, rather than */
+/* being copied to the buffer.  0 if the value is copied */
+static uint32_t
+mp4tag_build_ref (mp4tag_t *mp4tag, mp4tagbuild_t *build)
+{
+  if (mp4tag->datalen == 0 || mp4tag->datalen != build->savelen) {
+    return 0;
+  }
+
+  if (mp4tag->identtype == MP4TAG_ID_STRING) {
+    if (mp4tag->data != NULL && mp4tag->datalen >= MP4TAG_WRITE_REF_SZ) {
+      return mp4tag->datalen;
+    }
+    return 0;
+  }
+
+  if (mp4tag->identtype == MP4TAG_ID_DATA &&
+      (strcmp (mp4tag->tag, boxids [MP4TAG_TRKN]) == 0 ||
+      strcmp (mp4tag->tag, boxids [MP4TAG_DISK]) == 0)) {
+    return 0;
+  }
+
+  if (mp4tag->identtype == MP4TAG_ID_DATA ||
+      mp4tag->identtype == MP4TAG_ID_JPG ||
+      mp4tag->identtype == MP4TAG_ID_PNG) {
+    if (mp4tag->data == NULL && mp4tag->dataoffset != 0) {
+      return mp4tag->datalen;
+    }
+    if (mp4tag->data != NULL && mp4tag->datalen >= MP4TAG_WRITE_REF_SZ) {
+      return mp4tag->datalen;
+    }
+  }
+
+  return 0;
+}
+
+/* the space for the tag has already been allocated */
+static void
+mp4tag_build_append (libmp4tag_t *libmp4tag, int idx, mp4tagilst_t *ilst)
+{
+  mp4tag_t      *mp4tag;
+  mp4tagbuild_t build;
+  uint32_t      tlen;
+  uint32_t      reflen;
+  uint32_t      doffset;    /* offset of the tag in the tag data */
+  uint64_t      t64;
+  char          *start;
+  char          *end;
+  char          *dptr;
+
+
+  mp4tag = &libmp4tag->tags [idx];
+
+  if (mp4tag->tag == NULL) {
+    return;
+  }
+
+  if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
+    fprintf (stdout, "name: %s type: %02x dataidx: %d\n", mp4tag->tag, mp4tag->identtype, mp4tag->dataidx);
+    fprintf (stdout, "  int-len: %d data-len: %d\n", mp4tag->internallen, mp4tag->datalen);
+    fflush (stdout);
+  }
+
+  tlen = mp4tag_build_len (libmp4tag, mp4tag, &build);
+  if (tlen == 0) {
+    return;
+  }
+
+  if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
+    fprintf (stdout, "  save-len: %d\n", build.savelen);
+    fprintf (stdout, "  datacount: %d\n", libmp4tag->datacount);
+    fprintf (stdout, "  lastbox offset %" PRId64 "\n", libmp4tag->lastbox_offset);
   }
-  dptr = data + *dlen;
-  *dlen += tlen;
+
+  reflen = mp4tag_build_ref (mp4tag, &build);
+
+  start = ilst->buff + ilst->bufflen;
+  end = start + tlen - reflen;
+  doffset = ilst->datalen;
+  ilst->datalen += tlen;
+  dptr = start;
 
   if (mp4tag->covername != NULL) {
     /* back out the cover name size change */
@@ -786,7 +1058,7 @@ mp4tag_build_append (libmp4tag_t *libmp4tag, int idx,
     /* save the offset for the start of the last box */
     /* it is needed for multiple covers/cover names and */
     /* for arrays of strings */
-    libmp4tag->lastbox_offset = (int32_t) (dptr - data);
+    libmp4tag->lastbox_offset = (int32_t) (dptr - ilst->buff);
   }
 
   /* if this is a second cover, or an array, */
@@ -795,30 +1067,30 @@ mp4tag_build_append (libmp4tag_t *libmp4tag, int idx,
     /* box length */
     dptr = mp4tag_append_len_32 (dptr, tlen);
 
-    dptr = mp4tag_append_data (dptr, tnm, MP4TAG_ID_LEN);
+    dptr = mp4tag_append_data (dptr, build.tnm, MP4TAG_ID_LEN);
 
-    if (iscustom) {
+    if (build.iscustom) {
       size_t      tmplen;
 
       /* update tlen to remove 'mean' */
       tlen -= sizeof (uint32_t) * 2 + MP4TAG_ID_LEN;
-      tlen -= appnamelen;
+      tlen -= build.appnamelen;
 
-      tmplen = sizeof (uint32_t) * 2 + MP4TAG_ID_LEN + appnamelen;
+      tmplen = sizeof (uint32_t) * 2 + MP4TAG_ID_LEN + build.appnamelen;
       dptr = mp4tag_append_len_32 (dptr, tmplen);
       dptr = mp4tag_append_data (dptr, boxids [MP4TAG_MEAN], MP4TAG_ID_LEN);
       dptr = mp4tag_append_len_32 (dptr, 0);
-      dptr = mp4tag_append_data (dptr, appname, appnamelen);
+      dptr = mp4tag_append_data (dptr, build.appname, build.appnamelen);
 
       /* update tlen to remove 'name' */
       tlen -= sizeof (uint32_t) * 2 + MP4TAG_ID_LEN;
-      tlen -= customnamelen;
+      tlen -= build.customnamelen;
 
-      tmplen = sizeof (uint32_t) * 2 + MP4TAG_ID_LEN + customnamelen;
+      tmplen = sizeof (uint32_t) * 2 + MP4TAG_ID_LEN + build.customnamelen;
       dptr = mp4tag_append_len_32 (dptr, tmplen);
       dptr = mp4tag_append_data (dptr, boxids [MP4TAG_NAME], MP4TAG_ID_LEN);
       dptr = mp4tag_append_len_32 (dptr, 0);
-      dptr = mp4tag_append_data (dptr, customname, customnamelen);
+      dptr = mp4tag_append_data (dptr, build.customname, build.customnamelen);
     }
 
     /* data length does not include ident len and ident */
@@ -837,9 +1109,14 @@ mp4tag_build_append (libmp4tag_t *libmp4tag, int idx,
     if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
       fprintf (stdout, "  string %.*s\n", (int) mp4tag->datalen, mp4tag->data);
     }
-    dptr = mp4tag_append_data (dptr, mp4tag->data, mp4tag->datalen);
+    if (reflen > 0) {
+      dptr = mp4tag_append_ref (ilst, dptr, mp4tag,
+          doffset + (uint32_t) (dptr - start));
+    } else {
+      dptr = mp4tag_append_data (dptr, mp4tag->data, mp4tag->datalen);
+    }
     if (libmp4tag->datacount > 0 && libmp4tag->lastbox_offset != -1) {
-      mp4tag_update_data_len (libmp4tag, data, MP4TAG_DATA_SZ + mp4tag->datalen);
+      mp4tag_update_data_len (libmp4tag, ilst->buff, MP4TAG_DATA_SZ + mp4tag->datalen);
     }
   }
   if (mp4tag->identtype == MP4TAG_ID_NUM) {
@@ -883,18 +1160,28 @@ mp4tag_build_append (libmp4tag_t *libmp4tag, int idx,
       }
       dptr = mp4tag_append_len_32 (dptr, ta);
       dptr = mp4tag_append_len_16 (dptr, tb);
+    } else if (reflen > 0) {
+      dptr = mp4tag_append_ref (ilst, dptr, mp4tag,
+          doffset + (uint32_t) (dptr - start));
     } else {
-      dptr = mp4tag_append_data (dptr, mp4tag->data, mp4tag->datalen);
+      dptr = mp4tag_append_binary (libmp4tag, dptr, mp4tag,
+          doffset + (uint32_t) (dptr - start));
     }
   }
 
   if (mp4tag->identtype == MP4TAG_ID_JPG ||
       mp4tag->identtype == MP4TAG_ID_PNG) {
-    dptr = mp4tag_append_data (dptr, mp4tag->data, mp4tag->datalen);
+    if (reflen > 0) {
+      dptr = mp4tag_append_ref (ilst, dptr, mp4tag,
+          doffset + (uint32_t) (dptr - start));
+    } else {
+      dptr = mp4tag_append_binary (libmp4tag, dptr, mp4tag,
+          doffset + (uint32_t) (dptr - start));
+    }
 
     if (libmp4tag->datacount > 0 && libmp4tag->lastbox_offset != -1) {
       /* datalen + size of a data box */
-      mp4tag_update_data_len (libmp4tag, data,
+      mp4tag_update_data_len (libmp4tag, ilst->buff,
           MP4TAG_DATA_SZ + mp4tag->datalen);
     }
     if (mp4tag->covername != NULL && *mp4tag->covername) {
@@ -907,17 +1194,44 @@ mp4tag_build_append (libmp4tag_t *libmp4tag, int idx,
       dptr = mp4tag_append_data (dptr, boxids [MP4TAG_NAME], MP4TAG_ID_LEN);
       dptr = mp4tag_append_data (dptr, mp4tag->covername, cnmlen);
 
-      mp4tag_update_data_len (libmp4tag, data, tcnmlen);
+      mp4tag_update_data_len (libmp4tag, ilst->buff, tcnmlen);
     }
   }
 
+  /* the next tag starts at the end of the space for this tag */
+  mp4tag_build_iov (ilst, ilst->buff + ilst->bufflen, 0,
+      end - (ilst->buff + ilst->bufflen));
+  ilst->bufflen = (uint32_t) (end - ilst->buff);
+
   libmp4tag->datacount += 1;
+}
+
+/* adds a part to the ilst data. */
+/* a part in memory that follows the previous part is merged with it */
+static void
+mp4tag_build_iov (mp4tagilst_t *ilst, const char *data, int64_t offset,
+    size_t len)
+{
+  mp4tagiov_t   *iov;
 
-  if (iscustom) {
-    free (custom);
+  if (data != NULL && len == 0) {
+    return;
+  }
+
+  if (ilst->iovcount > 0) {
+    iov = &ilst->iov [ilst->iovcount - 1];
+    if (data != NULL && iov->data != NULL && iov->data + iov->len == data) {
+      iov->len += len;
+      return;
+    }
   }
 
-  return data;
+  iov = &ilst->iov [ilst->iovcount];
+  iov->data = data;
+  iov->offset = offset;
+  iov->len = len;
+  iov->alloc = false;
+  ilst->iovcount += 1;
 }
 
 static void
@@ -941,6 +1255,48 @@ mp4tag_append_data (char *dptr, const char *tnm, uint32_t sz)
   return dptr;
 }
 
+/* binary data that has not been read in is copied directly from the file */
+static char *
+mp4tag_append_binary (libmp4tag_t *libmp4tag, char *dptr, mp4tag_t *mp4tag,
+    uint32_t doffset)
+{
+  if (mp4tag->data != NULL || mp4tag->dataoffset == 0) {
+    return mp4tag_append_data (dptr, mp4tag->data, mp4tag->datalen);
+  }
+
+  if (libmp4tag->fh == NULL) {
+    libmp4tag->mp4error = MP4TAG_ERR_NOT_OPEN;
+  } else if (mp4tag_pread (libmp4tag->fh, dptr, mp4tag->datalen,
+      mp4tag->dataoffset) != mp4tag->datalen) {
+    libmp4tag->mp4error = MP4TAG_ERR_FILE_READ_ERROR;
+  }
+  /* save the location so that the offset can be updated */
+  /* once the data is written */
+  mp4tag->writeoffset = doffset;
+  dptr += mp4tag->datalen;
+  return dptr;
+}
+
+/* the tag's value is written from the tag, or from the file if it */
+/* has not been read in.  the data in the buffer up to dptr is ended */
+/* as a part, and the value is added as the next part */
+static char *
+mp4tag_append_ref (mp4tagilst_t *ilst, char *dptr, mp4tag_t *mp4tag,
+    uint32_t doffset)
+{
+  mp4tag_build_iov (ilst, ilst->buff + ilst->bufflen, 0,
+      dptr - (ilst->buff + ilst->bufflen));
+  ilst->bufflen = (uint32_t) (dptr - ilst->buff);
+
+  mp4tag_build_iov (ilst, mp4tag->data, mp4tag->dataoffset, mp4tag->datalen);
+  if (mp4tag->data == NULL) {
+    /* save the location so that the offset can be updated */
+    /* once the data is written */
+    mp4tag->writeoffset = doffset;
+  }
+  return dptr;
+}
+
 static char *
 mp4tag_append_len_8 (char *dptr, uint64_t val)
 {
@@ -1004,7 +1360,8 @@ mp4tag_update_data_len (libmp4tag_t *libmp4tag, char *data, uint32_t len)
 }
 
 static int
-mp4tag_copy_file_data (FILE *ifh, FILE *ofh, int64_t offset, size_t len)
+mp4tag_copy_file_data (FILE *ifh, FILE *ofh, int64_t offset, size_t len,
+    int64_t woffset)
 {
   char    *data;
   size_t  rlen = 0;
@@ -1014,11 +1371,15 @@ mp4tag_copy_file_data (FILE *ifh, FILE *ofh, int64_t offset, size_t len)
   size_t  totwrite = 0;
   int     rc = MP4TAG_OK;
 
-  if (mp4tag_fseek (ifh, offset, SEEK_SET) != 0) {
-    return MP4TAG_ERR_FILE_SEEK_ERROR;
+  if (len == 0) {
+    return rc;
   }
 
-  data = malloc (MP4TAG_COPY_SIZE);
+  rlen = MP4TAG_COPY_SIZE;
+  if (len < rlen) {
+    rlen = len;
+  }
+  data = malloc (rlen);
   if (data == NULL) {
     rc = MP4TAG_ERR_OUT_OF_MEMORY;
     return rc;
@@ -1029,13 +1390,14 @@ mp4tag_copy_file_data (FILE *ifh, FILE *ofh, int64_t offset, size_t len)
     if (bremain < rlen) {
       rlen = bremain;
     }
-    bread = fread (data, 1, rlen, ifh);
+    bread = mp4tag_pread (ifh, data, rlen, offset + totwrite);
     if (bread <= 0) {
       break;
     }
-    bwrite = fwrite (data, 1, bread, ofh);
+    bwrite = mp4tag_pwrite (ofh, data, bread, woffset + totwrite);
     if (bwrite != bread) {
       rc = MP4TAG_ERR_FILE_WRITE_ERROR;
+      free (data);
       return rc;
     }
     totwrite += bwrite;
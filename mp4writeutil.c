@@ -11,6 +11,12 @@
 #include <stdint.h>
 #include <inttypes.h>
 
+#if defined (__SSE2__)
+# include <emmintrin.h>
+#elif defined (__ARM_NEON)
+# include <arm_neon.h>
+#endif
+
 #include "libmp4tag.h"
 #include "mp4tagint.h"
 #include "mp4tagbe.h"
@@ -19,7 +25,6 @@ void
 mp4tag_update_parent_lengths (libmp4tag_t *libmp4tag, FILE *ofh, int32_t delta)
 {
   int     idx;
-  int     rc;
 
   idx = libmp4tag->parentidx;
 
@@ -31,21 +36,116 @@ mp4tag_update_parent_lengths (libmp4tag_t *libmp4tag, FILE *ofh, int32_t delta)
   while (idx >= 0) {
     uint32_t    t32;
 
-    rc = mp4tag_fseek (ofh, libmp4tag->base_offsets [idx], SEEK_SET);
-    if (rc != 0) {
-      libmp4tag->mp4error = MP4TAG_ERR_FILE_SEEK_ERROR;
-      return;
-    }
-
     t32 = libmp4tag->base_lengths [idx] + delta;
     if (mp4tag_chk_dbg (libmp4tag, MP4TAG_DBG_WRITE)) {
       fprintf (stdout, "    update-parent: idx: %d %s offset: %" PRId64 " len: %d / %d\n", idx, libmp4tag->base_name [idx], libmp4tag->base_offsets [idx], libmp4tag->base_lengths [idx], t32);
     }
     t32 = htobe32 (t32);
-    if (fwrite (&t32, sizeof (uint32_t), 1, ofh) != 1) {
+    if (mp4tag_pwrite (ofh, &t32, sizeof (uint32_t),
+        libmp4tag->base_offsets [idx]) != sizeof (uint32_t)) {
       libmp4tag->mp4error = MP4TAG_ERR_FILE_WRITE_ERROR;
     }
     --idx;
   }
 }
 
+/* the chunk offset tables are stored big-endian. */
+/* every offset past foffset is moved by delta. */
+/* long video files may have hundreds of thousands of offsets, */
+/* so several offsets are processed at a time (sse2 or neon) */
+/* where possible. */
+/* sse2 has no 64-bit compare, and emulating it was slower than */
+/* the byte-swap instruction used by the simple loop, so the */
+/* 64-bit offsets are done one at a time */
+
+#if defined (__SSE2__)
+
+/* sse2 has no byte shuffle: swap the bytes in each 16-bit word, */
+/* then re-order the words */
+static inline __m128i
+mp4tag_bswap_32x4 (__m128i v)
+{
+  v = _mm_or_si128 (_mm_slli_epi16 (v, 8), _mm_srli_epi16 (v, 8));
+  v = _mm_shufflelo_epi16 (v, _MM_SHUFFLE (2, 3, 0, 1));
+  v = _mm_shufflehi_epi16 (v, _MM_SHUFFLE (2, 3, 0, 1));
+  return v;
+}
+
+#endif
+
+void
+mp4tag_relocate_offsets_32 (char *dptr, uint32_t count,
+    uint64_t foffset, int32_t delta)
+{
+  uint32_t  i = 0;
+  uint32_t  t32;
+
+  if (foffset >= UINT32_MAX) {
+    /* no 32-bit offset can be past foffset */
+    return;
+  }
+
+#if defined (__SSE2__)
+  {
+    /* sse2 only has a signed compare, flip the sign bits */
+    __m128i   bias = _mm_set1_epi32 ((int32_t) 0x80000000);
+    __m128i   limit = _mm_set1_epi32 ((int32_t) ((uint32_t) foffset ^ 0x80000000));
+    __m128i   vdelta = _mm_set1_epi32 (delta);
+
+    for ( ; i + 4 <= count; i += 4) {
+      __m128i   v;
+      __m128i   mask;
+
+      v = _mm_loadu_si128 ((const __m128i *) (dptr + i * sizeof (uint32_t)));
+      v = mp4tag_bswap_32x4 (v);
+      mask = _mm_cmpgt_epi32 (_mm_xor_si128 (v, bias), limit);
+      v = _mm_add_epi32 (v, _mm_and_si128 (mask, vdelta));
+      v = mp4tag_bswap_32x4 (v);
+      _mm_storeu_si128 ((__m128i *) (dptr + i * sizeof (uint32_t)), v);
+    }
+  }
+#elif defined (__ARM_NEON)
+  {
+    uint32x4_t  limit = vdupq_n_u32 ((uint32_t) foffset);
+    uint32x4_t  vdelta = vdupq_n_u32 ((uint32_t) delta);
+
+    for ( ; i + 4 <= count; i += 4) {
+      uint8_t     *p = (uint8_t *) dptr + i * sizeof (uint32_t);
+      uint32x4_t  v;
+      uint32x4_t  mask;
+
+      v = vreinterpretq_u32_u8 (vrev32q_u8 (vld1q_u8 (p)));
+      mask = vcgtq_u32 (v, limit);
+      v = vaddq_u32 (v, vandq_u32 (mask, vdelta));
+      vst1q_u8 (p, vrev32q_u8 (vreinterpretq_u8_u32 (v)));
+    }
+  }
+#endif
+
+  for ( ; i < count; ++i) {
+    memcpy (&t32, dptr + i * sizeof (uint32_t), sizeof (uint32_t));
+    t32 = be32toh (t32);
+    if (t32 > foffset) {
+      t32 += delta;
+      t32 = htobe32 (t32);
+      memcpy (dptr + i * sizeof (uint32_t), &t32, sizeof (uint32_t));
+    }
+  }
+}
+
+void
+mp4tag_relocate_offsets_64 (char *dptr, uint32_t count,
+    uint64_t foffset, int32_t delta)
+{
+  uint64_t  t64;
+
+  for (uint32_t i = 0; i < count; ++i) {
+    memcpy (&t64, dptr + i * sizeof (uint64_t), sizeof (uint64_t));
+    t64 = be64toh (t64);
+    if (t64 > foffset) {
+      t64 += delta;
+      t64 = htobe64 (t64);
+      memcpy (dptr + i * sizeof (uint64_t), &t64, sizeof (uint64_t));
+    }
+  }
+}
@@ -36,6 +36,12 @@ TEXPS=test-exp-sort.txt
 TACT=test-actual.txt
 TFN=test-tmp.m4a
 TFNB=test-tmp-b.m4a
+TFNC=test-tmp-c.m4a
+TFND=test-tmp-d.m4a
+TOPTA=test-opt-a.txt
+TOPTB=test-opt-b.txt
+OUTA=test-co-a.txt
+OUTB=test-co-b.txt
 
 PICA=samples/bdj4-b.png
 PICALEN=$(stat ${sopt} "${sfmt}" ${PICA})
@@ -53,7 +59,8 @@ case $systype in
     MP4TAGCLIEXEC=.\\build\\mp4tagcli.exe
     ;;
 esac
-if [[ ! -f ${MP4TAGCLI} ]]; then
+MP4TAGAPITEST=./build/mp4tagapitest
+if [[ ! -f ${MP4TAGCLI} || ! -f ${MP4TAGAPITEST} ]]; then
   echo "executable not found"
   exit 1
 fi
@@ -74,6 +81,18 @@ for f in $flist; do
   cp $f ${TFN}
   chmod u+w ${TFN}
   cp -fp ${TFN} ${TFNB}
+  cp -fp ${TFN} ${TFNC}
+
+  # the functions that are not available from mp4tagcli
+  ${MP4TAGAPITEST} ${TFNC} > /dev/null
+  rc=$?
+  if [[ $rc -ne 0 ]]; then
+    echo -n "api-fail "
+    grc=1
+  else
+    echo -n "api-ok "
+  fi
+  rm -f ${TFNC}
 
   # string tags
   for tag in aART catg cprt desc keyw ldes ownr purd purl soaa \
@@ -313,6 +332,64 @@ diff ${TEXPS} ${TACT}
     echo -n "diff-preserve-ok "
   fi
 
+  # the other methods of reading the file must give the same
+  # output as the default
+  ${MP4TAGCLI} ${TFN} > ${TOPTA}
+  orc=0
+  for opt in --mmap --ilstview "--ilstview --mmap" --asfeed --readonly; do
+    ${MP4TAGCLI} ${opt} ${TFN} > ${TOPTB}
+    diff ${TOPTA} ${TOPTB} > /dev/null 2>&1
+    rc=$?
+    if [[ $rc -ne 0 ]]; then
+      echo -n "opt-fail ${opt} "
+diff ${TOPTA} ${TOPTB}
+      orc=1
+      grc=1
+    fi
+  done
+  if [[ $orc -eq 0 ]]; then
+    echo -n "opt-ok "
+  fi
+
+  # only the filtered tags are returned
+  ${GREP} -E -- "^(duration|${CS}nam|covr|${CS}wrt)[=:]" ${TOPTA} > ${TEXPS}
+  ${MP4TAGCLI} --filter nam --filter covr --filter wrt ${TFN} > ${TOPTB}
+  diff ${TEXPS} ${TOPTB} > /dev/null 2>&1
+  rc=$?
+  if [[ $rc -ne 0 ]]; then
+    echo -n "filter-fail "
+diff ${TEXPS} ${TOPTB}
+    grc=1
+  else
+    echo -n "filter-ok "
+  fi
+
+  # the probe must report the same duration, and the sample rate
+  ${MP4TAGCLI} --probe ${TFN} > ${TOPTB}
+  rc=$?
+  val=$(${GREP} -E -c -- '^samplerate=[1-9]' ${TOPTB})
+  if [[ $rc -ne 0 || $val -ne 1 ||
+      $(${GREP} '^duration=' ${TOPTB}) != $(${GREP} '^duration=' ${TOPTA}) ]]; then
+    echo -n "probe-fail "
+    grc=1
+  else
+    echo -n "probe-ok "
+  fi
+
+  # a write to a read-only file must fail, and the tags are unchanged
+  ${MP4TAGCLI} --readonly ${TFN} nam=readonly > /dev/null 2>&1
+  rc=$?
+  ${MP4TAGCLI} ${TFN} > ${TOPTB}
+  diff ${TOPTA} ${TOPTB} > /dev/null 2>&1
+  drc=$?
+  if [[ $rc -eq 0 || $drc -ne 0 ]]; then
+    echo -n "readonly-fail "
+    grc=1
+  else
+    echo -n "readonly-ok "
+  fi
+  rm -f ${TOPTA} ${TOPTB}
+
   # string tags
   for tag in aART catg cprt desc keyw ldes ownr purd purl soaa \
       soal soar soco sonm sosn tven tvnn tvsh ART alb cmt \
@@ -401,6 +478,57 @@ diff ${TEXPS} ${TACT}
   rm -f ${TEXPA} ${TEXPS} ${TACT} ${TFN} ${TFNB}
 done
 
+# chunk offset tables in more than one track.
+# the file has 'stco', 'co64' and 'stco' tracks, the last after the
+# 'udta' box, and the 'mdat' box follows the 'moov' box.
+# the tag list is grown so that the file is re-written.
+# every chunk offset must move by the same amount,
+# and must still point at the same data.
+echo -n "chk: multi-track "
+cocount=$(python3 tests/mkmultitrak.py ${TFND} 2> /dev/null)
+if [[ $? -ne 0 ]]; then
+  echo "not available"
+else
+  ${MP4TAGCLI} --debug 4 ${TFND} |
+      ${GREP} -E '^ *[0-9]+: [0-9a-f]+ ' > ${OUTA}
+  ${MP4TAGCLI} --freespace 64 ${TFND} lyr=$(printf '%04000d' 0)
+  rc=$?
+  if [[ $rc -ne 0 ]]; then
+    echo "fail grow"
+    exit 1
+  fi
+  ${MP4TAGCLI} --debug 4 ${TFND} |
+      ${GREP} -E '^ *[0-9]+: [0-9a-f]+ ' > ${OUTB}
+
+  codelta=""
+  cogood=0
+  while IFS='|' read -r linea lineb; do
+    set -- ${linea}
+    offa=$((16#$2))
+    shift 2
+    dataa="$*"
+    set -- ${lineb}
+    offb=$((16#$2))
+    shift 2
+    datab="$*"
+    if [[ ${codelta} == "" ]]; then
+      codelta=$((offb - offa))
+    fi
+    if [[ $((offb - offa)) -eq ${codelta} && ${dataa} == ${datab} ]]; then
+      cogood=$((cogood + 1))
+    fi
+  done < <(paste -d '|' ${OUTA} ${OUTB})
+
+  if [[ $(wc -l < ${OUTB}) -ne ${cocount} || ${cogood} -ne ${cocount} ||
+      ${codelta} -le 0 ]]; then
+    echo "co-fail"
+    grc=1
+  else
+    echo "co-ok"
+  fi
+  rm -f ${OUTA} ${OUTB} ${TFND}
+fi
+
 if [[ $grc -eq 0 ]]; then
   echo "OK"
 else
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+#
+# Copyright 2026 Brad Lanam Pleasant Hill CA
+#
+# mkmultitrak.py <file>
+#   Creates an m4a file with three tracks, with 'stco', 'co64' and
+#   'stco' chunk offset tables.  The third track follows the 'udta'
+#   box.  The chunks of the tracks are interleaved in the 'mdat' box,
+#   which follows the 'moov' box, so the offsets change when the tags
+#   grow.
+#   Each chunk starts with 'CHNK', the track and the chunk number.
+#   Prints the number of chunk offsets.
+#
+
+import struct
+import sys
+
+CHUNKS = 8
+CHUNK_SZ = 64
+TRACKS = 3
+
+def box (name, payload):
+  return struct.pack ('>I', 8 + len (payload)) + name + payload
+
+def fullbox (name, payload):
+  return box (name, struct.pack ('>I', 0) + payload)
+
+def trak (offsets, co64):
+  if co64:
+    co = fullbox (b'co64', struct.pack ('>I', len (offsets)) +
+        b''.join (struct.pack ('>Q', o) for o in offsets))
+  else:
+    co = fullbox (b'stco', struct.pack ('>I', len (offsets)) +
+        b''.join (struct.pack ('>I', o) for o in offsets))
+  stbl = box (b'stbl', fullbox (b'stsd', struct.pack ('>I', 0)) +
+      fullbox (b'stts', struct.pack ('>I', 0)) + co)
+  minf = box (b'minf', fullbox (b'smhd', b'\0' * 4) + box (b'dinf', b'') + stbl)
+  mdhd = fullbox (b'mdhd', struct.pack ('>IIIII', 0, 0, 44100, 441000, 0))
+  hdlr = fullbox (b'hdlr', b'\0' * 4 + b'soun' + b'\0' * 13)
+  return box (b'trak', fullbox (b'tkhd', b'\0' * 80) +
+      box (b'mdia', mdhd + hdlr + minf))
+
+def moov (offsets):
+  mvhd = fullbox (b'mvhd', struct.pack ('>IIII', 0, 0, 44100, 441000) +
+      b'\0' * 80)
+  data = box (b'data', struct.pack ('>II', 1, 0) + b'multi-track')
+  ilst = box (b'ilst', box (b'\xa9nam', data))
+  hdlr = fullbox (b'hdlr', struct.pack ('>I', 0) + b'mdirappl' + b'\0' * 9)
+  udta = box (b'udta', fullbox (b'meta', hdlr + ilst))
+  return box (b'moov', mvhd + trak (offsets [0], False) +
+      trak (offsets [1], True) + udta + trak (offsets [2], False))
+
+def main ():
+  ftyp = box (b'ftyp', b'M4A ' + struct.pack ('>I', 0x200) + b'M4A mp42isom')
+  mdat = b''
+  for c in range (CHUNKS):
+    for t in range (TRACKS):
+      mdat += b'CHNK' + struct.pack ('>HH', t, c) + b'\0' * (CHUNK_SZ - 8)
+
+  # the size of the 'moov' box does not depend on the offsets
+  base = len (ftyp) + len (moov ([[0] * CHUNKS] * TRACKS)) + 8
+  offsets = [[base + (c * TRACKS + t) * CHUNK_SZ for c in range (CHUNKS)]
+      for t in range (TRACKS)]
+
+  with open (sys.argv [1], 'wb') as fh:
+    fh.write (ftyp + moov (offsets) + box (b'mdat', mdat))
+  print (CHUNKS * TRACKS)
+
+main ()
@@ -0,0 +1,353 @@
+/*
+ * Copyright 2026 Brad Lanam Pleasant Hill CA
+ *
+ * mp4tagapitest
+ *    Checks the library functions that change a list of tags at once
+ *    (mp4tag_set_tags, mp4tag_delete_tags_by_prefix), which are not
+ *    available from mp4tagcli.
+ *    The file is modified, run this on a copy.
+ *
+ *    mp4tagapitest <file>
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "libmp4tag.h"
+
+enum {
+  APITEST_TAG_SZ = 200,
+};
+
+static const char *APITEST_TITLE = "\xc2\xa9nam";
+static const char *APITEST_ARTIST = "\xc2\xa9" "ART";
+static const char *APITEST_CUSTOM_A = "----:MP4TAGAPITEST:A";
+static const char *APITEST_CUSTOM_B = "----:MP4TAGAPITEST:B";
+static const char *APITEST_CUSTOM_C = "----:MP4TAGAPITEST:C";
+static const char *APITEST_PREFIX = "----:com.apple.iTunes:";
+static const char *APITEST_PREFIX_A = "----:com.apple.iTunes:MP4TAGAPITEST A";
+static const char *APITEST_PREFIX_B = "----:com.apple.iTunes:MP4TAGAPITEST B";
+static const char APITEST_BIN [] = { 0x01, 0x00, 0x02, 0x00, 0x03 };
+
+static int  apitest_set_tags (libmp4tag_t *libmp4tag);
+static int  apitest_set_tags_fail (libmp4tag_t *libmp4tag);
+static int  apitest_verify_set_tags (libmp4tag_t *libmp4tag, const char *which);
+static int  apitest_delete_prefix (libmp4tag_t *libmp4tag);
+static int  apitest_chk_prefix (libmp4tag_t *libmp4tag, const char *which);
+static int  apitest_chk_string (libmp4tag_t *libmp4tag, const char *which, const char *tag, const char *value);
+static int  apitest_count_tags (libmp4tag_t *libmp4tag);
+static libmp4tag_t * apitest_open (const char *fn);
+
+int
+main (int argc, char *argv [])
+{
+  libmp4tag_t   *libmp4tag;
+  int           failed = 0;
+
+  if (argc < 2) {
+    fprintf (stderr, "no file specified\n");
+    exit (1);
+  }
+
+  libmp4tag = apitest_open (argv [1]);
+  if (libmp4tag == NULL) {
+    exit (1);
+  }
+
+  failed += apitest_set_tags (libmp4tag);
+  failed += apitest_set_tags_fail (libmp4tag);
+  failed += apitest_delete_prefix (libmp4tag);
+
+  if (mp4tag_write_tags (libmp4tag) != MP4TAG_OK) {
+    fprintf (stderr, "write failed (%s)\n", mp4tag_error_str (libmp4tag));
+    failed += 1;
+  }
+  mp4tag_free (libmp4tag);
+
+  /* the changes must be present in the file */
+  libmp4tag = apitest_open (argv [1]);
+  if (libmp4tag == NULL) {
+    exit (1);
+  }
+  failed += apitest_verify_set_tags (libmp4tag, "set-tags (re-read)");
+  failed += apitest_chk_prefix (libmp4tag, "delete-prefix (re-read)");
+  mp4tag_free (libmp4tag);
+
+  if (failed > 0) {
+    fprintf (stdout, "failed: %d\n", failed);
+    return 1;
+  }
+  fprintf (stdout, "ok\n");
+  return 0;
+}
+
+static int
+apitest_set_tags (libmp4tag_t *libmp4tag)
+{
+  mp4tagpub_t   items [4];
+  int           rc;
+
+  memset (items, 0, sizeof (items));
+  items [0].tag = APITEST_TITLE;
+  items [0].data = "apitest title";
+  items [1].tag = APITEST_ARTIST;
+  items [1].data = "apitest artist";
+  items [2].tag = APITEST_CUSTOM_A;
+  items [2].data = "apitest custom";
+  items [3].tag = APITEST_CUSTOM_B;
+  items [3].data = APITEST_BIN;
+  items [3].datalen = sizeof (APITEST_BIN);
+  items [3].binary = true;
+
+  rc = mp4tag_set_tags (libmp4tag, items, 4);
+  if (rc != MP4TAG_OK) {
+    fprintf (stderr, "set-tags: failed (%s)\n", mp4tag_error_str (libmp4tag));
+    return 1;
+  }
+
+  return apitest_verify_set_tags (libmp4tag, "set-tags");
+}
+
+/* a list with an item that fails the check must not change any tag */
+static int
+apitest_set_tags_fail (libmp4tag_t *libmp4tag)
+{
+  mp4tagpub_t   items [4];
+  int           count;
+  int           failed = 0;
+
+  count = apitest_count_tags (libmp4tag);
+
+  /* a new tag is set as a string, and then as binary data */
+  memset (items, 0, sizeof (items));
+  items [0].tag = APITEST_TITLE;
+  items [0].data = "changed title";
+  items [1].tag = APITEST_CUSTOM_C;
+  items [1].data = "string";
+  items [2].tag = APITEST_CUSTOM_C;
+  items [2].data = APITEST_BIN;
+  items [2].datalen = sizeof (APITEST_BIN);
+  items [2].binary = true;
+  if (mp4tag_set_tags (libmp4tag, items, 3) != MP4TAG_ERR_MISMATCH) {
+    fprintf (stderr, "set-tags-fail: same tag: not rejected\n");
+    failed += 1;
+  }
+
+  /* an existing string tag is set as binary data */
+  memset (items, 0, sizeof (items));
+  items [0].tag = APITEST_CUSTOM_C;
+  items [0].data = "string";
+  items [1].tag = APITEST_ARTIST;
+  items [1].data = APITEST_BIN;
+  items [1].datalen = sizeof (APITEST_BIN);
+  items [1].binary = true;
+  if (mp4tag_set_tags (libmp4tag, items, 2) != MP4TAG_ERR_MISMATCH) {
+    fprintf (stderr, "set-tags-fail: existing tag: not rejected\n");
+    failed += 1;
+  }
+
+  /* an unknown tag */
+  memset (items, 0, sizeof (items));
+  items [0].tag = APITEST_CUSTOM_C;
+  items [0].data = "string";
+  items [1].tag = "zzzz";
+  items [1].data = "string";
+  if (mp4tag_set_tags (libmp4tag, items, 2) != MP4TAG_ERR_TAG_NOT_FOUND) {
+    fprintf (stderr, "set-tags-fail: unknown tag: not rejected\n");
+    failed += 1;
+  }
+
+  if (apitest_count_tags (libmp4tag) != count) {
+    fprintf (stderr, "set-tags-fail: tag count changed\n");
+    failed += 1;
+  }
+  failed += apitest_verify_set_tags (libmp4tag, "set-tags-fail");
+  if (apitest_chk_string (libmp4tag, "set-tags-fail",
+      APITEST_CUSTOM_C, NULL) != 0) {
+    failed += 1;
+  }
+
+  return failed;
+}
+
+static int
+apitest_verify_set_tags (libmp4tag_t *libmp4tag, const char *which)
+{
+  mp4tagpub_t   mp4tagpub;
+  int           failed = 0;
+
+  failed += apitest_chk_string (libmp4tag, which,
+      APITEST_TITLE, "apitest title");
+  failed += apitest_chk_string (libmp4tag, which,
+      APITEST_ARTIST, "apitest artist");
+  failed += apitest_chk_string (libmp4tag, which,
+      APITEST_CUSTOM_A, "apitest custom");
+
+  if (mp4tag_get_tag_by_name (libmp4tag, APITEST_CUSTOM_B,
+      &mp4tagpub) != MP4TAG_OK ||
+      ! mp4tagpub.binary ||
+      mp4tagpub.datalen != sizeof (APITEST_BIN) ||
+      memcmp (mp4tagpub.data, APITEST_BIN, sizeof (APITEST_BIN)) != 0) {
+    fprintf (stderr, "%s: %s: mismatch\n", which, APITEST_CUSTOM_B);
+    failed += 1;
+  }
+
+  return failed;
+}
+
+/* only the tags that do not begin with the prefix may remain, */
+/* in the same order */
+static int
+apitest_delete_prefix (libmp4tag_t *libmp4tag)
+{
+  mp4tagpub_t   mp4tagpub;
+  char          **names;
+  int           count = 0;
+  int           keep = 0;
+  int           idx = 0;
+  int           failed = 0;
+
+  if (mp4tag_set_tag (libmp4tag, APITEST_PREFIX_A, "a", false) != MP4TAG_OK ||
+      mp4tag_set_tag (libmp4tag, APITEST_PREFIX_B, "b", false) != MP4TAG_OK) {
+    fprintf (stderr, "delete-prefix: set failed (%s)\n",
+        mp4tag_error_str (libmp4tag));
+    return 1;
+  }
+
+  count = apitest_count_tags (libmp4tag);
+  names = malloc (sizeof (char *) * count);
+  if (names == NULL) {
+    return 1;
+  }
+  mp4tag_iterate_init (libmp4tag);
+  while (mp4tag_iterate (libmp4tag, &mp4tagpub) == MP4TAG_OK) {
+    if (strncmp (mp4tagpub.tag, APITEST_PREFIX, strlen (APITEST_PREFIX)) != 0) {
+      names [keep] = strdup (mp4tagpub.tag);
+      ++keep;
+    }
+  }
+
+  if (mp4tag_delete_tags_by_prefix (libmp4tag, APITEST_PREFIX) != MP4TAG_OK) {
+    fprintf (stderr, "delete-prefix: failed (%s)\n",
+        mp4tag_error_str (libmp4tag));
+    failed += 1;
+  }
+
+  mp4tag_iterate_init (libmp4tag);
+  while (mp4tag_iterate (libmp4tag, &mp4tagpub) == MP4TAG_OK) {
+    if (idx >= keep ||
+        names [idx] == NULL ||
+        strcmp (mp4tagpub.tag, names [idx]) != 0) {
+      fprintf (stderr, "delete-prefix: %s: not expected\n", mp4tagpub.tag);
+      failed += 1;
+      break;
+    }
+    ++idx;
+  }
+  if (failed == 0 && idx != keep) {
+    fprintf (stderr, "delete-prefix: %d of %d tags remain\n", idx, keep);
+    failed += 1;
+  }
+  failed += apitest_chk_prefix (libmp4tag, "delete-prefix");
+
+  /* nothing left to delete */
+  if (mp4tag_delete_tags_by_prefix (libmp4tag, APITEST_PREFIX) !=
+      MP4TAG_ERR_TAG_NOT_FOUND) {
+    fprintf (stderr, "delete-prefix: second delete: not 'not found'\n");
+    failed += 1;
+  }
+
+  for (int i = 0; i < keep; ++i) {
+    free (names [i]);
+  }
+  free (names);
+
+  return failed;
+}
+
+static int
+apitest_chk_prefix (libmp4tag_t *libmp4tag, const char *which)
+{
+  mp4tagpub_t   mp4tagpub;
+  int           failed = 0;
+
+  mp4tag_iterate_init (libmp4tag);
+  while (mp4tag_iterate (libmp4tag, &mp4tagpub) == MP4TAG_OK) {
+    if (strncmp (mp4tagpub.tag, APITEST_PREFIX, strlen (APITEST_PREFIX)) == 0) {
+      fprintf (stderr, "%s: %s: present\n", which, mp4tagpub.tag);
+      failed += 1;
+    }
+  }
+
+  /* the tags set earlier are not affected */
+  failed += apitest_verify_set_tags (libmp4tag, which);
+
+  return failed;
+}
+
+/* if value is null, the tag must not be present */
+static int
+apitest_chk_string (libmp4tag_t *libmp4tag, const char *which,
+    const char *tag, const char *value)
+{
+  mp4tagpub_t   mp4tagpub;
+  int           rc;
+
+  rc = mp4tag_get_tag_by_name (libmp4tag, tag, &mp4tagpub);
+  if (value == NULL) {
+    if (rc != MP4TAG_ERR_TAG_NOT_FOUND) {
+      fprintf (stderr, "%s: %s: present\n", which, tag);
+      return 1;
+    }
+    return 0;
+  }
+
+  if (rc != MP4TAG_OK ||
+      mp4tagpub.data == NULL ||
+      strcmp (mp4tagpub.data, value) != 0) {
+    fprintf (stderr, "%s: %s: mismatch\n", which, tag);
+    return 1;
+  }
+
+  return 0;
+}
+
+static int
+apitest_count_tags (libmp4tag_t *libmp4tag)
+{
+  mp4tagpub_t   mp4tagpub;
+  int           count = 0;
+
+  mp4tag_iterate_init (libmp4tag);
+  while (mp4tag_iterate (libmp4tag, &mp4tagpub) == MP4TAG_OK) {
+    ++count;
+  }
+
+  return count;
+}
+
+static libmp4tag_t *
+apitest_open (const char *fn)
+{
+  libmp4tag_t   *libmp4tag;
+  int           mp4error;
+
+  libmp4tag = mp4tag_open (fn, &mp4error);
+  if (libmp4tag == NULL) {
+    fprintf (stderr, "%s: unable to open (%d)\n", fn, mp4error);
+    return NULL;
+  }
+  if (mp4tag_parse (libmp4tag) != MP4TAG_OK) {
+    fprintf (stderr, "%s: unable to parse (%s)\n", fn,
+        mp4tag_error_str (libmp4tag));
+    mp4tag_free (libmp4tag);
+    return NULL;
+  }
+
+  return libmp4tag;
+}
@@ -0,0 +1,987 @@
+/*
+ * Copyright 2026 Brad Lanam Pleasant Hill CA
+ *
+ * mp4tagbench
+ *    Times the parse of one or more MP4 files using the various
+ *    libmp4tag read methods.
+ *    The probe method only locates the duration.
+ *    The batch methods parse all of the files in each iteration with
+ *    mp4tag_parse_batch, using io_uring (batch) or reading the files
+ *    one at a time (batch-sync).
+ *    The many methods parse all of the files in each iteration with
+ *    mp4tag_parse_many, using <n> worker threads (many, the default is
+ *    the number of processors) or a single thread (many-1).
+ *
+ *    mp4tagbench [--iterations <n>] [--method <method>] [--workers <n>]
+ *        [--filter <tag> ...] <file> ...
+ *
+ *    With --relocate, the chunk offset relocation used by the write
+ *    process is timed against a simple loop for 32-bit (stco) and
+ *    64-bit (co64) tables of <count> offsets.  No file is needed.
+ *
+ *    mp4tagbench --relocate <count> [--iterations <n>]
+ *
+ *    With --scale, the files are parsed with mp4tag_parse_many using
+ *    1, 2, 4, ... up to <n> workers, and the throughput for each
+ *    number of workers is displayed.
+ *
+ *    mp4tagbench --scale <n> [--iterations <n>] <file> ...
+ *
+ *    With --boxes, a synthetic file is built in memory with a 'moov'
+ *    box holding <count> tracks of 14 boxes each, and is parsed using
+ *    mp4tag_feed.  The parse time for each box is displayed.
+ *    No file is needed.
+ *
+ *    mp4tagbench --boxes <count> [--iterations <n>]
+ *
+ *    With --custom, a synthetic file is built in memory with <count>
+ *    custom (----) tags.  The time to locate, update and add each
+ *    custom tag is displayed.  The tags are added one at a time
+ *    (add) and with mp4tag_set_tags (add-batch), and are deleted one
+ *    at a time (delete) and with mp4tag_delete_tags_by_prefix
+ *    (delete-prefix).  No file is needed.
+ *
+ *    mp4tagbench --custom <count> [--iterations <n>]
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "libmp4tag.h"
+#include "mp4tagint.h"
+#include "mp4tagbe.h"
+
+enum {
+  BENCH_ITERATIONS = 1000,
+  BENCH_FILTER_MAX = 20,
+  /* the relocation is moved by this amount for every offset */
+  BENCH_CO_STEP = 1000,
+  BENCH_CO_DELTA = 2048,
+  /* the synthetic file */
+  BENCH_BOX_DEPTH = 10,
+  BENCH_TRACK_SZ = 400,
+  BENCH_BOX_EXTRA = 4096,
+  BENCH_CUSTOM_SZ = 128,
+  BENCH_TAG_SZ = 64,
+};
+
+enum {
+  BENCH_FILE,
+  BENCH_READONLY,
+  BENCH_STREAM,
+  BENCH_STREAM_WAIT,
+  BENCH_PROBE,
+  BENCH_BATCH,
+  BENCH_BATCH_SYNC,
+  BENCH_MANY,
+  BENCH_MANY_ONE,
+  BENCH_WORKER_MAX = 256,
+  /* use the library's default read-ahead buffer size (off) */
+  BENCH_RA_DEFAULT = -1,
+  BENCH_RA_SZ = 64 * 1024,
+};
+
+typedef struct {
+  const char  *name;
+  int         type;
+  int         options;
+  ssize_t     rabuffsz;
+} benchmethod_t;
+
+typedef struct {
+  FILE        *fh;
+  uint64_t    readcount;
+  uint64_t    seekcount;
+} benchstream_t;
+
+typedef struct {
+  char        *data;
+  size_t      len;
+  size_t      start [BENCH_BOX_DEPTH];
+  int         depth;
+  int         boxes;
+} benchbuild_t;
+
+static const benchmethod_t benchmethods [] = {
+  { "fread",        BENCH_FILE,   MP4TAG_OPTION_NONE, BENCH_RA_DEFAULT },
+  { "mmap",         BENCH_FILE,   MP4TAG_OPTION_MMAP, BENCH_RA_DEFAULT },
+  { "ilstview",     BENCH_FILE,   MP4TAG_OPTION_ILST_VIEW, BENCH_RA_DEFAULT },
+  { "readonly",     BENCH_READONLY, MP4TAG_OPTION_NONE, BENCH_RA_DEFAULT },
+  { "stream",       BENCH_STREAM, MP4TAG_OPTION_NONE, BENCH_RA_DEFAULT },
+  { "stream-buf",   BENCH_STREAM, MP4TAG_OPTION_NONE, BENCH_RA_SZ },
+  { "stream-wait",  BENCH_STREAM_WAIT, MP4TAG_OPTION_NONE, BENCH_RA_SZ },
+  { "probe",        BENCH_PROBE,  MP4TAG_OPTION_NONE, BENCH_RA_DEFAULT },
+  { "batch",        BENCH_BATCH,  MP4TAG_OPTION_NONE, BENCH_RA_DEFAULT },
+  { "batch-sync",   BENCH_BATCH_SYNC, MP4TAG_OPTION_NONE, BENCH_RA_DEFAULT },
+  { "many",         BENCH_MANY,   MP4TAG_OPTION_NONE, BENCH_RA_DEFAULT },
+  { "many-1",       BENCH_MANY_ONE, MP4TAG_OPTION_NONE, BENCH_RA_DEFAULT },
+};
+enum {
+  BENCH_METHOD_MAX = sizeof (benchmethods) / sizeof (benchmethod_t),
+};
+
+static int64_t bench_parse (const benchmethod_t *method, int iterations, int fcount, char *fnames [], const char *filter [], int filtercount, benchstream_t *stream);
+static int64_t bench_many (int workers, int iterations, int fcount, char *fnames [], mp4tagworkerstats_t stats []);
+static libmp4tag_t * bench_open (const benchmethod_t *method, const char *fname, const char *filter [], int filtercount, benchstream_t *stream);
+static size_t bench_readcb (char *buff, size_t sz, size_t nmemb, void *udata);
+static int bench_seekcb (size_t offset, void *udata);
+static int bench_waitcb (uint32_t timeout, void *udata);
+static void bench_batchcb (libmp4tag_t *libmp4tag, int idx, int mp4error, void *udata);
+static int bench_scale (int maxworkers, int iterations, int fcount, char *fnames []);
+static int bench_relocate (int iterations, uint32_t count);
+static int64_t bench_relocate_table (char *table, uint32_t count, int offsetsz, int iterations, bool simple);
+static void bench_relocate_simple (char *dptr, uint32_t count, int offsetsz, uint64_t foffset, int32_t delta);
+static int bench_boxes (int iterations, int tracks);
+static int bench_custom (int iterations, int count);
+static libmp4tag_t * bench_custom_open (benchbuild_t *build);
+static void bench_box_open (benchbuild_t *build, const char *nm);
+static void bench_box_close (benchbuild_t *build);
+static char * bench_box_add (benchbuild_t *build, const char *nm, size_t len);
+static int64_t bench_time (void);
+
+int
+main (int argc, char *argv [])
+{
+  int           c;
+  int           option_index;
+  int           iterations = BENCH_ITERATIONS;
+  const char    *methodnm = NULL;
+  const char    *filter [BENCH_FILTER_MAX];
+  int           filtercount = 0;
+  int64_t       basetm = 0;
+  uint32_t      relocate = 0;
+  int           boxes = 0;
+  int           custom = 0;
+  int           workers = 0;
+  int           scale = 0;
+  static mp4tagworkerstats_t stats [BENCH_WORKER_MAX];
+
+  static struct option mp4tagbench_options [] = {
+    { "boxes",          required_argument,  NULL,   'b' },
+    { "custom",         required_argument,  NULL,   'c' },
+    { "filter",         required_argument,  NULL,   'f' },
+    { "iterations",     required_argument,  NULL,   'i' },
+    { "method",         required_argument,  NULL,   'm' },
+    { "relocate",       required_argument,  NULL,   'r' },
+    { "scale",          required_argument,  NULL,   's' },
+    { "workers",        required_argument,  NULL,   'w' },
+    { NULL,             0,                  NULL,   0 }
+  };
+
+  while ((c = getopt_long_only (argc, argv, "b:c:f:i:m:r:s:w:",
+      mp4tagbench_options, &option_index)) != -1) {
+    switch (c) {
+      case 'b': {
+        boxes = atoi (optarg);
+        break;
+      }
+      case 'c': {
+        custom = atoi (optarg);
+        break;
+      }
+      case 'f': {
+        if (filtercount < BENCH_FILTER_MAX) {
+          filter [filtercount++] = optarg;
+        }
+        break;
+      }
+      case 'i': {
+        iterations = atoi (optarg);
+        break;
+      }
+      case 'm': {
+        methodnm = optarg;
+        break;
+      }
+      case 'r': {
+        relocate = (uint32_t) atol (optarg);
+        break;
+      }
+      case 's': {
+        scale = atoi (optarg);
+        if (scale > BENCH_WORKER_MAX) {
+          scale = BENCH_WORKER_MAX;
+        }
+        break;
+      }
+      case 'w': {
+        workers = atoi (optarg);
+        if (workers > BENCH_WORKER_MAX) {
+          workers = BENCH_WORKER_MAX;
+        }
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+  }
+
+  if (iterations <= 0) {
+    iterations = 1;
+  }
+
+  if (relocate > 0) {
+    if (bench_relocate (iterations, relocate) != 0) {
+      exit (1);
+    }
+    return 0;
+  }
+
+  if (boxes > 0) {
+    if (bench_boxes (iterations, boxes) != 0) {
+      exit (1);
+    }
+    return 0;
+  }
+
+  if (custom > 0) {
+    if (bench_custom (iterations, custom) != 0) {
+      exit (1);
+    }
+    return 0;
+  }
+
+  if (optind >= argc) {
+    fprintf (stderr, "no file specified\n");
+    exit (1);
+  }
+
+  if (scale > 0) {
+    if (bench_scale (scale, iterations, argc - optind, argv + optind) != 0) {
+      exit (1);
+    }
+    return 0;
+  }
+
+  for (int i = 0; i < BENCH_METHOD_MAX; ++i) {
+    const benchmethod_t *method = &benchmethods [i];
+    benchstream_t       stream;
+    int64_t             tm;
+
+    if (methodnm != NULL && strcmp (methodnm, method->name) != 0) {
+      continue;
+    }
+
+    stream.readcount = 0;
+    stream.seekcount = 0;
+    if (method->type == BENCH_MANY || method->type == BENCH_MANY_ONE) {
+      tm = bench_many (method->type == BENCH_MANY_ONE ? 1 : workers,
+          iterations, argc - optind, argv + optind, stats);
+    } else {
+      tm = bench_parse (method, iterations, argc - optind, argv + optind,
+          filter, filtercount, &stream);
+    }
+    if (tm < 0) {
+      exit (1);
+    }
+    if (basetm == 0) {
+      basetm = tm;
+    }
+    fprintf (stdout, "%-12s %10.3f ms %10.3f us/parse %6.2fx",
+        method->name, (double) tm / 1000000.0,
+        (double) tm / 1000.0 / (double) iterations / (double) (argc - optind),
+        (double) basetm / (double) (tm > 0 ? tm : 1));
+    if (method->type == BENCH_STREAM || method->type == BENCH_STREAM_WAIT) {
+      fprintf (stdout, "  read-cb/parse %.1f seek-cb/parse %.1f",
+          (double) stream.readcount / (double) iterations / (double) (argc - optind),
+          (double) stream.seekcount / (double) iterations / (double) (argc - optind));
+    }
+    if (method->type == BENCH_MANY && workers > 0) {
+      /* the statistics are from the last iteration */
+      fprintf (stdout, "  files/worker");
+      for (int j = 0; j < workers; ++j) {
+        fprintf (stdout, " %d", stats [j].files);
+      }
+      fprintf (stdout, "  steals");
+      for (int j = 0; j < workers; ++j) {
+        fprintf (stdout, " %d", stats [j].steals);
+      }
+    }
+    fprintf (stdout, "\n");
+  }
+
+  return 0;
+}
+
+static int64_t
+bench_parse (const benchmethod_t *method, int iterations, int fcount,
+    char *fnames [], const char *filter [], int filtercount,
+    benchstream_t *stream)
+{
+  libmp4tag_t   *libmp4tag;
+  mp4tagprobe_t mp4tagprobe;
+  int64_t       tm;
+  int           rc;
+
+  tm = bench_time ();
+  for (int i = 0; i < iterations; ++i) {
+    if (method->type == BENCH_BATCH || method->type == BENCH_BATCH_SYNC) {
+      const char  **fn = (const char **) fnames;
+      int         failed = 0;
+
+      /* a depth of one reads the files one at a time */
+      rc = mp4tag_parse_batch (fn, fcount,
+          method->type == BENCH_BATCH_SYNC ? 1 : 0, bench_batchcb, &failed);
+      if (rc != MP4TAG_OK || failed > 0) {
+        return -1;
+      }
+      continue;
+    }
+    for (int j = 0; j < fcount; ++j) {
+      libmp4tag = bench_open (method, fnames [j], filter, filtercount, stream);
+      if (libmp4tag == NULL) {
+        fprintf (stderr, "unable to open %s\n", fnames [j]);
+        return -1;
+      }
+      if (method->type == BENCH_PROBE) {
+        rc = mp4tag_probe (libmp4tag, &mp4tagprobe);
+      } else {
+        rc = mp4tag_parse (libmp4tag);
+      }
+      if (rc != MP4TAG_OK) {
+        fprintf (stderr, "unable to parse %s (%s)\n", fnames [j],
+            mp4tag_error_str (libmp4tag));
+        mp4tag_free (libmp4tag);
+        return -1;
+      }
+      mp4tag_free (libmp4tag);
+      if (stream->fh != NULL) {
+        fclose (stream->fh);
+        stream->fh = NULL;
+      }
+    }
+  }
+
+  return bench_time () - tm;
+}
+
+/* the per-worker statistics are only available if the number of */
+/* workers is specified */
+static int64_t
+bench_many (int workers, int iterations, int fcount, char *fnames [],
+    mp4tagworkerstats_t stats [])
+{
+  const char  **fn = (const char **) fnames;
+  int         *results;
+  int64_t     tm;
+  int         rc;
+
+  results = malloc (sizeof (int) * fcount);
+  if (results == NULL) {
+    return -1;
+  }
+
+  tm = bench_time ();
+  for (int i = 0; i < iterations; ++i) {
+    rc = mp4tag_parse_many (fn, fcount, workers, NULL, NULL, results,
+        workers > 0 ? stats : NULL);
+    for (int j = 0; rc == MP4TAG_OK && j < fcount; ++j) {
+      if (results [j] != MP4TAG_OK) {
+        fprintf (stderr, "unable to parse %s (%d)\n", fnames [j], results [j]);
+        rc = results [j];
+      }
+    }
+    if (rc != MP4TAG_OK) {
+      free (results);
+      return -1;
+    }
+  }
+  tm = bench_time () - tm;
+
+  free (results);
+  return tm;
+}
+
+static int
+bench_scale (int maxworkers, int iterations, int fcount, char *fnames [])
+{
+  int64_t     tm;
+  int64_t     basetm = 0;
+  int         workers = 1;
+
+  while (true) {
+    tm = bench_many (workers, iterations, fcount, fnames, NULL);
+    if (tm < 0) {
+      return -1;
+    }
+    if (basetm == 0) {
+      basetm = tm;
+    }
+    fprintf (stdout, "workers %3d %10.3f ms %10.1f files/s %6.2fx\n",
+        workers, (double) tm / 1000000.0,
+        (double) fcount * (double) iterations /
+        ((double) (tm > 0 ? tm : 1) / 1000000000.0),
+        (double) basetm / (double) (tm > 0 ? tm : 1));
+    if (workers >= maxworkers) {
+      break;
+    }
+    workers *= 2;
+    if (workers > maxworkers) {
+      workers = maxworkers;
+    }
+  }
+
+  return 0;
+}
+
+static libmp4tag_t *
+bench_open (const benchmethod_t *method, const char *fname,
+    const char *filter [], int filtercount, benchstream_t *stream)
+{
+  libmp4tag_t   *libmp4tag = NULL;
+  int           mp4error;
+
+  stream->fh = NULL;
+
+  if (method->type == BENCH_FILE || method->type == BENCH_PROBE) {
+    libmp4tag = mp4tag_open (fname, &mp4error);
+  }
+  if (method->type == BENCH_READONLY) {
+    libmp4tag = mp4tag_open_readonly (fname, &mp4error);
+  }
+  if (method->type == BENCH_STREAM || method->type == BENCH_STREAM_WAIT) {
+    stream->fh = mp4tag_fopen (fname, "rb");
+    if (stream->fh == NULL) {
+      return NULL;
+    }
+    /* the stdio buffering is turned off so that the cost of each */
+    /* callback is closer to that of a real stream */
+    setvbuf (stream->fh, NULL, _IONBF, 0);
+    /* a timeout of zero, as the end of the file is known to be */
+    /* the end of the stream */
+    libmp4tag = mp4tag_openstream (bench_readcb, bench_seekcb, stream,
+        0, &mp4error);
+  }
+  if (libmp4tag == NULL) {
+    if (stream->fh != NULL) {
+      fclose (stream->fh);
+      stream->fh = NULL;
+    }
+    return NULL;
+  }
+
+  mp4tag_set_option (libmp4tag, method->options);
+  if (method->type == BENCH_STREAM_WAIT) {
+    /* the end of the stream is reported by the wait callback, */
+    /* rather than waiting for the timeout */
+    mp4tag_set_wait_callback (libmp4tag, bench_waitcb);
+  }
+  if (method->rabuffsz != BENCH_RA_DEFAULT) {
+    mp4tag_set_read_buffer (libmp4tag, method->rabuffsz);
+  }
+  if (filtercount > 0) {
+    mp4tag_set_tag_filter (libmp4tag, filter, filtercount);
+  }
+
+  return libmp4tag;
+}
+
+/* the offsets are in increasing order, as in a real table. */
+/* the relocation point is a quarter of the way in */
+static int
+bench_relocate (int iterations, uint32_t count)
+{
+  static const int  offsetszs [] = { sizeof (uint32_t), sizeof (uint64_t) };
+  char              *table;
+  char              *check;
+  int               rc = 0;
+
+  table = malloc ((size_t) count * sizeof (uint64_t));
+  check = malloc ((size_t) count * sizeof (uint64_t));
+  if (table == NULL || check == NULL) {
+    free (table);
+    free (check);
+    fprintf (stderr, "out of memory\n");
+    return 1;
+  }
+
+  for (size_t k = 0; k < sizeof (offsetszs) / sizeof (int); ++k) {
+    int       offsetsz = offsetszs [k];
+    size_t    tsz = (size_t) count * offsetsz;
+    int64_t   simpletm;
+    int64_t   tm;
+
+    /* both must produce the same table */
+    bench_relocate_table (table, count, offsetsz, 1, true);
+    bench_relocate_table (check, count, offsetsz, 1, false);
+    if (memcmp (table, check, tsz) != 0) {
+      fprintf (stderr, "%s: relocation does not match\n",
+          offsetsz == sizeof (uint32_t) ? "stco" : "co64");
+      rc = 1;
+      break;
+    }
+
+    simpletm = bench_relocate_table (table, count, offsetsz, iterations, true);
+    tm = bench_relocate_table (table, count, offsetsz, iterations, false);
+    fprintf (stdout, "%s-simple   %10.3f ms %10.3f us/table\n",
+        offsetsz == sizeof (uint32_t) ? "stco" : "co64",
+        (double) simpletm / 1000000.0,
+        (double) simpletm / 1000.0 / (double) iterations);
+    fprintf (stdout, "%s-relocate %10.3f ms %10.3f us/table %6.2fx\n",
+        offsetsz == sizeof (uint32_t) ? "stco" : "co64",
+        (double) tm / 1000000.0,
+        (double) tm / 1000.0 / (double) iterations,
+        (double) simpletm / (double) (tm > 0 ? tm : 1));
+  }
+
+  free (table);
+  free (check);
+  return rc;
+}
+
+static int64_t
+bench_relocate_table (char *table, uint32_t count, int offsetsz,
+    int iterations, bool simple)
+{
+  uint64_t    foffset;
+  int64_t     tm;
+
+  for (uint32_t i = 0; i < count; ++i) {
+    uint64_t    t64 = (uint64_t) i * BENCH_CO_STEP;
+    uint32_t    t32 = (uint32_t) t64;
+
+    if (offsetsz == sizeof (uint32_t)) {
+      t32 = htobe32 (t32);
+      memcpy (table + i * sizeof (uint32_t), &t32, sizeof (uint32_t));
+    } else {
+      t64 = htobe64 (t64);
+      memcpy (table + i * sizeof (uint64_t), &t64, sizeof (uint64_t));
+    }
+  }
+  foffset = (uint64_t) count / 4 * BENCH_CO_STEP;
+
+  /* the offsets past the relocation point move further away */
+  /* on each iteration, the same offsets are changed every time */
+  tm = bench_time ();
+  for (int i = 0; i < iterations; ++i) {
+    if (simple) {
+      bench_relocate_simple (table, count, offsetsz, foffset, BENCH_CO_DELTA);
+    } else if (offsetsz == sizeof (uint32_t)) {
+      mp4tag_relocate_offsets_32 (table, count, foffset, BENCH_CO_DELTA);
+    } else {
+      mp4tag_relocate_offsets_64 (table, count, foffset, BENCH_CO_DELTA);
+    }
+  }
+
+  return bench_time () - tm;
+}
+
+/* one offset at a time */
+static void
+bench_relocate_simple (char *dptr, uint32_t count, int offsetsz,
+    uint64_t foffset, int32_t delta)
+{
+  uint32_t  t32;
+  uint64_t  t64;
+
+  for (uint32_t i = 0; i < count; ++i) {
+    if (offsetsz == sizeof (uint32_t)) {
+      memcpy (&t32, dptr, sizeof (uint32_t));
+      t32 = be32toh (t32);
+      if (t32 > foffset) {
+        t32 += delta;
+        t32 = htobe32 (t32);
+        memcpy (dptr, &t32, sizeof (uint32_t));
+      }
+    }
+    if (offsetsz == sizeof (uint64_t)) {
+      memcpy (&t64, dptr, sizeof (uint64_t));
+      t64 = be64toh (t64);
+      if (t64 > foffset) {
+        t64 += delta;
+        t64 = htobe64 (t64);
+        memcpy (dptr, &t64, sizeof (uint64_t));
+      }
+    }
+    dptr += offsetsz;
+  }
+}
+
+/* the tracks are the boxes the parser looks at in an audio file, */
+/* the chunk offset tables are empty */
+static int
+bench_boxes (int iterations, int tracks)
+{
+  benchbuild_t  build;
+  libmp4tag_t   *libmp4tag;
+  char          *dptr;
+  int64_t       tm;
+  int           mp4error;
+  int           rc = MP4TAG_OK;
+
+  build.data = calloc ((size_t) tracks * BENCH_TRACK_SZ + BENCH_BOX_EXTRA, 1);
+  if (build.data == NULL) {
+    fprintf (stderr, "out of memory\n");
+    return 1;
+  }
+  build.len = 0;
+  build.depth = 0;
+  build.boxes = 0;
+
+  /* major brand, version, compatible brands */
+  dptr = bench_box_add (&build, "ftyp", 16);
+  memcpy (dptr, "M4A ", 4);
+  memcpy (dptr + 8, "M4A mp42", 8);
+  bench_box_open (&build, "moov");
+  bench_box_add (&build, "mvhd", 100);
+  for (int i = 0; i < tracks; ++i) {
+    bench_box_open (&build, "trak");
+    bench_box_add (&build, "tkhd", 84);
+    bench_box_open (&build, "mdia");
+    dptr = bench_box_add (&build, "mdhd", 24);
+    /* flags, creation date, modified date, timescale, duration */
+    dptr [15] = 100;
+    dptr [19] = 100;
+    bench_box_add (&build, "hdlr", 25);
+    bench_box_open (&build, "minf");
+    bench_box_add (&build, "smhd", 8);
+    bench_box_add (&build, "dinf", 28);
+    bench_box_open (&build, "stbl");
+    bench_box_add (&build, "stsd", 8);
+    bench_box_add (&build, "stts", 8);
+    bench_box_add (&build, "stsc", 8);
+    bench_box_add (&build, "stsz", 12);
+    bench_box_add (&build, "stco", 8);
+    bench_box_close (&build);
+    bench_box_close (&build);
+    bench_box_close (&build);
+    bench_box_close (&build);
+  }
+  bench_box_open (&build, "udta");
+  bench_box_open (&build, "meta");
+  build.len += sizeof (uint32_t);
+  bench_box_add (&build, "hdlr", 25);
+  bench_box_open (&build, "ilst");
+  bench_box_open (&build, "\xa9nam");
+  dptr = bench_box_add (&build, "data", 13);
+  dptr [3] = MP4TAG_ID_STRING;
+  memcpy (dptr + 8, "bench", 5);
+  bench_box_close (&build);
+  bench_box_close (&build);
+  bench_box_close (&build);
+  bench_box_close (&build);
+  bench_box_close (&build);
+
+  tm = bench_time ();
+  for (int i = 0; i < iterations && rc == MP4TAG_OK; ++i) {
+    libmp4tag = mp4tag_openfeed (&mp4error);
+    if (libmp4tag == NULL) {
+      rc = mp4error;
+      break;
+    }
+    rc = mp4tag_feed (libmp4tag, build.data, build.len);
+    if (rc == MP4TAG_NEED_DATA) {
+      rc = mp4tag_feed (libmp4tag, NULL, 0);
+    }
+    mp4tag_free (libmp4tag);
+  }
+  tm = bench_time () - tm;
+  free (build.data);
+
+  if (rc != MP4TAG_OK) {
+    fprintf (stderr, "unable to parse the synthetic file (%d)\n", rc);
+    return 1;
+  }
+
+  fprintf (stdout, "boxes %d     %10.3f ms %10.3f us/parse %8.2f ns/box\n",
+      build.boxes, (double) tm / 1000000.0,
+      (double) tm / 1000.0 / (double) iterations,
+      (double) tm / (double) iterations / (double) build.boxes);
+  return 0;
+}
+
+static int
+bench_custom (int iterations, int count)
+{
+  benchbuild_t  build;
+  libmp4tag_t   *libmp4tag;
+  mp4tagpub_t   mp4tagpub;
+  mp4tagpub_t   *items;
+  char          *names;
+  char          *dptr;
+  char          tag [BENCH_TAG_SZ];
+  char          value [BENCH_TAG_SZ];
+  int64_t       gettm = 0;
+  int64_t       settm = 0;
+  int64_t       addtm = 0;
+  int64_t       batchtm = 0;
+  int64_t       deltm = 0;
+  int64_t       prefixtm = 0;
+  int64_t       tm;
+  int           rc = MP4TAG_OK;
+
+  build.data = calloc ((size_t) count * BENCH_CUSTOM_SZ + BENCH_BOX_EXTRA, 1);
+  items = calloc (count, sizeof (mp4tagpub_t));
+  names = malloc ((size_t) count * BENCH_TAG_SZ);
+  if (build.data == NULL || items == NULL || names == NULL) {
+    fprintf (stderr, "out of memory\n");
+    return 1;
+  }
+  build.len = 0;
+  build.depth = 0;
+  build.boxes = 0;
+
+  for (int i = 0; i < count; ++i) {
+    snprintf (names + (size_t) i * BENCH_TAG_SZ, BENCH_TAG_SZ,
+        "----:MP4TAGBENCH:NEW%06d", (int) (((int64_t) i * 7919) % count));
+    items [i].tag = names + (size_t) i * BENCH_TAG_SZ;
+    items [i].data = "added";
+  }
+
+  /* major brand, version, compatible brands */
+  dptr = bench_box_add (&build, "ftyp", 16);
+  memcpy (dptr, "M4A ", 4);
+  memcpy (dptr + 8, "M4A mp42", 8);
+  bench_box_open (&build, "moov");
+  bench_box_add (&build, "mvhd", 100);
+  bench_box_open (&build, "udta");
+  bench_box_open (&build, "meta");
+  build.len += sizeof (uint32_t);
+  bench_box_add (&build, "hdlr", 25);
+  bench_box_open (&build, "ilst");
+  for (int i = 0; i < count; ++i) {
+    size_t    len;
+
+    bench_box_open (&build, "----");
+    /* 'mean' and 'name' have 4 bytes of flags */
+    dptr = bench_box_add (&build, "mean", 4 + strlen ("MP4TAGBENCH"));
+    memcpy (dptr + 4, "MP4TAGBENCH", strlen ("MP4TAGBENCH"));
+    len = snprintf (tag, sizeof (tag), "TAG%06d", i);
+    dptr = bench_box_add (&build, "name", 4 + len);
+    memcpy (dptr + 4, tag, len);
+    len = snprintf (value, sizeof (value), "value %d", i);
+    dptr = bench_box_add (&build, "data", 8 + len);
+    dptr [3] = MP4TAG_ID_STRING;
+    memcpy (dptr + 8, value, len);
+    bench_box_close (&build);
+  }
+  bench_box_close (&build);
+  bench_box_close (&build);
+  bench_box_close (&build);
+  bench_box_close (&build);
+
+  for (int i = 0; i < iterations && rc == MP4TAG_OK; ++i) {
+    libmp4tag = bench_custom_open (&build);
+    if (libmp4tag == NULL) {
+      rc = MP4TAG_ERR_NOT_PARSED;
+      break;
+    }
+
+    /* the tags are visited in a scattered order */
+    tm = bench_time ();
+    for (int j = 0; j < count && rc == MP4TAG_OK; ++j) {
+      snprintf (tag, sizeof (tag), "----:MP4TAGBENCH:TAG%06d",
+          (int) (((int64_t) j * 7919) % count));
+      rc = mp4tag_get_tag_by_name (libmp4tag, tag, &mp4tagpub);
+    }
+    gettm += bench_time () - tm;
+
+    tm = bench_time ();
+    for (int j = 0; j < count && rc == MP4TAG_OK; ++j) {
+      snprintf (tag, sizeof (tag), "----:MP4TAGBENCH:TAG%06d",
+          (int) (((int64_t) j * 7919) % count));
+      rc = mp4tag_set_tag (libmp4tag, tag, "updated", false);
+    }
+    settm += bench_time () - tm;
+
+    tm = bench_time ();
+    for (int j = 0; j < count && rc == MP4TAG_OK; ++j) {
+      snprintf (tag, sizeof (tag), "----:MP4TAGBENCH:NEW%06d",
+          (int) (((int64_t) j * 7919) % count));
+      rc = mp4tag_set_tag (libmp4tag, tag, "added", false);
+    }
+    addtm += bench_time () - tm;
+
+    mp4tag_free (libmp4tag);
+    if (rc != MP4TAG_OK) {
+      break;
+    }
+
+    libmp4tag = bench_custom_open (&build);
+    if (libmp4tag == NULL) {
+      rc = MP4TAG_ERR_NOT_PARSED;
+      break;
+    }
+    tm = bench_time ();
+    rc = mp4tag_set_tags (libmp4tag, items, count);
+    batchtm += bench_time () - tm;
+    mp4tag_free (libmp4tag);
+    if (rc != MP4TAG_OK) {
+      break;
+    }
+
+    libmp4tag = bench_custom_open (&build);
+    if (libmp4tag == NULL) {
+      rc = MP4TAG_ERR_NOT_PARSED;
+      break;
+    }
+    tm = bench_time ();
+    for (int j = 0; j < count && rc == MP4TAG_OK; ++j) {
+      snprintf (tag, sizeof (tag), "----:MP4TAGBENCH:TAG%06d",
+          (int) (((int64_t) j * 7919) % count));
+      rc = mp4tag_delete_tag (libmp4tag, tag);
+    }
+    /* the deleted tags are removed from the tag list here */
+    mp4tag_iterate_init (libmp4tag);
+    mp4tag_iterate (libmp4tag, &mp4tagpub);
+    deltm += bench_time () - tm;
+    mp4tag_free (libmp4tag);
+    if (rc != MP4TAG_OK) {
+      break;
+    }
+
+    libmp4tag = bench_custom_open (&build);
+    if (libmp4tag == NULL) {
+      rc = MP4TAG_ERR_NOT_PARSED;
+      break;
+    }
+    tm = bench_time ();
+    rc = mp4tag_delete_tags_by_prefix (libmp4tag, "----:MP4TAGBENCH:");
+    prefixtm += bench_time () - tm;
+    mp4tag_free (libmp4tag);
+  }
+  free (build.data);
+  free (items);
+  free (names);
+
+  if (rc != MP4TAG_OK) {
+    fprintf (stderr, "custom tag benchmark failed (%d)\n", rc);
+    return 1;
+  }
+
+  fprintf (stdout, "custom %d get %10.3f ms %8.2f ns/tag\n", count,
+      (double) gettm / 1000000.0,
+      (double) gettm / (double) iterations / (double) count);
+  fprintf (stdout, "custom %d set %10.3f ms %8.2f ns/tag\n", count,
+      (double) settm / 1000000.0,
+      (double) settm / (double) iterations / (double) count);
+  fprintf (stdout, "custom %d add %10.3f ms %8.2f ns/tag\n", count,
+      (double) addtm / 1000000.0,
+      (double) addtm / (double) iterations / (double) count);
+  fprintf (stdout, "custom %d add-batch %10.3f ms %8.2f ns/tag\n", count,
+      (double) batchtm / 1000000.0,
+      (double) batchtm / (double) iterations / (double) count);
+  fprintf (stdout, "custom %d delete %10.3f ms %8.2f ns/tag\n", count,
+      (double) deltm / 1000000.0,
+      (double) deltm / (double) iterations / (double) count);
+  fprintf (stdout, "custom %d delete-prefix %10.3f ms %8.2f ns/tag\n", count,
+      (double) prefixtm / 1000000.0,
+      (double) prefixtm / (double) iterations / (double) count);
+  return 0;
+}
+
+static libmp4tag_t *
+bench_custom_open (benchbuild_t *build)
+{
+  libmp4tag_t   *libmp4tag;
+  int           mp4error;
+  int           rc;
+
+  libmp4tag = mp4tag_openfeed (&mp4error);
+  if (libmp4tag == NULL) {
+    return NULL;
+  }
+  rc = mp4tag_feed (libmp4tag, build->data, build->len);
+  if (rc == MP4TAG_NEED_DATA) {
+    rc = mp4tag_feed (libmp4tag, NULL, 0);
+  }
+  if (rc != MP4TAG_OK) {
+    mp4tag_free (libmp4tag);
+    return NULL;
+  }
+  return libmp4tag;
+}
+
+/* the length is filled in when the box is closed */
+static void
+bench_box_open (benchbuild_t *build, const char *nm)
+{
+  build->start [build->depth++] = build->len;
+  bench_box_add (build, nm, 0);
+}
+
+static void
+bench_box_close (benchbuild_t *build)
+{
+  size_t    start;
+  uint32_t  t32;
+
+  start = build->start [--build->depth];
+  t32 = htobe32 ((uint32_t) (build->len - start));
+  memcpy (build->data + start, &t32, sizeof (uint32_t));
+}
+
+/* returns a pointer to the box contents, which are zeroed */
+static char *
+bench_box_add (benchbuild_t *build, const char *nm, size_t len)
+{
+  char      *dptr;
+  uint32_t  t32;
+
+  dptr = build->data + build->len;
+  t32 = htobe32 ((uint32_t) (len + MP4TAG_BOXHEAD_SZ));
+  memcpy (dptr, &t32, sizeof (uint32_t));
+  memcpy (dptr + sizeof (uint32_t), nm, MP4TAG_ID_LEN);
+  build->len += MP4TAG_BOXHEAD_SZ + len;
+  build->boxes += 1;
+  return dptr + MP4TAG_BOXHEAD_SZ;
+}
+
+static size_t
+bench_readcb (char *buff, size_t sz, size_t nmemb, void *udata)
+{
+  benchstream_t *stream = udata;
+
+  ++stream->readcount;
+  return fread (buff, sz, nmemb, stream->fh);
+}
+
+static int
+bench_seekcb (size_t offset, void *udata)
+{
+  benchstream_t *stream = udata;
+
+  ++stream->seekcount;
+  return mp4tag_fseek (stream->fh, offset, SEEK_CUR);
+}
+
+static int
+bench_waitcb (uint32_t timeout, void *udata)
+{
+  benchstream_t *stream = udata;
+
+  if (feof (stream->fh)) {
+    return 1;
+  }
+  return 0;
+}
+
+static void
+bench_batchcb (libmp4tag_t *libmp4tag, int idx, int mp4error, void *udata)
+{
+  int   *failed = udata;
+
+  if (mp4error != MP4TAG_OK) {
+    fprintf (stderr, "unable to parse file %d (%s)\n", idx,
+        libmp4tag == NULL ? "open" : mp4tag_error_str (libmp4tag));
+    *failed += 1;
+  }
+}
+
+/* nanoseconds */
+static int64_t
+bench_time (void)
+{
+  struct timespec   ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,414 @@
+/*
+ * Copyright 2026 Brad Lanam Pleasant Hill CA
+ *
+ * mp4tagstress
+ *    Parses and writes separate copies of an MP4 file on many threads
+ *    at once.  Each thread sets its own tags in its own copy, writes
+ *    them, and verifies them with a new handle.  The copies are then
+ *    parsed with mp4tag_parse_many and verified again.  Last, the
+ *    threads get the tags from a single parsed handle at once, which
+ *    loads the cover images that were not read during the parse.
+ *    Intended to be run with a thread sanitizer build
+ *    (LIBMP4TAG_BUILD=SanitizeThread).
+ *
+ *    mp4tagstress [--threads <n>] [--iterations <n>] <file>
+ *
+ *    The copies are created in the current directory and removed
+ *    when the test is done.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "libmp4tag.h"
+
+enum {
+  STRESS_THREADS = 32,
+  STRESS_ITERATIONS = 20,
+  STRESS_FN_SZ = 512,
+  STRESS_DATA_SZ = 100,
+  STRESS_GET_REPEAT = 10,
+};
+
+static const char *STRESS_TAG = "----:MP4TAGSTRESS:THREAD";
+static const char *STRESS_TITLE = "\xc2\xa9nam";
+static const char *STRESS_GET_TAGS [] = {
+  "covr", "covr:1", "\xc2\xa9nam", "----:MP4TAGSTRESS:THREAD",
+  /* never present */
+  "----:MP4TAGSTRESS:MISSING",
+};
+enum {
+  STRESS_GET_COUNT = sizeof (STRESS_GET_TAGS) / sizeof (const char *),
+};
+
+typedef struct {
+  char        fn [STRESS_FN_SZ];
+  pthread_t   thread;
+  int         tidx;
+  int         iterations;
+  int         failed;
+  /* set by the mp4tag_parse_many callback */
+  bool        manyfailed;
+} stress_t;
+
+/* the threads that get the tags from a single handle */
+typedef struct {
+  pthread_t     thread;
+  libmp4tag_t   *libmp4tag;
+  /* the tags retrieved from a separate handle, before the threads */
+  /* are started */
+  mp4tagpub_t   *reference;
+  int           *referencerc;
+  int           failed;
+} stressget_t;
+
+static void * stress_thread (void *arg);
+static int  stress_write (stress_t *stress, int iter);
+static int  stress_verify (libmp4tag_t *libmp4tag, int tidx, int iter);
+static void stress_data (char *buff, size_t sz, int tidx, int iter);
+static void stress_manycb (libmp4tag_t *libmp4tag, int idx, int mp4error, void *udata);
+static int  stress_shared (const char *fn, int threads, int iterations);
+static void * stress_get_thread (void *arg);
+
+int
+main (int argc, char *argv [])
+{
+  int           c;
+  int           option_index;
+  int           threads = STRESS_THREADS;
+  int           iterations = STRESS_ITERATIONS;
+  stress_t      *stress;
+  const char    **fn;
+  char          *data;
+  size_t        datasz;
+  int           mp4error;
+  int           failed = 0;
+  int           manyfailed = 0;
+  int           getfailed = 0;
+
+  static struct option mp4tagstress_options [] = {
+    { "iterations",     required_argument,  NULL,   'i' },
+    { "threads",        required_argument,  NULL,   't' },
+    { NULL,             0,                  NULL,   0 }
+  };
+
+  while ((c = getopt_long_only (argc, argv, "i:t:",
+      mp4tagstress_options, &option_index)) != -1) {
+    switch (c) {
+      case 'i': {
+        iterations = atoi (optarg);
+        break;
+      }
+      case 't': {
+        threads = atoi (optarg);
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+  }
+
+  if (iterations <= 0) {
+    iterations = 1;
+  }
+  if (threads <= 0) {
+    threads = 1;
+  }
+
+  if (optind >= argc) {
+    fprintf (stderr, "no file specified\n");
+    exit (1);
+  }
+
+  data = mp4tag_read_file (argv [optind], &datasz, &mp4error);
+  if (data == NULL) {
+    fprintf (stderr, "unable to read %s\n", argv [optind]);
+    exit (1);
+  }
+
+  stress = malloc (sizeof (stress_t) * threads);
+  fn = malloc (sizeof (char *) * threads);
+  if (stress == NULL || fn == NULL) {
+    exit (1);
+  }
+
+  for (int i = 0; i < threads; ++i) {
+    FILE    *fh;
+
+    snprintf (stress [i].fn, sizeof (stress [i].fn),
+        "mp4tagstress-%03d.m4a", i);
+    stress [i].tidx = i;
+    stress [i].iterations = iterations;
+    stress [i].failed = 0;
+    stress [i].manyfailed = false;
+    fn [i] = stress [i].fn;
+
+    fh = mp4tag_fopen (stress [i].fn, "wb");
+    if (fh == NULL || fwrite (data, datasz, 1, fh) != 1) {
+      fprintf (stderr, "unable to create %s\n", stress [i].fn);
+      exit (1);
+    }
+    fclose (fh);
+  }
+  free (data);
+
+  for (int i = 0; i < threads; ++i) {
+    if (pthread_create (&stress [i].thread, NULL, stress_thread,
+        &stress [i]) != 0) {
+      fprintf (stderr, "unable to start thread %d\n", i);
+      exit (1);
+    }
+  }
+  for (int i = 0; i < threads; ++i) {
+    pthread_join (stress [i].thread, NULL);
+    failed += stress [i].failed;
+  }
+
+  /* the last value written by each thread is checked again, */
+  /* with the parse of every copy running on the worker threads */
+  if (mp4tag_parse_many (fn, threads, 0, stress_manycb,
+      stress, NULL, NULL) != MP4TAG_OK) {
+    fprintf (stderr, "mp4tag_parse_many failed\n");
+    manyfailed = 1;
+  }
+  for (int i = 0; i < threads; ++i) {
+    if (stress [i].manyfailed) {
+      manyfailed += 1;
+    }
+  }
+
+  getfailed = stress_shared (stress [0].fn, threads, iterations);
+
+  for (int i = 0; i < threads; ++i) {
+    mp4tag_file_delete (stress [i].fn);
+  }
+
+  free (fn);
+  free (stress);
+
+  if (failed > 0 || manyfailed > 0 || getfailed > 0) {
+    fprintf (stdout, "failed: %d write/verify %d parse-many %d get\n",
+        failed, manyfailed, getfailed);
+    return 1;
+  }
+  fprintf (stdout, "ok: %d threads %d iterations\n", threads, iterations);
+  return 0;
+}
+
+static void *
+stress_thread (void *arg)
+{
+  stress_t    *stress = arg;
+
+  for (int i = 0; i < stress->iterations; ++i) {
+    if (stress_write (stress, i) != 0) {
+      stress->failed += 1;
+    }
+  }
+
+  return NULL;
+}
+
+static int
+stress_write (stress_t *stress, int iter)
+{
+  libmp4tag_t   *libmp4tag;
+  mp4tagpub_t   items [2];
+  char          buff [STRESS_DATA_SZ];
+  int           mp4error;
+  int           rc;
+
+  libmp4tag = mp4tag_open (stress->fn, &mp4error);
+  if (libmp4tag == NULL) {
+    fprintf (stderr, "%s: unable to open (%d)\n", stress->fn, mp4error);
+    return -1;
+  }
+  rc = mp4tag_parse (libmp4tag);
+  if (rc == MP4TAG_OK && iter > 0) {
+    /* the previous iteration's tags must still be present */
+    rc = stress_verify (libmp4tag, stress->tidx, iter - 1);
+  }
+  if (rc == MP4TAG_OK) {
+    stress_data (buff, sizeof (buff), stress->tidx, iter);
+    /* the title is set again along with the custom tag */
+    rc = mp4tag_set_tag (libmp4tag, STRESS_TITLE, buff, false);
+  }
+  if (rc == MP4TAG_OK) {
+    memset (items, 0, sizeof (items));
+    items [0].tag = STRESS_TAG;
+    items [0].data = buff;
+    items [1].tag = STRESS_TITLE;
+    items [1].data = buff;
+    rc = mp4tag_set_tags (libmp4tag, items, 2);
+  }
+  if (rc == MP4TAG_OK) {
+    rc = mp4tag_write_tags (libmp4tag);
+  }
+  if (rc != MP4TAG_OK) {
+    fprintf (stderr, "%s: %d: write failed (%s)\n", stress->fn, iter,
+        mp4tag_error_str (libmp4tag));
+    mp4tag_free (libmp4tag);
+    return -1;
+  }
+  mp4tag_free (libmp4tag);
+
+  libmp4tag = mp4tag_open_readonly (stress->fn, &mp4error);
+  if (libmp4tag == NULL) {
+    fprintf (stderr, "%s: unable to re-open (%d)\n", stress->fn, mp4error);
+    return -1;
+  }
+  rc = mp4tag_parse (libmp4tag);
+  if (rc == MP4TAG_OK) {
+    rc = stress_verify (libmp4tag, stress->tidx, iter);
+  }
+  mp4tag_free (libmp4tag);
+
+  return rc == MP4TAG_OK ? 0 : -1;
+}
+
+static int
+stress_verify (libmp4tag_t *libmp4tag, int tidx, int iter)
+{
+  mp4tagpub_t   mp4tagpub;
+  char          buff [STRESS_DATA_SZ];
+  const char    *tags [] = { STRESS_TITLE, STRESS_TAG };
+
+  stress_data (buff, sizeof (buff), tidx, iter);
+  for (size_t i = 0; i < sizeof (tags) / sizeof (const char *); ++i) {
+    if (mp4tag_get_tag_by_name (libmp4tag, tags [i], &mp4tagpub) != MP4TAG_OK ||
+        mp4tagpub.data == NULL ||
+        strcmp (mp4tagpub.data, buff) != 0) {
+      fprintf (stderr, "thread %d: %d: %s mismatch\n", tidx, iter, tags [i]);
+      return MP4TAG_ERR_MISMATCH;
+    }
+  }
+
+  return MP4TAG_OK;
+}
+
+static void
+stress_data (char *buff, size_t sz, int tidx, int iter)
+{
+  snprintf (buff, sz, "thread %03d iteration %d", tidx, iter);
+}
+
+/* called on the mp4tag_parse_many worker threads. */
+/* each callback only changes the entry for its own file */
+static void
+stress_manycb (libmp4tag_t *libmp4tag, int idx, int mp4error, void *udata)
+{
+  stress_t  *stress = udata;
+
+  if (libmp4tag == NULL || mp4error != MP4TAG_OK ||
+      stress_verify (libmp4tag, idx, stress [idx].iterations - 1) != MP4TAG_OK) {
+    fprintf (stderr, "parse-many: %d: failed (%d)\n", idx, mp4error);
+    stress [idx].manyfailed = true;
+  }
+}
+
+/* the threads get the same tags from one handle at the same time. */
+/* a new handle is parsed for each iteration, so that the cover */
+/* images are loaded by the threads each time */
+static int
+stress_shared (const char *fn, int threads, int iterations)
+{
+  libmp4tag_t   *reflibmp4tag;
+  stressget_t   *stressget;
+  mp4tagpub_t   reference [STRESS_GET_COUNT];
+  int           referencerc [STRESS_GET_COUNT];
+  int           mp4error;
+  int           failed = 0;
+
+  reflibmp4tag = mp4tag_open (fn, &mp4error);
+  if (reflibmp4tag == NULL || mp4tag_parse (reflibmp4tag) != MP4TAG_OK) {
+    fprintf (stderr, "%s: shared: unable to open (%d)\n", fn, mp4error);
+    mp4tag_free (reflibmp4tag);
+    return 1;
+  }
+  for (int i = 0; i < STRESS_GET_COUNT; ++i) {
+    referencerc [i] = mp4tag_get_tag_by_name (reflibmp4tag,
+        STRESS_GET_TAGS [i], &reference [i]);
+  }
+
+  stressget = malloc (sizeof (stressget_t) * threads);
+  if (stressget == NULL) {
+    mp4tag_free (reflibmp4tag);
+    return 1;
+  }
+
+  for (int iter = 0; iter < iterations; ++iter) {
+    libmp4tag_t   *libmp4tag;
+
+    libmp4tag = mp4tag_open (fn, &mp4error);
+    if (libmp4tag == NULL || mp4tag_parse (libmp4tag) != MP4TAG_OK) {
+      fprintf (stderr, "%s: shared: unable to open (%d)\n", fn, mp4error);
+      mp4tag_free (libmp4tag);
+      failed += 1;
+      break;
+    }
+
+    for (int i = 0; i < threads; ++i) {
+      stressget [i].libmp4tag = libmp4tag;
+      stressget [i].reference = reference;
+      stressget [i].referencerc = referencerc;
+      stressget [i].failed = 0;
+      if (pthread_create (&stressget [i].thread, NULL, stress_get_thread,
+          &stressget [i]) != 0) {
+        fprintf (stderr, "unable to start thread %d\n", i);
+        exit (1);
+      }
+    }
+    for (int i = 0; i < threads; ++i) {
+      pthread_join (stressget [i].thread, NULL);
+      failed += stressget [i].failed;
+    }
+
+    mp4tag_free (libmp4tag);
+  }
+
+  free (stressget);
+  mp4tag_free (reflibmp4tag);
+
+  return failed;
+}
+
+static void *
+stress_get_thread (void *arg)
+{
+  stressget_t   *stressget = arg;
+  mp4tagpub_t   mp4tagpub;
+  int           rc;
+
+  for (int i = 0; i < STRESS_GET_REPEAT; ++i) {
+    for (int j = 0; j < STRESS_GET_COUNT; ++j) {
+      const mp4tagpub_t   *ref = &stressget->reference [j];
+
+      rc = mp4tag_get_tag_by_name (stressget->libmp4tag,
+          STRESS_GET_TAGS [j], &mp4tagpub);
+      if (rc != stressget->referencerc [j]) {
+        fprintf (stderr, "shared: %s: rc %d\n", STRESS_GET_TAGS [j], rc);
+        stressget->failed += 1;
+        continue;
+      }
+      if (rc != MP4TAG_OK) {
+        continue;
+      }
+      if (mp4tagpub.data == NULL ||
+          mp4tagpub.datalen != ref->datalen ||
+          memcmp (mp4tagpub.data, ref->data, ref->datalen) != 0) {
+        fprintf (stderr, "shared: %s: mismatch\n", STRESS_GET_TAGS [j]);
+        stressget->failed += 1;
+      }
+    }
+  }
+
+  return NULL;
+}